@@ -21,9 +21,6 @@
  * commercial activities involving this program without disclosing the source
  * code of your own applications
  */
-#include <deque>
-#include <thread>
-#include <condition_variable>
 #include <string.h>
 #include <curl/curl.h>
 #include <evcollect/evcollect.h>
@@ -39,7 +36,6 @@ class EventQLTarget {
 public:
 
   static const size_t kDefaultHTTPTimeoutMicros = 30 * kMicrosPerSecond;
-  static const size_t kDefaultMaxQueueLength = 8192;
 
   EventQLTarget(
       const std::string& hostname,
@@ -47,24 +43,26 @@ public:
 
   ~EventQLTarget();
 
-  void addRoute(
+  ReturnCode addRoute(
       const std::string& event_name_match,
       const std::string& target);
 
   void setHTTPTimeout(uint64_t usecs);
-  void setMaxQueueLength(size_t queue_len);
 
   void setAuthToken(const std::string& auth_token);
   void setCredentials(
       const std::string& username,
       const std::string& password);
 
-  ReturnCode emitEvent(
-    const std::string& event_name,
-    const std::string& event_data);
+  ReturnCode emitEvent(const evcollect_event_t* event);
 
-  ReturnCode startUploadThread();
-  void stopUploadThread();
+  /**
+   * Upload the events in a single insert request. Returns an error unless
+   * every event was inserted, so that the delivery queue retries the batch
+   */
+  ReturnCode emitEvents(
+    const evcollect_event_t** events,
+    size_t events_count);
 
 protected:
 
@@ -73,36 +71,31 @@ protected:
     std::string table;
   };
 
-  struct EnqueuedEvent {
-    std::string database;
-    std::string table;
-    std::string data;
-  };
-
   struct EventRouting {
     std::string event_name_match;
-    std::string target;
+    TargetTable target;
+  };
+
+  struct CachedRouting {
+    bool resolved;
+    std::vector<const TargetTable*> targets;
   };
 
-  ReturnCode enqueueEvent(const EnqueuedEvent& event);
-  bool awaitEvent(EnqueuedEvent* event);
-  ReturnCode uploadEvent(const EnqueuedEvent& event);
+  const CachedRouting& resolveRoutes(const evcollect_event_t* event);
+
+  void routeEvent(const evcollect_event_t* event, std::string* body);
+  ReturnCode uploadEvents(const std::string& body);
 
   std::string hostname_;
   uint16_t port_;
   std::string username_;
   std::string password_;
   std::string auth_token_;
-  std::deque<EnqueuedEvent> queue_;
-  mutable std::mutex mutex_;
-  mutable std::condition_variable cv_;
-  size_t queue_max_length_;
-  std::thread thread_;
-  bool thread_running_;
-  bool thread_shutdown_;
   std::vector<EventRouting> routes_;
+  std::vector<CachedRouting> route_cache_;
   CURL* curl_;
   uint64_t http_timeout_;
+  evcollect_histogram_t* upload_rtt_;
 };
 
 EventQLTarget::EventQLTarget(
@@ -110,11 +103,16 @@ EventQLTarget::EventQLTarget(
     uint16_t port) :
     hostname_(hostname),
     port_(port),
-    queue_max_length_(kDefaultMaxQueueLength),
-    thread_running_(false),
     curl_(nullptr),
     http_timeout_(kDefaultHTTPTimeoutMicros) {
   curl_ = curl_easy_init();
+
+  auto histogram_name = StringUtil::format(
+      "eventql.upload_rtt.$0:$1",
+      hostname_,
+      port_);
+
+  upload_rtt_ = evcollect_histogram_get(histogram_name.c_str());
 }
 
 EventQLTarget::~EventQLTarget() {
@@ -123,13 +121,23 @@ EventQLTarget::~EventQLTarget() {
   }
 }
 
-void EventQLTarget::addRoute(
+ReturnCode EventQLTarget::addRoute(
     const std::string& event_name_match,
     const std::string& target) {
+  auto target_parts = StringUtil::split(target, "/");
+  if (target_parts.size() != 2) {
+    return ReturnCode::error(
+        "EINVAL",
+        "invalid target specification. " \
+        "format is: database/table");
+  }
+
   EventRouting r;
   r.event_name_match = event_name_match;
-  r.target = target;
+  r.target.database = target_parts[0];
+  r.target.table = target_parts[1];
   routes_.emplace_back(r);
+  return ReturnCode::success();
 }
 
 void EventQLTarget::setAuthToken(const std::string& auth_token) {
@@ -147,118 +155,78 @@ void EventQLTarget::setHTTPTimeout(uint64_t usecs) {
   http_timeout_ = usecs;
 }
 
-void EventQLTarget::setMaxQueueLength(size_t queue_len) {
-  queue_max_length_ = queue_len;
+ReturnCode EventQLTarget::emitEvent(const evcollect_event_t* event) {
+  return emitEvents(&event, 1);
 }
 
-ReturnCode EventQLTarget::emitEvent(
-    const std::string& event_name,
-    const std::string& event_data) {
-  for (const auto& route : routes_) {
-    if (route.event_name_match != event_name) {
-      continue;
-    }
-
-    auto target = StringUtil::split(route.target, "/");
-    if (target.size() != 2) {
-      return ReturnCode::error(
-          "EINVAL",
-          "invalid target specification. " \
-          "format is: database/table");
-    }
-
-    EnqueuedEvent e;
-    e.database = target[0];
-    e.table = target[1];
-    e.data = event_data;
+ReturnCode EventQLTarget::emitEvents(
+    const evcollect_event_t** events,
+    size_t events_count) {
+  std::string body;
+  for (size_t i = 0; i < events_count; ++i) {
+    routeEvent(events[i], &body);
+  }
 
-    auto rc = enqueueEvent(e);
-    if (!rc.isSuccess()) {
-      return rc;
-    }
+  if (body.empty()) {
+    return ReturnCode::success();
   }
 
-  return ReturnCode::success();
+  body.insert(0, "[");
+  body += "]";
+  return uploadEvents(body);
 }
 
-ReturnCode EventQLTarget::enqueueEvent(const EnqueuedEvent& event) {
-  std::unique_lock<std::mutex> lk(mutex_);
-
-  while (queue_.size() >= queue_max_length_) {
-    cv_.wait(lk);
+const EventQLTarget::CachedRouting& EventQLTarget::resolveRoutes(
+    const evcollect_event_t* event) {
+  /* routes are resolved by name once per event id and then looked up by id;
+     names that were set at runtime have id 0 and are resolved every time */
+  auto event_id = evcollect_event_getid(event);
+  if (event_id >= route_cache_.size()) {
+    route_cache_.resize(event_id + 1, CachedRouting { false, {} });
   }
 
-  queue_.emplace_back(event);
-  cv_.notify_all();
+  auto& cached = route_cache_[event_id];
+  if (cached.resolved && event_id != 0) {
+    return cached;
+  }
 
-  return ReturnCode::success();
-}
+  cached.targets.clear();
 
-bool EventQLTarget::awaitEvent(EnqueuedEvent* event) {
-  std::unique_lock<std::mutex> lk(mutex_);
+  const char* event_name;
+  size_t event_name_len;
+  evcollect_event_getname(event, &event_name, &event_name_len);
 
-  if (queue_.size() == 0) {
-    cv_.wait(lk);
+  for (const auto& route : routes_) {
+    if (route.event_name_match.size() == event_name_len &&
+        !memcmp(route.event_name_match.data(), event_name, event_name_len)) {
+      cached.targets.emplace_back(&route.target);
+    }
   }
 
-  if (queue_.size() == 0) {
-    return false;
-  } else {
-    *event = queue_.front();
-    queue_.pop_front();
-    cv_.notify_all();
-    return true;
-  }
+  cached.resolved = true;
+  return cached;
 }
 
-ReturnCode EventQLTarget::startUploadThread() {
-  if (thread_running_) {
-    return ReturnCode::error("RTERROR", "upload thread is already running");
-  }
-
-  auto upload_thread = [this] () {
-    while (true) {
-      {
-        std::unique_lock<std::mutex> lk(mutex_);
-        if (thread_shutdown_) {
-          return;
-        }
-      }
-
-      EnqueuedEvent ev;
-      if (!awaitEvent(&ev)) {
-        continue;
-      }
-
-      auto rc = uploadEvent(ev);
-      if (!rc.isSuccess()) {
-        auto msg = StringUtil::format(
-            "error while uploading event to $0/$1: $2", 
-            ev.database,
-            ev.table,
-            rc.getMessage());
+/* appends one row per target table the event is routed to */
+void EventQLTarget::routeEvent(
+    const evcollect_event_t* event,
+    std::string* body) {
+  const char* ev_data;
+  size_t ev_data_len;
+  evcollect_event_getdata(event, &ev_data, &ev_data_len);
 
-        evcollect_log(EVCOLLECT_LOG_ERROR, msg.c_str());
-      }
+  for (const auto target : resolveRoutes(event).targets) {
+    if (!body->empty()) {
+      *body += ",";
     }
-  };
 
-  std::unique_lock<std::mutex> lk(mutex_);
-  thread_running_ = true;
-  thread_shutdown_ = false;
-  thread_ = std::thread(upload_thread);
-  return ReturnCode::success();
-}
-
-void EventQLTarget::stopUploadThread() {
-  if (!thread_running_) {
-    return;
+    *body += StringUtil::format(
+        R"({ "database": "$0", "table": "$1", "data": )",
+        StringUtil::jsonEscape(target->database),
+        StringUtil::jsonEscape(target->table));
+    body->append(ev_data, ev_data_len);
+    *body += "}";
   }
-
-  thread_shutdown_ = true;
-  cv_.notify_all();
-  thread_.join();
-  thread_running_ = false;
 }
 
 namespace {
@@ -271,23 +239,12 @@ size_t curl_write_cb(void* data, size_t size, size_t nmemb, std::string* s) {
 }
 }
 
-ReturnCode EventQLTarget::uploadEvent(const EnqueuedEvent& ev) {
+ReturnCode EventQLTarget::uploadEvents(const std::string& body) {
   auto url = StringUtil::format(
       "http://$0:$1/api/v1/tables/insert",
       hostname_,
       port_);
 
-  std::string body;
-  body += "[{ ";
-  body += StringUtil::format(
-      "\"database\": \"$0\",",
-      StringUtil::jsonEscape(ev.database));
-  body += StringUtil::format(
-      "\"table\": \"$0\"",
-      StringUtil::jsonEscape(ev.table));
-  body += "\"data\":" + ev.data;
-  body += "}]";
-
   if (!curl_) {
     return ReturnCode::error("EIO", "curl_init() failed");
   }
@@ -311,9 +268,12 @@ ReturnCode EventQLTarget::uploadEvent(const EnqueuedEvent& ev) {
   std::string res_body;
   curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
   curl_easy_setopt(curl_, CURLOPT_TIMEOUT_MS, http_timeout_ / kMicrosPerMilli);
-  curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, body.c_str());
+  curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, req_headers);
+  curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, body.data());
+  curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, long(body.size()));
   curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, curl_write_cb);
   curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &res_body);
+  auto t0 = MonotonicClock::now();
   CURLcode curl_res = curl_easy_perform(curl_);
   curl_slist_free_all(req_headers);
   if (curl_res != CURLE_OK) {
@@ -323,6 +283,8 @@ ReturnCode EventQLTarget::uploadEvent(const EnqueuedEvent& ev) {
         curl_easy_strerror(curl_res));
   }
 
+  evcollect_histogram_record(upload_rtt_, MonotonicClock::now() - t0);
+
   long http_res_code = 0;
   curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_res_code);
 
@@ -413,17 +375,13 @@ int pluginAttach(
     target->setHTTPTimeout(http_timeout);
   }
 
+  /* events are no longer queued by the plugin itself */
   const char* queue_maxlen_opt;
   if (evcollect_plugin_getcfg(cfg, "queue_maxlen", &queue_maxlen_opt)) {
-    uint64_t queue_maxlen;
-    try {
-      queue_maxlen = std::stoull(queue_maxlen_opt);
-    } catch (...) {
-      evcollect_seterror(ctx, "invalid value for queue_maxlen");
-      return false;
-    }
-
-    target->setMaxQueueLength(queue_maxlen);
+    evcollect_log(
+        EVCOLLECT_LOG_WARNING,
+        "eventql: queue_maxlen is deprecated and ignored, use "
+        "delivery_queue_length instead");
   }
 
   for (int i = 0; ; ++i) {
@@ -449,18 +407,19 @@ int pluginAttach(
       return false;
     }
 
-    target->addRoute(route[0], route[1]);
+    auto rc = target->addRoute(route[0], route[1]);
+    if (!rc.isSuccess()) {
+      evcollect_seterror(ctx, rc.getMessage().c_str());
+      return false;
+    }
   }
 
-  target->startUploadThread();
   *userdata = target.release();
   return true;
 }
 
 int pluginDetach(evcollect_ctx_t* ctx, void* userdata) {
-  auto target = static_cast<EventQLTarget*>(userdata);
-  target->stopUploadThread();
-  delete target;
+  delete static_cast<EventQLTarget*>(userdata);
   return true;
 }
 
@@ -470,18 +429,24 @@ int pluginEmitEvent(
     const evcollect_event_t* event) {
   auto target = static_cast<EventQLTarget*>(userdata);
 
-  const char* ev_name;
-  size_t ev_name_len;
-  evcollect_event_getname(event, &ev_name, &ev_name_len);
+  auto rc = target->emitEvent(event);
 
-  const char* ev_data;
-  size_t ev_data_len;
-  evcollect_event_getdata(event, &ev_data, &ev_data_len);
+  if (rc.isSuccess()) {
+    return 1;
+  } else {
+    evcollect_seterror(ctx, rc.getMessage().c_str());
+    return 0;
+  }
+}
 
-  auto rc = target->emitEvent(
-      std::string(ev_name, ev_name_len),
-      std::string(ev_data, ev_data_len));
+int pluginEmitEvents(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t** events,
+    size_t events_count) {
+  auto target = static_cast<EventQLTarget*>(userdata);
 
+  auto rc = target->emitEvents(events, events_count);
   if (rc.isSuccess()) {
     return 1;
   } else {
@@ -494,10 +459,11 @@ int pluginEmitEvent(
 } // namespace evcollect
 
 EVCOLLECT_PLUGIN_INIT(eventql) {
-  evcollect_output_plugin_register(
+  evcollect_output_plugin_register_batched(
       ctx,
       "eventql",
       &evcollect::plugin_eventql::pluginEmitEvent,
+      &evcollect::plugin_eventql::pluginEmitEvents,
       &evcollect::plugin_eventql::pluginAttach,
       &evcollect::plugin_eventql::pluginDetach,
       NULL,
@@ -0,0 +1,305 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <evcollect/checkpoint_store.h>
+#include <evcollect/util/crc32.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+/* file: magic, version, records. record: key, inode, offset, fingerprint,
+   fingerprint size, crc32 of the preceding fields. all integers are little
+   endian */
+const char kMagic[4] = { 'E', 'V', 'C', 'P' };
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t);
+const size_t kRecordDataSize =
+    SHA1Hash::kSize + sizeof(uint64_t) * 2 + sizeof(uint32_t) * 2;
+const size_t kRecordSize = kRecordDataSize + sizeof(uint32_t);
+
+} // namespace
+
+CheckpointStore::CheckpointStore(
+    const std::string& path,
+    uint64_t flush_interval_micros) :
+    path_(path),
+    flush_interval_micros_(flush_interval_micros),
+    dirty_(false),
+    last_flush_(0) {}
+
+ReturnCode CheckpointStore::load() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  checkpoints_.clear();
+
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return ReturnCode::success();
+    }
+
+    return ReturnCode::error(
+        "IOERR",
+        "open('%s') failed: %s",
+        path_.c_str(),
+        strerror(errno));
+  }
+
+  std::string data;
+  char buf[65536];
+  for (;;) {
+    auto len = read(fd, buf, sizeof(buf));
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (len <= 0) {
+      break;
+    }
+
+    data.append(buf, len);
+  }
+
+  close(fd);
+
+  if (data.size() < kHeaderSize || memcmp(data.data(), kMagic, 4) != 0) {
+    return ReturnCode::error(
+        "EIO",
+        "invalid checkpoint file: %s",
+        path_.c_str());
+  }
+
+  uint32_t version;
+  memcpy(&version, data.data() + sizeof(kMagic), sizeof(version));
+  if (version != kVersion) {
+    return ReturnCode::error(
+        "EIO",
+        "unsupported checkpoint file version %u: %s",
+        version,
+        path_.c_str());
+  }
+
+  size_t invalid = 0;
+  for (size_t pos = kHeaderSize; pos + kRecordSize <= data.size();
+       pos += kRecordSize) {
+    auto record = data.data() + pos;
+
+    uint32_t crc;
+    memcpy(&crc, record + kRecordDataSize, sizeof(crc));
+    if (CRC32::compute(record, kRecordDataSize) != crc) {
+      ++invalid;
+      continue;
+    }
+
+    Checkpoint checkpoint;
+    auto field = record + SHA1Hash::kSize;
+    memcpy(&checkpoint.inode, field, sizeof(uint64_t));
+    field += sizeof(uint64_t);
+    memcpy(&checkpoint.offset, field, sizeof(uint64_t));
+    field += sizeof(uint64_t);
+    memcpy(&checkpoint.fingerprint, field, sizeof(uint32_t));
+    field += sizeof(uint32_t);
+    memcpy(&checkpoint.fingerprint_size, field, sizeof(uint32_t));
+
+    checkpoints_[SHA1Hash(record, SHA1Hash::kSize)] = checkpoint;
+  }
+
+  if (invalid > 0 || (data.size() - kHeaderSize) % kRecordSize != 0) {
+    logWarning(
+        "Skipped $0 corrupt records in checkpoint file $1",
+        invalid,
+        path_);
+  }
+
+  return ReturnCode::success();
+}
+
+bool CheckpointStore::get(const SHA1Hash& key, Checkpoint* checkpoint) const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  auto iter = checkpoints_.find(key);
+  if (iter == checkpoints_.end()) {
+    return false;
+  }
+
+  *checkpoint = iter->second;
+  return true;
+}
+
+bool CheckpointStore::Checkpoint::operator==(const Checkpoint& o) const {
+  return
+      inode == o.inode &&
+      offset == o.offset &&
+      fingerprint == o.fingerprint &&
+      fingerprint_size == o.fingerprint_size;
+}
+
+void CheckpointStore::set(const SHA1Hash& key, const Checkpoint& checkpoint) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  auto iter = checkpoints_.find(key);
+  if (iter != checkpoints_.end() && iter->second == checkpoint) {
+    return;
+  }
+
+  checkpoints_[key] = checkpoint;
+  dirty_ = true;
+}
+
+void CheckpointStore::remove(const SHA1Hash& key) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (checkpoints_.erase(key) > 0) {
+    dirty_ = true;
+  }
+}
+
+size_t CheckpointStore::size() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return checkpoints_.size();
+}
+
+ReturnCode CheckpointStore::flushIfDue() {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (!dirty_ ||
+        MonotonicClock::now() - last_flush_ < flush_interval_micros_) {
+      return ReturnCode::success();
+    }
+  }
+
+  return flush();
+}
+
+ReturnCode CheckpointStore::flush() {
+  /* serializes snapshots so that an older one never replaces a newer one */
+  std::unique_lock<std::mutex> flush_lk(flush_mutex_);
+
+  std::string data;
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (!dirty_) {
+      return ReturnCode::success();
+    }
+
+    data.reserve(kHeaderSize + checkpoints_.size() * kRecordSize);
+    data.append(kMagic, sizeof(kMagic));
+    data.append((const char*) &kVersion, sizeof(kVersion));
+    for (const auto& c : checkpoints_) {
+      auto pos = data.size();
+      data.append((const char*) c.first.data(), SHA1Hash::kSize);
+      data.append((const char*) &c.second.inode, sizeof(uint64_t));
+      data.append((const char*) &c.second.offset, sizeof(uint64_t));
+      data.append((const char*) &c.second.fingerprint, sizeof(uint32_t));
+      data.append((const char*) &c.second.fingerprint_size, sizeof(uint32_t));
+
+      uint32_t crc = CRC32::compute(data.data() + pos, kRecordDataSize);
+      data.append((const char*) &crc, sizeof(crc));
+    }
+
+    dirty_ = false;
+    last_flush_ = MonotonicClock::now();
+  }
+
+  auto rc = writeSnapshot(data);
+  if (!rc.isSuccess()) {
+    std::unique_lock<std::mutex> lk(mutex_);
+    dirty_ = true;
+  }
+
+  return rc;
+}
+
+ReturnCode CheckpointStore::writeSnapshot(const std::string& data) {
+  auto tmp_path = path_ + ".tmp";
+  int fd = open(
+      tmp_path.c_str(),
+      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0666);
+
+  if (fd < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "open('%s') failed: %s",
+        tmp_path.c_str(),
+        strerror(errno));
+  }
+
+  for (size_t pos = 0; pos < data.size(); ) {
+    auto len = write(fd, data.data() + pos, data.size() - pos);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (len < 0) {
+      auto err = errno;
+      close(fd);
+      return ReturnCode::error(
+          "IOERR",
+          "write('%s') failed: %s",
+          tmp_path.c_str(),
+          strerror(err));
+    }
+
+    pos += len;
+  }
+
+  if (fsync(fd) < 0) {
+    auto err = errno;
+    close(fd);
+    return ReturnCode::error(
+        "IOERR",
+        "fsync('%s') failed: %s",
+        tmp_path.c_str(),
+        strerror(err));
+  }
+
+  close(fd);
+
+  if (rename(tmp_path.c_str(), path_.c_str()) < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "rename('%s') failed: %s",
+        tmp_path.c_str(),
+        strerror(errno));
+  }
+
+  /* make the rename itself durable */
+  std::vector<char> dir_path(path_.begin(), path_.end());
+  dir_path.emplace_back(0);
+  int dir_fd = open(dirname(dir_path.data()), O_RDONLY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  return ReturnCode::success();
+}
+
+} // namespace evcollect
+
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <evcollect/util/return_code.h>
+#include <evcollect/util/sha1.h>
+
+namespace evcollect {
+
+/**
+ * Stores the read positions of all tailed logfiles in a single file. Updates
+ * are kept in memory and written together on flush as a new snapshot (temp
+ * file, fsync, rename), so a crash leaves either the previous or the new
+ * snapshot. Every record carries a CRC32; records that fail the check are
+ * skipped when the store is loaded
+ */
+class CheckpointStore {
+public:
+
+  struct Checkpoint {
+    Checkpoint() :
+        inode(0),
+        offset(0),
+        fingerprint(0),
+        fingerprint_size(0) {}
+
+    uint64_t inode;
+    uint64_t offset;
+
+    /* crc32 of the first fingerprint_size bytes of the file; identifies the
+       file after it was rotated and compressed */
+    uint32_t fingerprint;
+    uint32_t fingerprint_size;
+
+    bool operator==(const Checkpoint& o) const;
+  };
+
+  static const uint64_t kDefaultFlushIntervalMicros = 10000000;
+
+  CheckpointStore(
+      const std::string& path,
+      uint64_t flush_interval_micros = kDefaultFlushIntervalMicros);
+
+  ReturnCode load();
+
+  bool get(const SHA1Hash& key, Checkpoint* checkpoint) const;
+  void set(const SHA1Hash& key, const Checkpoint& checkpoint);
+  void remove(const SHA1Hash& key);
+
+  /**
+   * Write a new snapshot if anything changed since the last one
+   */
+  ReturnCode flush();
+
+  /**
+   * Like flush, but at most once per flush interval
+   */
+  ReturnCode flushIfDue();
+
+  size_t size() const;
+
+protected:
+
+  ReturnCode writeSnapshot(const std::string& data);
+
+  std::string path_;
+  uint64_t flush_interval_micros_;
+  mutable std::mutex mutex_;
+  std::mutex flush_mutex_;
+  std::unordered_map<SHA1Hash, Checkpoint> checkpoints_;
+  bool dirty_;
+  uint64_t last_flush_;
+};
+
+} // namespace evcollect
+
@@ -23,6 +23,7 @@
  * code of your own applications
  */
 #include <initializer_list>
+#include <limits>
 #include <unordered_map>
 #include <sstream>
 #include <fstream>
@@ -30,6 +31,7 @@
 #include <evcollect/config.h>
 #include <evcollect/util/stringutil.h>
 #include <evcollect/util/logging.h>
+#include <evcollect/util/time.h>
 
 template<>
 std::string StringUtil::toString(evcollect::ConfigToken value) {
@@ -117,6 +119,29 @@ ReturnCode loadConfig(
   return ReturnCode::success();
 }
 
+static bool parseUInt(const std::string& str, uint64_t* out) {
+  if (str.empty()) {
+    return false;
+  }
+
+  uint64_t value = 0;
+  for (auto c : str) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+
+    uint64_t digit = c - '0';
+    if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+      return false;
+    }
+
+    value = value * 10 + digit;
+  }
+
+  *out = value;
+  return true;
+}
+
 bool PropertyList::get(const std::string& key, std::string* out) const {
   for (const auto& p : properties) {
     if (p.first != key) {
@@ -192,6 +217,23 @@ size_t PropertyList::get(
   return cnt;
 }
 
+ReturnCode PropertyList::getUInt(const std::string& key, uint64_t* out) const {
+  std::string str;
+  if (!get(key, &str)) {
+    return ReturnCode::success();
+  }
+
+  if (!parseUInt(str, out)) {
+    return ReturnCode::error(
+        "EINVAL",
+        "invalid value for %s: %s",
+        key.c_str(),
+        str.c_str());
+  }
+
+  return ReturnCode::success();
+}
+
 static const int CR = '\r';
 static const int LF = '\n';
 
@@ -630,7 +672,28 @@ ReturnCode ConfigParser::applyEventProperties(const PropertyList& props,
                                               EventConfig* output) {
 
   for (const auto& prop: props.properties) {
-    if (prop.first == "interval") {
+    uint64_t* budget = nullptr;
+    uint64_t budget_scale = 1;
+    if (prop.first == "tick_budget_events") {
+      budget = &output->tick_budget_events;
+    } else if (prop.first == "tick_budget_bytes") {
+      budget = &output->tick_budget_bytes;
+    } else if (prop.first == "tick_budget_time") {
+      budget = &output->tick_budget_micros;
+      budget_scale = kMicrosPerMilli;
+    }
+
+    if (budget) {
+      if (prop.second.empty() || !parseUInt(prop.second[0], budget)) {
+        return ReturnCode::error(
+            "EINVAL",
+            "invalid value for %s: %s",
+            prop.first.c_str(),
+            prop.second.empty() ? "" : prop.second[0].c_str());
+      }
+
+      *budget *= budget_scale;
+    } else if (prop.first == "interval") {
       output->interval_micros = 1000000; // TODO: parseTime(prop.second[0]) FIXME not sure if that's meant like this
     } else {
       logWarning("Ignoring unsupported property \"%s\".", prop.first);
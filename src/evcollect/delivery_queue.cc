@@ -0,0 +1,815 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <chrono>
+#include <evcollect/delivery_queue.h>
+#include <evcollect/event_names.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+/* spool record header: time (u64), name length (u32), data length (u32) */
+const size_t kSpoolHeaderSize = sizeof(uint64_t) + sizeof(uint32_t) * 2;
+
+/* set in the name length if the payload is MessagePack encoded */
+const uint32_t kSpoolMsgPackFlag = uint32_t(1) << 31;
+
+} // namespace
+
+ReturnCode parseOverflowPolicy(
+    const std::string& str,
+    OverflowPolicy* policy) {
+  if (str == "block") {
+    *policy = OverflowPolicy::BLOCK;
+    return ReturnCode::success();
+  }
+
+  if (str == "drop_oldest") {
+    *policy = OverflowPolicy::DROP_OLDEST;
+    return ReturnCode::success();
+  }
+
+  if (str == "drop_newest") {
+    *policy = OverflowPolicy::DROP_NEWEST;
+    return ReturnCode::success();
+  }
+
+  if (str == "spill") {
+    *policy = OverflowPolicy::SPILL;
+    return ReturnCode::success();
+  }
+
+  return ReturnCode::error(
+      "EINVAL",
+      "invalid overflow policy '%s'; " \
+      "must be one of block, drop_oldest, drop_newest, spill",
+      str.c_str());
+}
+
+DeliveryQueue::DeliveryQueue(
+    const std::string& name,
+    OutputPlugin* plugin,
+    void* userdata) :
+    name_(name),
+    plugin_(plugin),
+    userdata_(userdata),
+    policy_(OverflowPolicy::BLOCK),
+    capacity_(kDefaultCapacity),
+    high_watermark_(kDefaultCapacity * 3 / 4),
+    low_watermark_(kDefaultCapacity / 4),
+    batch_size_(kDefaultBatchSize),
+    max_retries_(kDefaultMaxRetries),
+    above_high_watermark_(false),
+    paused_(false),
+    flush_requested_(0),
+    flush_completed_(0),
+    flush_rc_(ReturnCode::success()),
+    dropped_(0),
+    delivered_events_(0),
+    delivered_bytes_(0),
+    retries_(0),
+    failed_(0),
+    enqueued_sequence_(0),
+    pending_sequenced_(0),
+    ack_stalled_(false),
+    acked_sequence_(0),
+    spool_fd_(-1),
+    spool_read_offset_(0),
+    spool_write_offset_(0),
+    spool_queued_(0),
+    spool_inflight_(0),
+    spool_truncating_(false),
+    thread_running_(false),
+    thread_shutdown_(false) {}
+
+DeliveryQueue::~DeliveryQueue() {
+  stop();
+
+  if (spool_fd_ >= 0) {
+    close(spool_fd_);
+  }
+}
+
+ReturnCode DeliveryQueue::configure(
+    const PropertyList& config,
+    const std::string& spool_dir) {
+  std::string opt;
+  uint64_t value;
+  if (config.get("delivery_overflow", &opt)) {
+    auto rc = parseOverflowPolicy(opt, &policy_);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (config.get("delivery_queue_length", &opt)) {
+    if (!config.getUInt("delivery_queue_length", &value).isSuccess() ||
+        value == 0) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid value for delivery_queue_length");
+    }
+
+    capacity_ = value;
+    high_watermark_ = capacity_ * 3 / 4;
+    low_watermark_ = capacity_ / 4;
+  }
+
+  if (config.get("delivery_high_watermark", &opt)) {
+    if (!config.getUInt("delivery_high_watermark", &value).isSuccess()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid value for delivery_high_watermark");
+    }
+
+    high_watermark_ = value;
+  }
+
+  if (config.get("delivery_low_watermark", &opt)) {
+    if (!config.getUInt("delivery_low_watermark", &value).isSuccess()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid value for delivery_low_watermark");
+    }
+
+    low_watermark_ = value;
+  }
+
+  if (low_watermark_ > high_watermark_ || high_watermark_ > capacity_) {
+    return ReturnCode::error(
+        "EINVAL",
+        "invalid delivery watermarks; must satisfy " \
+        "low_watermark <= high_watermark <= queue_length");
+  }
+
+  if (config.get("delivery_batch_size", &opt)) {
+    if (!config.getUInt("delivery_batch_size", &value).isSuccess() ||
+        value == 0) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid value for delivery_batch_size");
+    }
+
+    batch_size_ = value;
+  }
+
+  if (config.get("delivery_max_retries", &opt)) {
+    if (!config.getUInt("delivery_max_retries", &value).isSuccess()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid value for delivery_max_retries");
+    }
+
+    max_retries_ = value;
+  }
+
+  spool_path_ = StringUtil::format(
+      "$0/delivery_$1.spool",
+      spool_dir,
+      StringUtil::stripShell(name_));
+
+  /* replay events spilled by a previous run even if spilling is disabled */
+  struct stat st;
+  if (policy_ == OverflowPolicy::SPILL ||
+      stat(spool_path_.c_str(), &st) == 0) {
+    auto rc = openSpoolFile();
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode DeliveryQueue::enqueueEvents(
+    const EventData* events,
+    size_t events_count) {
+  std::unique_lock<std::mutex> lk(mutex_);
+
+  auto rc = ReturnCode::success();
+  bool spilled = false;
+  for (size_t i = 0; i < events_count; ++i) {
+    const auto& event = events[i];
+    if (event.sequence > enqueued_sequence_) {
+      enqueued_sequence_ = event.sequence;
+    }
+
+    /* keep ordering: once we spilled, everything goes to disk until drained */
+    if (spool_read_offset_ < spool_write_offset_) {
+      auto spill_rc = spillEvent(event);
+      if (spill_rc.isSuccess()) {
+        spilled = true;
+      } else {
+        ++dropped_;
+        ack_stalled_ |= event.sequence > 0;
+        rc = spill_rc;
+      }
+
+      continue;
+    }
+
+    if (queue_.size() < capacity_) {
+      queue_.emplace_back(event);
+      pending_sequenced_ += event.sequence > 0;
+      continue;
+    }
+
+    auto policy = policy_;
+    if (paused_) {
+      policy = OverflowPolicy::SPILL;
+    }
+
+    switch (policy) {
+
+      case OverflowPolicy::BLOCK:
+        while (queue_.size() >= capacity_ && !thread_shutdown_) {
+          cv_.notify_all();
+          cv_.wait(lk);
+        }
+
+        queue_.emplace_back(event);
+        pending_sequenced_ += event.sequence > 0;
+        break;
+
+      case OverflowPolicy::DROP_OLDEST:
+        pending_sequenced_ -= queue_.front().sequence > 0;
+        spool_queued_ -= spool_queued_ > 0;
+        queue_.pop_front();
+        queue_.emplace_back(event);
+        pending_sequenced_ += event.sequence > 0;
+        ++dropped_;
+        break;
+
+      case OverflowPolicy::DROP_NEWEST:
+        ++dropped_;
+        break;
+
+      case OverflowPolicy::SPILL: {
+        /* the delivery thread truncates the spool file without the lock */
+        while (spool_truncating_) {
+          cv_.wait(lk);
+        }
+
+        auto spill_rc = spillEvent(event);
+        if (spill_rc.isSuccess()) {
+          spilled = true;
+        } else {
+          ++dropped_;
+          ack_stalled_ |= event.sequence > 0;
+          rc = spill_rc;
+        }
+        break;
+      }
+
+    }
+  }
+
+  /* spilled events count as settled, so they must be on disk before the
+     acknowledged sequence (and with it the source checkpoints) moves past
+     them */
+  if (spilled && fdatasync(spool_fd_) < 0) {
+    rc = ReturnCode::error(
+        "IOERR",
+        "fsync('%s') failed: %s",
+        spool_path_.c_str(),
+        strerror(errno));
+
+    if (!ack_stalled_) {
+      ack_stalled_ = true;
+      logError(
+          "Spilled events for '$0' could not be synced, source checkpoints " \
+          "will not advance until restart",
+          name_);
+    }
+  }
+
+  updateWatermark();
+  updateAcknowledged();
+  cv_.notify_all();
+  return rc;
+}
+
+void DeliveryQueue::updateWatermark() {
+  if (!above_high_watermark_ && queue_.size() >= high_watermark_) {
+    above_high_watermark_ = true;
+    logWarning(
+        "Delivery queue '$0' is above its high watermark ($1 events)",
+        name_,
+        queue_.size());
+  }
+
+  if (above_high_watermark_ && queue_.size() <= low_watermark_) {
+    above_high_watermark_ = false;
+    logInfo(
+        "Delivery queue '$0' is back below its low watermark ($1 events)",
+        name_,
+        queue_.size());
+  }
+}
+
+/* events are delivered in order and events that are not pending in memory
+   are settled, so once no sequenced event is pending everything that was
+   enqueued is settled */
+void DeliveryQueue::updateAcknowledged() {
+  if (!ack_stalled_ && pending_sequenced_ == 0) {
+    acked_sequence_.store(enqueued_sequence_, std::memory_order_release);
+  }
+}
+
+ReturnCode DeliveryQueue::start() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (thread_running_) {
+    return ReturnCode::error("RTERROR", "delivery thread is already running");
+  }
+
+  thread_running_ = true;
+  thread_shutdown_ = false;
+  thread_ = std::thread(std::bind(&DeliveryQueue::runDeliveryThread, this));
+  return ReturnCode::success();
+}
+
+void DeliveryQueue::stop() {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (!thread_running_) {
+      return;
+    }
+
+    thread_shutdown_ = true;
+  }
+
+  cv_.notify_all();
+  thread_.join();
+  thread_running_ = false;
+}
+
+void DeliveryQueue::runDeliveryThread() {
+  std::vector<EventData> batch;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(mutex_);
+
+      bool flush = false;
+      while (true) {
+        /* spilled events are only appended behind other spilled events so
+           that they stay at the front of the queue */
+        if (!thread_shutdown_ &&
+            queue_.size() <= low_watermark_ &&
+            queue_.size() == spool_queued_ &&
+            spool_read_offset_ < spool_write_offset_) {
+          readSpilledEvents(
+              &lk,
+              std::min(batch_size_, capacity_ - queue_.size()));
+          continue;
+        }
+
+        if (thread_shutdown_ || (!queue_.empty() && !paused_)) {
+          break;
+        }
+
+        if (!paused_ &&
+            flush_completed_ < flush_requested_ &&
+            spool_read_offset_ == spool_write_offset_) {
+          flush = true;
+          break;
+        }
+
+        cv_.wait(lk);
+      }
+
+      if (flush) {
+        auto flush_id = flush_requested_;
+        lk.unlock();
+        auto rc = plugin_->pluginFlush(userdata_);
+        lk.lock();
+        flush_rc_ = rc;
+        flush_completed_ = flush_id;
+        cv_.notify_all();
+        continue;
+      }
+
+      if (queue_.empty()) {
+        return;
+      }
+
+      auto batch_len = std::min(queue_.size(), batch_size_);
+      spool_inflight_ = std::min(batch_len, spool_queued_);
+      spool_queued_ -= spool_inflight_;
+
+      auto batch_end = queue_.begin() + batch_len;
+      batch.assign(
+          std::make_move_iterator(queue_.begin()),
+          std::make_move_iterator(batch_end));
+      queue_.erase(queue_.begin(), batch_end);
+
+      updateWatermark();
+      cv_.notify_all();
+    }
+
+    auto delivered = deliverBatch(&batch);
+
+    uint64_t batch_sequence = 0;
+    size_t batch_sequenced = 0;
+    for (const auto& event : batch) {
+      if (event.sequence > 0) {
+        batch_sequence = event.sequence;
+        ++batch_sequenced;
+      }
+    }
+
+    batch.clear();
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    pending_sequenced_ -= batch_sequenced;
+    if (!delivered && batch_sequenced > 0 && !ack_stalled_) {
+      ack_stalled_ = true;
+      logError(
+          "Events were lost while delivering to '$0', source checkpoints " \
+          "will not advance until restart",
+          name_);
+    }
+
+    if (!ack_stalled_) {
+      if (batch_sequence > acked_sequence_.load(std::memory_order_relaxed)) {
+        acked_sequence_.store(batch_sequence, std::memory_order_release);
+      }
+
+      updateAcknowledged();
+    }
+
+    spool_inflight_ = 0;
+    truncateSpoolFile(&lk);
+  }
+}
+
+ReturnCode DeliveryQueue::pause() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (paused_) {
+    return ReturnCode::success();
+  }
+
+  if (spool_fd_ < 0) {
+    auto rc = openSpoolFile();
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  paused_ = true;
+  logInfo("Delivery to '$0' paused", name_);
+  return ReturnCode::success();
+}
+
+void DeliveryQueue::resume() {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (!paused_) {
+      return;
+    }
+
+    paused_ = false;
+    logInfo("Delivery to '$0' resumed", name_);
+  }
+
+  cv_.notify_all();
+}
+
+bool DeliveryQueue::isPaused() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return paused_;
+}
+
+ReturnCode DeliveryQueue::flush(uint64_t timeout_micros) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (paused_) {
+    return ReturnCode::error(
+        "EPAUSED",
+        "delivery to '%s' is paused",
+        name_.c_str());
+  }
+
+  if (!thread_running_) {
+    return ReturnCode::error("RTERROR", "delivery thread is not running");
+  }
+
+  auto flush_id = ++flush_requested_;
+  cv_.notify_all();
+
+  auto deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::microseconds(timeout_micros);
+
+  while (flush_completed_ < flush_id) {
+    if (cv_.wait_until(lk, deadline) == std::cv_status::timeout &&
+        flush_completed_ < flush_id) {
+      return ReturnCode::error(
+          "ETIMEOUT",
+          "timeout while flushing '%s'",
+          name_.c_str());
+    }
+  }
+
+  return flush_rc_;
+}
+
+bool DeliveryQueue::deliverBatch(std::vector<EventData>* batch) {
+  for (size_t attempt = 0; ; ++attempt) {
+    auto t0 = MonotonicClock::now();
+    auto rc = plugin_->pluginEmitEvents(
+        userdata_,
+        batch->data(),
+        batch->size());
+
+    delivery_latency_.record(MonotonicClock::now() - t0);
+
+    if (rc.isSuccess()) {
+      uint64_t bytes = 0;
+      for (const auto& event : *batch) {
+        bytes += event.event_data->size();
+      }
+
+      delivered_events_.fetch_add(batch->size(), std::memory_order_relaxed);
+      delivered_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+      return true;
+    }
+
+    if (attempt >= max_retries_) {
+      failed_.fetch_add(batch->size(), std::memory_order_relaxed);
+      logError(
+          "Error while delivering $0 events to '$1': $2",
+          batch->size(),
+          name_,
+          rc.getMessage());
+      return false;
+    }
+
+    logWarning(
+        "Error while delivering $0 events to '$1', retrying: $2",
+        batch->size(),
+        name_,
+        rc.getMessage());
+
+    retries_.fetch_add(1, std::memory_order_relaxed);
+    usleep(kRetryBackoffMicros << attempt);
+  }
+}
+
+ReturnCode DeliveryQueue::openSpoolFile() {
+  spool_fd_ = open(spool_path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (spool_fd_ < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "open('%s') failed: %s",
+        spool_path_.c_str(),
+        strerror(errno));
+  }
+
+  struct stat st;
+  if (fstat(spool_fd_, &st) < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "fstat('%s') failed: %s",
+        spool_path_.c_str(),
+        strerror(errno));
+  }
+
+  spool_read_offset_ = 0;
+  spool_write_offset_ = st.st_size;
+  if (spool_write_offset_ > 0) {
+    logInfo(
+        "Replaying $0 bytes of spilled events for '$1'",
+        spool_write_offset_,
+        name_);
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode DeliveryQueue::spillEvent(const EventData& event) {
+  if (spool_fd_ < 0) {
+    return ReturnCode::error("IOERR", "no spool file for '%s'", name_.c_str());
+  }
+
+  unsigned char hdr[kSpoolHeaderSize];
+  uint32_t name_len = event.event_name->size();
+  uint32_t data_len = event.event_data->size();
+  uint32_t name_len_flags = name_len;
+  if (event.encoding == EventEncoding::MSGPACK) {
+    name_len_flags |= kSpoolMsgPackFlag;
+  }
+
+  memcpy(hdr, &event.time, sizeof(uint64_t));
+  memcpy(hdr + sizeof(uint64_t), &name_len_flags, sizeof(uint32_t));
+  memcpy(hdr + sizeof(uint64_t) + sizeof(uint32_t), &data_len, sizeof(uint32_t));
+
+  struct iovec iov[3];
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = (void*) event.event_name->data();
+  iov[1].iov_len = name_len;
+  iov[2].iov_base = (void*) event.event_data->data();
+  iov[2].iov_len = data_len;
+
+  ssize_t len = sizeof(hdr) + name_len + data_len;
+  if (writev(spool_fd_, iov, 3) != len) {
+    return ReturnCode::error(
+        "IOERR",
+        "write('%s') failed: %s",
+        spool_path_.c_str(),
+        strerror(errno));
+  }
+
+  spool_write_offset_ += len;
+  return ReturnCode::success();
+}
+
+/* called from the delivery thread, which is the only one that reads or
+   truncates the spool file, so the file is read without holding the lock.
+   enqueueEvents keeps appending to the spool file in the meantime as long as
+   it wasn't read up to its end */
+bool DeliveryQueue::readSpilledEvents(
+    std::unique_lock<std::mutex>* lk,
+    size_t max_events) {
+  auto read_offset = spool_read_offset_;
+  auto write_offset = spool_write_offset_;
+  lk->unlock();
+
+  std::vector<EventData> events;
+  while (events.size() < max_events && read_offset < write_offset) {
+    unsigned char hdr[kSpoolHeaderSize];
+    if (pread(spool_fd_, hdr, sizeof(hdr), read_offset) != sizeof(hdr)) {
+      break;
+    }
+
+    EventData event;
+    uint32_t name_len;
+    uint32_t data_len;
+    memcpy(&event.time, hdr, sizeof(uint64_t));
+    memcpy(&name_len, hdr + sizeof(uint64_t), sizeof(uint32_t));
+    memcpy(&data_len, hdr + sizeof(uint64_t) + sizeof(uint32_t), sizeof(uint32_t));
+
+    if (name_len & kSpoolMsgPackFlag) {
+      event.encoding = EventEncoding::MSGPACK;
+      name_len &= ~kSpoolMsgPackFlag;
+    }
+
+    std::string event_name(name_len, 0);
+    std::string event_data(data_len, 0);
+    auto offset = read_offset + sizeof(hdr);
+    if ((name_len > 0 &&
+            pread(spool_fd_, &event_name[0], name_len, offset) !=
+            name_len) ||
+        (data_len > 0 &&
+            pread(spool_fd_, &event_data[0], data_len, offset + name_len) !=
+            data_len)) {
+      break;
+    }
+
+    EventNameTable::get()->setEventName(&event, event_name);
+    event.event_data = std::make_shared<const std::string>(
+        std::move(event_data));
+
+    read_offset = offset + name_len + data_len;
+    events.emplace_back(std::move(event));
+  }
+
+  if (read_offset < write_offset && events.size() < max_events) {
+    logError(
+        "Spool file '$0' is corrupt, discarding $1 bytes",
+        spool_path_,
+        write_offset - read_offset);
+    read_offset = write_offset;
+  }
+
+  lk->lock();
+  spool_read_offset_ = read_offset;
+  for (auto& event : events) {
+    queue_.emplace_back(std::move(event));
+  }
+
+  spool_queued_ += events.size();
+  updateWatermark();
+  return !events.empty();
+}
+
+/* the spool file is only truncated once every event in it was delivered (or
+   given up on), so that a crash never loses spilled events. events that were
+   delivered before a crash are delivered again on the next start */
+void DeliveryQueue::truncateSpoolFile(std::unique_lock<std::mutex>* lk) {
+  if (spool_write_offset_ == 0 ||
+      spool_read_offset_ < spool_write_offset_ ||
+      spool_queued_ > 0 ||
+      spool_inflight_ > 0) {
+    return;
+  }
+
+  spool_truncating_ = true;
+  lk->unlock();
+
+  if (ftruncate(spool_fd_, 0) < 0) {
+    logError("ftruncate('$0') failed", spool_path_);
+  }
+
+  lk->lock();
+  spool_read_offset_ = 0;
+  spool_write_offset_ = 0;
+  spool_truncating_ = false;
+  cv_.notify_all();
+}
+
+const std::string& DeliveryQueue::getName() const {
+  return name_;
+}
+
+size_t DeliveryQueue::getLength() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return queue_.size();
+}
+
+size_t DeliveryQueue::getCapacity() const {
+  return capacity_;
+}
+
+size_t DeliveryQueue::getHighWatermark() const {
+  return high_watermark_;
+}
+
+size_t DeliveryQueue::getLowWatermark() const {
+  return low_watermark_;
+}
+
+bool DeliveryQueue::isAboveHighWatermark() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return above_high_watermark_;
+}
+
+uint64_t DeliveryQueue::getSpilledBytes() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return spool_write_offset_ - spool_read_offset_;
+}
+
+uint64_t DeliveryQueue::getDroppedCount() const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+uint64_t DeliveryQueue::getDeliveredCount() const {
+  return delivered_events_.load(std::memory_order_relaxed);
+}
+
+uint64_t DeliveryQueue::getDeliveredBytes() const {
+  return delivered_bytes_.load(std::memory_order_relaxed);
+}
+
+uint64_t DeliveryQueue::getRetryCount() const {
+  return retries_.load(std::memory_order_relaxed);
+}
+
+uint64_t DeliveryQueue::getFailedCount() const {
+  return failed_.load(std::memory_order_relaxed);
+}
+
+const LatencyHistogram& DeliveryQueue::getDeliveryLatency() const {
+  return delivery_latency_;
+}
+
+uint64_t DeliveryQueue::getAcknowledgedSequence() const {
+  return acked_sequence_.load(std::memory_order_acquire);
+}
+
+} // namespace evcollect
+
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <evcollect/evcollect.h>
+#include <evcollect/plugin.h>
+#include <evcollect/util/return_code.h>
+#include <evcollect/util/histogram.h>
+
+namespace evcollect {
+
+enum class OverflowPolicy {
+  BLOCK,
+  DROP_OLDEST,
+  DROP_NEWEST,
+  SPILL
+};
+
+ReturnCode parseOverflowPolicy(
+    const std::string& str,
+    OverflowPolicy* policy);
+
+/**
+ * A bounded queue of events that is drained into one output plugin instance
+ * by a dedicated delivery thread
+ */
+class DeliveryQueue {
+public:
+
+  static const size_t kDefaultCapacity = 8192;
+  static const size_t kDefaultBatchSize = 1024;
+  static const size_t kDefaultMaxRetries = 3;
+  static const uint64_t kRetryBackoffMicros = 100000;
+  static const uint64_t kDefaultFlushTimeoutMicros = 10000000;
+
+  DeliveryQueue(
+      const std::string& name,
+      OutputPlugin* plugin,
+      void* userdata);
+
+  ~DeliveryQueue();
+
+  /**
+   * Configure the queue; must be called before the delivery thread is started
+   */
+  ReturnCode configure(
+      const PropertyList& config,
+      const std::string& spool_dir);
+
+  /**
+   * Enqueue a batch of events. Depending on the overflow policy this might
+   * block, drop events or spill events to disk if the queue is full
+   */
+  ReturnCode enqueueEvents(const EventData* events, size_t events_count);
+
+  /**
+   * Start the delivery thread
+   */
+  ReturnCode start();
+
+  /**
+   * Stop the delivery thread. All events that are still in the in-memory queue
+   * are delivered before this method returns. Spilled events are kept on disk
+   * and will be delivered on the next start
+   */
+  void stop();
+
+  /**
+   * Pause delivery. Events are still accepted while the queue is paused; once
+   * the queue is full, further events are spilled to disk regardless of the
+   * overflow policy, so that a paused output never blocks the sources
+   */
+  ReturnCode pause();
+
+  /**
+   * Resume delivery after pause()
+   */
+  void resume();
+
+  bool isPaused() const;
+
+  /**
+   * Wait until all queued and spilled events have been delivered and then
+   * call the output plugin's pluginFlush from the delivery thread. Returns an
+   * error if the queue is paused or does not drain within the timeout
+   */
+  ReturnCode flush(uint64_t timeout_micros = kDefaultFlushTimeoutMicros);
+
+  const std::string& getName() const;
+  size_t getLength() const;
+  size_t getCapacity() const;
+  size_t getHighWatermark() const;
+  size_t getLowWatermark() const;
+  bool isAboveHighWatermark() const;
+  uint64_t getSpilledBytes() const;
+  uint64_t getDroppedCount() const;
+
+  /**
+   * Delivery counters. These are updated by the delivery thread and can be
+   * read from any thread without taking the queue lock
+   */
+  uint64_t getDeliveredCount() const;
+  uint64_t getDeliveredBytes() const;
+  uint64_t getRetryCount() const;
+  uint64_t getFailedCount() const;
+
+  /**
+   * Latency of the output plugin's emit calls in microseconds, one sample per
+   * delivered batch
+   */
+  const LatencyHistogram& getDeliveryLatency() const;
+
+  /**
+   * Returns the highest sequence number such that every event with a lower or
+   * equal sequence that was enqueued has been settled: delivered, dropped by
+   * the overflow policy or spilled and synced to disk. Once events are lost (a batch
+   * fails after all retries or can't be spilled) the acknowledged sequence
+   * stops advancing, so that sources don't checkpoint past them. Can be
+   * called from any thread
+   */
+  uint64_t getAcknowledgedSequence() const;
+
+protected:
+
+  void updateWatermark();
+  void updateAcknowledged();
+  bool deliverBatch(std::vector<EventData>* batch);
+  void runDeliveryThread();
+
+  ReturnCode openSpoolFile();
+  ReturnCode spillEvent(const EventData& event);
+  bool readSpilledEvents(std::unique_lock<std::mutex>* lk, size_t max_events);
+  void truncateSpoolFile(std::unique_lock<std::mutex>* lk);
+
+  std::string name_;
+  OutputPlugin* plugin_;
+  void* userdata_;
+  OverflowPolicy policy_;
+  size_t capacity_;
+  size_t high_watermark_;
+  size_t low_watermark_;
+  size_t batch_size_;
+  size_t max_retries_;
+  std::deque<EventData> queue_;
+  bool above_high_watermark_;
+  bool paused_;
+  uint64_t flush_requested_;
+  uint64_t flush_completed_;
+  ReturnCode flush_rc_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> delivered_events_;
+  std::atomic<uint64_t> delivered_bytes_;
+  std::atomic<uint64_t> retries_;
+  std::atomic<uint64_t> failed_;
+  LatencyHistogram delivery_latency_;
+  uint64_t enqueued_sequence_;
+  size_t pending_sequenced_;
+  bool ack_stalled_;
+  std::atomic<uint64_t> acked_sequence_;
+  std::string spool_path_;
+  int spool_fd_;
+  uint64_t spool_read_offset_;
+  uint64_t spool_write_offset_;
+  /* events read back from the spool file that are still at the front of the
+     queue or in the batch that is being delivered; the spool file is only
+     truncated once all of them were delivered */
+  size_t spool_queued_;
+  size_t spool_inflight_;
+  bool spool_truncating_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+  bool thread_running_;
+  bool thread_shutdown_;
+};
+
+} // namespace evcollect
+
@@ -23,6 +23,7 @@
  */
 #pragma once
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
  * This file contains the common public C and C++ API as well as the C plugin
@@ -36,6 +37,7 @@ extern "C" {
 typedef void evcollect_ctx_t;
 typedef void evcollect_plugin_cfg_t;
 typedef void evcollect_event_t;
+typedef void evcollect_histogram_t;
 
 void evcollect_seterror(evcollect_ctx_t* ctx, const char* error);
 
@@ -78,6 +80,19 @@ void evcollect_event_setname(
     const char* data,
     size_t size);
 
+/**
+ * Return the id of the event's name. Event names are interned when the event
+ * is configured, so outputs can route by id (e.g. using a flat array indexed
+ * by id) instead of comparing names. Ids are small, dense integers. Names set
+ * at runtime that were not configured have id 0 and must be routed by name
+ */
+uint32_t evcollect_event_getid(const evcollect_event_t* ev);
+
+/**
+ * Return the time at which the event was emitted in microseconds since epoch
+ */
+uint64_t evcollect_event_gettime(const evcollect_event_t* ev);
+
 void evcollect_event_getdata(
     const evcollect_event_t* ev,
     const char** data,
@@ -88,6 +103,30 @@ void evcollect_event_setdata(
     const char* data,
     size_t size);
 
+/**
+ * Take a reference to an event so that it can be kept beyond the emit call.
+ * The event payload is shared, not copied. Every reference must be released
+ * using evcollect_event_release
+ */
+evcollect_event_t* evcollect_event_retain(const evcollect_event_t* ev);
+
+void evcollect_event_release(evcollect_event_t* ev);
+
+/**
+ * Return the latency histogram with the provided name, creating it if it does
+ * not exist yet. Histograms are exported via the monitor socket and dumped on
+ * shutdown. The returned pointer stays valid for the lifetime of the process
+ */
+evcollect_histogram_t* evcollect_histogram_get(const char* name);
+
+/**
+ * Record a value (usually a duration in microseconds). This is lock-free and
+ * may be called from any thread
+ */
+void evcollect_histogram_record(
+    evcollect_histogram_t* histogram,
+    uint64_t value);
+
 typedef int (*evcollect_plugin_getnextevent_fn)(
     evcollect_ctx_t* ctx,
     void* userdata,
@@ -102,6 +141,12 @@ typedef int (*evcollect_plugin_emitevent_fn)(
     void* userdata,
     const evcollect_event_t* ev);
 
+typedef int (*evcollect_plugin_emitevents_fn)(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t** evs,
+    size_t evs_count);
+
 typedef int (*evcollect_plugin_attach_fn)(
     evcollect_ctx_t* ctx,
     const evcollect_plugin_cfg_t* cfg,
@@ -136,6 +181,21 @@ void evcollect_output_plugin_register(
     evcollect_plugin_init_fn init_fn,
     evcollect_plugin_free_fn free_fn);
 
+/**
+ * Register an output plugin that receives whole batches of events through
+ * emitevents_fn. emitevent_fn is still required and is used for single events;
+ * if emitevents_fn is NULL batches are emitted one event at a time
+ */
+void evcollect_output_plugin_register_batched(
+    evcollect_ctx_t* ctx,
+    const char* plugin_name,
+    evcollect_plugin_emitevent_fn emitevent_fn,
+    evcollect_plugin_emitevents_fn emitevents_fn,
+    evcollect_plugin_attach_fn attach_fn,
+    evcollect_plugin_detach_fn detach_fn,
+    evcollect_plugin_init_fn init_fn,
+    evcollect_plugin_free_fn free_fn);
+
 int __evcollect_plugin_init(
     evcollect_ctx_t* ctx);
 
@@ -149,13 +209,39 @@ int __evcollect_plugin_init(
 #ifdef __cplusplus
 #include <string>
 #include <vector>
+#include <memory>
+#include <evcollect/util/return_code.h>
 
 namespace evcollect {
 
+/**
+ * The encoding of an event payload. Sources declare which encoding they
+ * produce and outputs which encodings they accept; events are converted to
+ * JSON only for outputs that do not accept the source's encoding
+ */
+enum class EventEncoding : uint8_t {
+  JSON = 0,
+  MSGPACK = 1
+};
+
+/**
+ * An event. The name is interned in the EventNameTable and the payload is
+ * immutable and shared between all copies of the event, so fanning out an
+ * event to multiple targets does not copy it
+ */
 struct EventData {
   uint64_t time;
-  std::string event_name;
-  std::string event_data;
+  uint32_t event_id;
+  const std::string* event_name;
+  std::shared_ptr<const std::string> event_data;
+
+  /* owns event_name if it was set at runtime and is not interned */
+  std::shared_ptr<const std::string> event_name_storage;
+  EventEncoding encoding = EventEncoding::JSON;
+
+  /* assigned by the service in emit order; 0 if the event is not tracked for
+     acknowledgement (e.g. replayed from a spool file) */
+  uint64_t sequence = 0;
 };
 
 struct PropertyList {
@@ -166,6 +252,11 @@ struct PropertyList {
   size_t get(
       const std::string& key,
       std::vector<std::vector<std::string>>* out) const;
+
+  /* parses the value of key as a decimal unsigned integer; signs, whitespace
+     and trailing characters are rejected. *out is left unchanged if the key
+     is not set */
+  ReturnCode getUInt(const std::string& key, uint64_t* out) const;
 };
 
 struct EventSourceConfig {
@@ -178,6 +269,13 @@ struct EventConfig {
   std::string event_name;
   uint64_t interval_micros;
   std::vector<EventSourceConfig> sources;
+
+  /* how much a single tick may read from all sources of the event together
+     before it yields to the other due events and continues after them; 0
+     means unlimited */
+  uint64_t tick_budget_events = 0;
+  uint64_t tick_budget_bytes = 0;
+  uint64_t tick_budget_micros = 0;
 };
 
 struct TargetConfig {
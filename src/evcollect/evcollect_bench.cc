@@ -0,0 +1,439 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <iostream>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <evcollect/evcollect.h>
+#include <evcollect/service.h>
+#include <evcollect/util/flagparser.h>
+#include <evcollect/util/histogram.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/time.h>
+
+/**
+ * Drives the real Service with the generator and logfile sources and a
+ * counting output and reports the sustained throughput, CPU time per million
+ * events, peak RSS and the latency between emitting and delivering an event
+ */
+
+using namespace evcollect;
+
+namespace {
+
+const char kGeneratorBatchSize[] = "10000";
+
+struct BenchCounters {
+  std::atomic<uint64_t> events;
+  std::atomic<uint64_t> bytes;
+  std::unique_ptr<LatencyHistogram> latency;
+};
+
+BenchCounters counters;
+
+int countingOutputEmitEvents(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t** evs,
+    size_t evs_count) {
+  auto now = WallClock::unixMicros();
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < evs_count; ++i) {
+    const char* data;
+    size_t data_len;
+    evcollect_event_getdata(evs[i], &data, &data_len);
+    bytes += data_len;
+
+    auto time = evcollect_event_gettime(evs[i]);
+    counters.latency->record(now > time ? now - time : 0);
+  }
+
+  counters.events.fetch_add(evs_count, std::memory_order_relaxed);
+  counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  return 1;
+}
+
+int countingOutputEmitEvent(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t* ev) {
+  return countingOutputEmitEvents(ctx, userdata, &ev, 1);
+}
+
+bool benchPluginInit(evcollect_ctx_t* ctx) {
+  evcollect_output_plugin_register_batched(
+      ctx,
+      "bench_counter",
+      &countingOutputEmitEvent,
+      &countingOutputEmitEvents,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr);
+
+  return true;
+}
+
+/**
+ * Appends lines to a logfile at a fixed rate from a background thread
+ */
+class LogfileWriter {
+public:
+
+  LogfileWriter(const std::string& path, uint64_t lines_per_sec) :
+      path_(path),
+      lines_per_sec_(lines_per_sec),
+      lines_written_(0),
+      running_(false) {}
+
+  ~LogfileWriter() {
+    stop();
+  }
+
+  ReturnCode start() {
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd_ < 0) {
+      return ReturnCode::error("IOERR", "open('%s') failed", path_.c_str());
+    }
+
+    running_ = true;
+    thread_ = std::thread(std::bind(&LogfileWriter::run, this));
+    return ReturnCode::success();
+  }
+
+  void stop() {
+    if (!running_) {
+      return;
+    }
+
+    running_ = false;
+    thread_.join();
+    close(fd_);
+  }
+
+  uint64_t getLinesWritten() const {
+    return lines_written_.load();
+  }
+
+protected:
+
+  void run() {
+    static const uint64_t kSliceMicros = 10 * kMicrosPerMilli;
+    auto start = MonotonicClock::now();
+
+    std::string buf;
+    while (running_) {
+      /* write as many lines as we owe according to the target rate */
+      auto elapsed = MonotonicClock::now() - start;
+      uint64_t target = lines_per_sec_ * elapsed / kMicrosPerSecond;
+
+      buf.clear();
+      for (auto n = lines_written_.load(); n < target; ++n) {
+        buf += StringUtil::format(
+            "127.0.0.1 - - \"GET /bench/$0 HTTP/1.1\" 200 $1\n",
+            n,
+            n % 4096);
+      }
+
+      if (!buf.empty() &&
+          write(fd_, buf.data(), buf.size()) == ssize_t(buf.size())) {
+        lines_written_ = target;
+      }
+
+      usleep(kSliceMicros);
+    }
+  }
+
+  std::string path_;
+  uint64_t lines_per_sec_;
+  std::atomic<uint64_t> lines_written_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+  int fd_;
+};
+
+uint64_t getCPUMicros() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return
+      (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * kMicrosPerSecond +
+      ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+uint64_t getMaxRSSKilobytes() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+ReturnCode runScenario(
+    const std::string& scenario,
+    const std::string& spool_dir,
+    uint64_t duration_secs,
+    uint64_t logfile_rate,
+    const std::string& event_size) {
+  counters.events = 0;
+  counters.bytes = 0;
+  counters.latency.reset(new LatencyHistogram());
+
+  auto service = Service::createService(spool_dir, spool_dir);
+
+  {
+    auto rc = service->loadPlugin(&benchPluginInit);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  std::unique_ptr<LogfileWriter> writer;
+  EventConfig event;
+  event.event_name = "bench." + scenario;
+  event.sources.emplace_back();
+
+  if (scenario == "generator") {
+    event.interval_micros = kMicrosPerMilli;
+    event.sources.back().plugin_name = "generator";
+    event.sources.back().properties.properties.emplace_back(
+        "batch_size",
+        std::vector<std::string> { kGeneratorBatchSize });
+    event.sources.back().properties.properties.emplace_back(
+        "event_size",
+        std::vector<std::string> { event_size });
+  } else if (scenario == "logfile") {
+    auto logfile_path = spool_dir + "/bench.log";
+    event.interval_micros = 10 * kMicrosPerMilli;
+    event.sources.back().plugin_name = "logfile";
+    event.sources.back().properties.properties.emplace_back(
+        "logfile",
+        std::vector<std::string> { logfile_path });
+
+    writer.reset(new LogfileWriter(logfile_path, logfile_rate));
+    auto rc = writer->start();
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  } else {
+    return ReturnCode::error(
+        "EINVAL",
+        "unknown scenario: %s",
+        scenario.c_str());
+  }
+
+  {
+    auto rc = service->addEvent(&event);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  {
+    TargetConfig target;
+    target.plugin_name = "bench_counter";
+    target.plugin_value = "bench";
+    auto rc = service->addTarget(&target);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  auto cpu_begin = getCPUMicros();
+  auto time_begin = MonotonicClock::now();
+
+  std::thread service_thread([&service] {
+    auto rc = service->run();
+    if (!rc.isSuccess()) {
+      logError("error: $0", rc.getMessage());
+    }
+  });
+
+  sleep(duration_secs);
+
+  auto events = counters.events.load();
+  auto bytes = counters.bytes.load();
+  auto cpu = getCPUMicros() - cpu_begin;
+  auto elapsed = MonotonicClock::now() - time_begin;
+
+  service->kill();
+  service_thread.join();
+
+  uint64_t lines_written = 0;
+  if (writer) {
+    writer->stop();
+    lines_written = writer->getLinesWritten();
+  }
+
+  service.reset();
+  unlink((spool_dir + "/bench.log").c_str());
+  unlink((spool_dir + "/delivery_bench.spool").c_str());
+
+  auto latency = counters.latency->getSnapshot();
+  printf(
+      "%-10s %12.0f %10.1fMB/s %10.1fms %8.1fMB %8llu %8llu %8llu %8llu %10llu",
+      scenario.c_str(),
+      double(events) * kMicrosPerSecond / elapsed,
+      double(bytes) / elapsed,
+      events > 0 ? double(cpu) * 1000 / events : 0,
+      getMaxRSSKilobytes() / 1024.0,
+      (unsigned long long) latency.getPercentile(0.5),
+      (unsigned long long) latency.getPercentile(0.9),
+      (unsigned long long) latency.getPercentile(0.99),
+      (unsigned long long) latency.getPercentile(0.999),
+      (unsigned long long) latency.max);
+
+  if (writer) {
+    printf("  (%llu of %llu lines)", (unsigned long long) events, (unsigned long long) lines_written);
+  }
+
+  printf("\n");
+  return ReturnCode::success();
+}
+
+} // namespace
+
+int main(int argc, const char** argv) {
+  signal(SIGPIPE, SIG_IGN);
+
+  FlagParser flags;
+
+  flags.defineFlag(
+      "help",
+      FlagParser::T_SWITCH,
+      false,
+      "?",
+      NULL);
+
+  flags.defineFlag(
+      "scenario",
+      FlagParser::T_STRING,
+      false,
+      NULL,
+      NULL);
+
+  flags.defineFlag(
+      "duration",
+      FlagParser::T_INTEGER,
+      false,
+      "d",
+      "5");
+
+  flags.defineFlag(
+      "rate",
+      FlagParser::T_INTEGER,
+      false,
+      "r",
+      "100000");
+
+  flags.defineFlag(
+      "event_size",
+      FlagParser::T_STRING,
+      false,
+      NULL,
+      "256");
+
+  flags.defineFlag(
+      "loglevel",
+      FlagParser::T_STRING,
+      false,
+      NULL,
+      "ERROR");
+
+  {
+    auto rc = flags.parseArgv(argc, argv);
+    if (!rc.isSuccess()) {
+      std::cerr << "error: " << rc.getMessage() << std::endl;
+      return 1;
+    }
+  }
+
+  if (flags.isSet("help")) {
+    std::cerr <<
+        "Usage: $ evcollect_bench [OPTIONS]\n\n"
+        "   --scenario <name>         Run only this scenario (generator, logfile)\n"
+        "   -d, --duration <secs>     Duration of each scenario (default: 5)\n"
+        "   -r, --rate <lines/s>      Line rate of the logfile writer (default: 100000)\n"
+        "   --event_size <bytes>      Size of generated events (default: 256)\n"
+        "   --loglevel <level>        Minimum log level (default: ERROR)\n"
+        "   -?, --help                Display this help text and exit\n";
+    return 0;
+  }
+
+  Logger::logToStderr(
+      "evcollect_bench",
+      strToLogLevel(flags.getString("loglevel")));
+
+  std::vector<std::string> scenarios = { "generator", "logfile" };
+  if (flags.isSet("scenario")) {
+    scenarios = { flags.getString("scenario") };
+  }
+
+  char spool_dir[] = "/tmp/evcollect_bench.XXXXXX";
+  if (!mkdtemp(spool_dir)) {
+    std::cerr << "error: mkdtemp() failed" << std::endl;
+    return 1;
+  }
+
+  printf(
+      "%-10s %12s %14s %12s %10s %8s %8s %8s %8s %10s\n",
+      "SCENARIO",
+      "EVENTS/S",
+      "THROUGHPUT",
+      "CPU/1M",
+      "MAX_RSS",
+      "P50us",
+      "P90us",
+      "P99us",
+      "P999us",
+      "MAXus");
+
+  int exit_code = 0;
+  for (const auto& scenario : scenarios) {
+    auto rc = runScenario(
+        scenario,
+        spool_dir,
+        flags.getInt("duration"),
+        flags.getInt("rate"),
+        flags.getString("event_size"));
+
+    if (!rc.isSuccess()) {
+      std::cerr << "error: " << rc.getMessage() << std::endl;
+      exit_code = 1;
+      break;
+    }
+  }
+
+  /* the logfile source leaves a checkpoint file behind */
+  unlink((std::string(spool_dir) + "/logfile.checkpoints").c_str());
+  if (rmdir(spool_dir) != 0) {
+    std::cerr << "warning: can't remove " << spool_dir << std::endl;
+  }
+
+  return exit_code;
+}
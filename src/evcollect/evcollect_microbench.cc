@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <evcollect/logfile.h>
+#include <evcollect/util/base64.h>
+#include <evcollect/util/benchmark.h>
+#include <evcollect/util/jsonutil.h>
+#include <evcollect/util/msgpack.h>
+#include <evcollect/util/sha1.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time_parser.h>
+
+using namespace evcollect;
+
+namespace {
+
+const char kAccessLogLine[] =
+    "10.0.0.1 - - [23/Aug/2016:13:37:00 +0200] \"GET /index.html?q=\\\"x\\\" "
+    "HTTP/1.1\" 200 1337 \"-\" \"Mozilla/5.0 (X11; Linux x86_64)\"";
+
+const char kAccessLogRegex[] =
+    "^(?<remote_addr>[^ ]+) [^ ]+ [^ ]+ \\[(?<time>[^\\]]+)\\] "
+    "\"(?<method>[A-Z]+) (?<path>[^ ]+) [^\"]+\" (?<status>\\d+) "
+    "(?<bytes>\\d+)";
+
+/* the same fields in the layouts of the delimiter, kv and json formats */
+const char kDelimitedLine[] =
+    "2016-08-23T13:37:00Z\tweb01\tGET\t/index.html\t200\t1337\t0.002";
+
+const char kDelimitedRegex[] =
+    "^(?<time>[^\t]*)\t(?<host>[^\t]*)\t(?<method>[^\t]*)\t"
+    "(?<path>[^\t]*)\t(?<status>[^\t]*)\t(?<bytes>[^\t]*)\t"
+    "(?<duration>[^\t]*)$";
+
+const char kDelimitedFields[] = "time,host,method,path,status,bytes,duration";
+
+const char kKeyValueLine[] =
+    "time=2016-08-23T13:37:00Z host=web01 method=GET path=/index.html "
+    "status=200 bytes=1337 duration=0.002";
+
+const char kKeyValueRegex[] =
+    "(?<key>[^ =]+)=(?<value>[^ ]*)";
+
+const char kJSONLine[] =
+    "{\"time\":\"2016-08-23T13:37:00Z\",\"host\":\"web01\","
+    "\"method\":\"GET\",\"path\":\"/index.html\",\"status\":200,"
+    "\"bytes\":1337,\"duration\":0.002}";
+
+std::string makeBuffer(size_t size) {
+  std::string buf;
+  buf.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    buf += char(i * 7919);
+  }
+
+  return buf;
+}
+
+/**
+ * Reads a temporary logfile with N copies of the line through the logfile
+ * source plugin configured with the provided options (e.g. a regex)
+ */
+void benchmarkLogfile(
+    benchmark::State& state,
+    const std::string& line,
+    const std::vector<std::pair<std::string, std::string>>& options = {}) {
+  const size_t kLines = 10000;
+
+  char tmp_dir[] = "/tmp/evcollect_microbench.XXXXXX";
+  if (!mkdtemp(tmp_dir)) {
+    state.skipWithError("mkdtemp() failed");
+    return;
+  }
+
+  std::string logfile_path = std::string(tmp_dir) + "/access.log";
+  std::string logfile_data;
+  for (size_t i = 0; i < kLines; ++i) {
+    logfile_data += line;
+    logfile_data += "\n";
+  }
+
+  {
+    int fd = open(logfile_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 ||
+        write(fd, logfile_data.data(), logfile_data.size()) !=
+            ssize_t(logfile_data.size())) {
+      state.skipWithError("can't write logfile");
+    }
+
+    close(fd);
+  }
+
+  PluginConfig plugin_cfg;
+  plugin_cfg.spool_dir = tmp_dir;
+
+  PropertyList config;
+  config.properties.emplace_back(
+      "logfile",
+      std::vector<std::string> { logfile_path });
+
+  for (const auto& option : options) {
+    config.properties.emplace_back(
+        option.first,
+        std::vector<std::string> { option.second });
+  }
+
+  std::string event;
+  while (state.keepRunning()) {
+    /* start every iteration from the beginning of the file */
+    state.pauseTiming();
+    LogfileSourcePlugin plugin;
+    plugin.pluginInit(plugin_cfg);
+
+    void* userdata;
+    auto rc = plugin.pluginAttach(config, &userdata);
+    if (!rc.isSuccess()) {
+      state.skipWithError(rc.getMessage());
+      break;
+    }
+    state.resumeTiming();
+
+    size_t n = 0;
+    while (plugin.pluginHasPendingEvent(userdata)) {
+      event.clear();
+      plugin.pluginGetNextEvent(userdata, &event);
+      benchmark::doNotOptimize(event);
+      ++n;
+    }
+
+    state.pauseTiming();
+    plugin.pluginDetach(userdata);
+    unlink((std::string(tmp_dir) + "/logfile.checkpoints").c_str());
+    if (n != kLines) {
+      state.skipWithError(StringUtil::format("read $0 lines", n));
+    }
+    state.resumeTiming();
+  }
+
+  state.setBytesPerIteration(logfile_data.size());
+  unlink(logfile_path.c_str());
+  rmdir(tmp_dir);
+}
+
+} // namespace
+
+BENCHMARK(StringUtil, jsonEscape) {
+  std::string str;
+  while (str.size() < 1024) {
+    str += kAccessLogLine;
+    str += "\n\t";
+  }
+
+  while (state.keepRunning()) {
+    benchmark::doNotOptimize(StringUtil::jsonEscape(str));
+  }
+
+  state.setBytesPerIteration(str.size());
+}
+
+BENCHMARK(StringUtil, format) {
+  std::string host = "web01.example.com";
+  while (state.keepRunning()) {
+    benchmark::doNotOptimize(
+        StringUtil::format(
+            R"({"host":"$0","pid":$1,"load":$2,"uptime":$3})",
+            host,
+            12345,
+            0.75,
+            uint64_t(86400)));
+  }
+}
+
+BENCHMARK(JSONUtil, validate) {
+  std::string str = "[";
+  while (str.size() < 1024) {
+    str += kJSONLine;
+    str += ",";
+  }
+
+  str += "{}]";
+  while (state.keepRunning()) {
+    benchmark::doNotOptimize(
+        JSONUtil::validate(str.data(), str.data() + str.size()));
+  }
+
+  state.setBytesPerIteration(str.size());
+}
+
+BENCHMARK(Logfile, lines) {
+  benchmarkLogfile(state, kAccessLogLine);
+}
+
+BENCHMARK(Logfile, pcreExtract) {
+  benchmarkLogfile(state, kAccessLogLine, { { "regex", kAccessLogRegex } });
+}
+
+BENCHMARK(Logfile, pcreExtractTyped) {
+  benchmarkLogfile(
+      state,
+      kAccessLogLine,
+      {
+        { "regex", kAccessLogRegex },
+        { "field_type", "time:timestamp:%d/%b/%Y:%H:%M:%S %z" },
+        { "field_type", "status:int" },
+        { "field_type", "bytes:int" }
+      });
+}
+
+BENCHMARK(Logfile, delimitedRegex) {
+  benchmarkLogfile(state, kDelimitedLine, { { "regex", kDelimitedRegex } });
+}
+
+BENCHMARK(Logfile, delimited) {
+  benchmarkLogfile(
+      state,
+      kDelimitedLine,
+      {
+        { "format", "delimiter" },
+        { "fields", kDelimitedFields }
+      });
+}
+
+/* a regex can only extract a fixed set of keys, so it matches the first
+   pair only */
+BENCHMARK(Logfile, keyValueRegex) {
+  benchmarkLogfile(state, kKeyValueLine, { { "regex", kKeyValueRegex } });
+}
+
+BENCHMARK(Logfile, keyValue) {
+  benchmarkLogfile(state, kKeyValueLine, { { "format", "kv" } });
+}
+
+BENCHMARK(Logfile, jsonWrapped) {
+  benchmarkLogfile(state, kJSONLine);
+}
+
+BENCHMARK(Logfile, json) {
+  benchmarkLogfile(state, kJSONLine, { { "format", "json" } });
+}
+
+/* consecutive lines from the same second only parse the zone */
+BENCHMARK(TimeParser, parseSameSecond) {
+  TimeParser parser;
+  parser.compile("%d/%b/%Y:%H:%M:%S %z");
+  std::string str = "23/Aug/2016:13:37:00 +0200";
+  uint64_t micros = 0;
+  while (state.keepRunning()) {
+    parser.parse(str.data(), str.size(), &micros);
+    benchmark::doNotOptimize(micros);
+  }
+}
+
+BENCHMARK(TimeParser, parseDistinct) {
+  TimeParser parser;
+  parser.compile("%d/%b/%Y:%H:%M:%S %z");
+  std::string strs[] = {
+    "23/Aug/2016:13:37:00 +0200",
+    "23/Aug/2016:13:37:01 +0200"
+  };
+
+  uint64_t micros = 0;
+  size_t n = 0;
+  while (state.keepRunning()) {
+    const auto& str = strs[++n & 1];
+    parser.parse(str.data(), str.size(), &micros);
+    benchmark::doNotOptimize(micros);
+  }
+}
+
+BENCHMARK(SHA1, compute4K) {
+  auto buf = makeBuffer(4096);
+  SHA1Hash hash;
+  while (state.keepRunning()) {
+    SHA1::compute(buf.data(), buf.size(), &hash);
+    benchmark::doNotOptimize(hash);
+  }
+
+  state.setBytesPerIteration(buf.size());
+}
+
+BENCHMARK(Base64, encode4K) {
+  auto buf = makeBuffer(4096);
+  std::string out;
+  while (state.keepRunning()) {
+    out.clear();
+    Base64::encode(buf, &out);
+    benchmark::doNotOptimize(out);
+  }
+
+  state.setBytesPerIteration(buf.size());
+}
+
+BENCHMARK(Base64, decode4K) {
+  auto buf = Base64::encode(makeBuffer(4096));
+  std::string out;
+  while (state.keepRunning()) {
+    out.clear();
+    Base64::decode(buf, &out);
+    benchmark::doNotOptimize(out);
+  }
+
+  state.setBytesPerIteration(buf.size());
+}
+
+BENCHMARK(MsgPack, encodeMetrics) {
+  std::string out;
+  while (state.keepRunning()) {
+    out.clear();
+    MsgPackWriter writer(&out);
+    writer.appendMap(4);
+    writer.appendString("host");
+    writer.appendString("web01.example.com");
+    writer.appendString("load");
+    writer.appendDouble(0.75);
+    writer.appendString("mem_free");
+    writer.appendUInt(uint64_t(1) << 33);
+    writer.appendString("procs");
+    writer.appendUInt(312);
+    benchmark::doNotOptimize(out);
+  }
+}
+
+BENCHMARK(MsgPack, toJSON) {
+  std::string msgpack;
+  MsgPackWriter writer(&msgpack);
+  writer.appendMap(4);
+  writer.appendString("host");
+  writer.appendString("web01.example.com");
+  writer.appendString("load");
+  writer.appendDouble(0.75);
+  writer.appendString("mem_free");
+  writer.appendUInt(uint64_t(1) << 33);
+  writer.appendString("procs");
+  writer.appendUInt(312);
+
+  std::string json;
+  while (state.keepRunning()) {
+    json.clear();
+    MsgPack::toJSON(msgpack, &json);
+    benchmark::doNotOptimize(json);
+  }
+
+  state.setBytesPerIteration(msgpack.size());
+}
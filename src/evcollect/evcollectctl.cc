@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <iostream>
+#include <evcollect/evcollect.h>
+#include <evcollect/monitor.h>
+#include <evcollect/util/flagparser.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+
+using namespace evcollect;
+
+static const char kDefaultSocketName[] = "evcollectd.sock";
+
+void printUsage() {
+  std::cerr <<
+      "Usage: $ evcollectctl [OPTIONS] <command> [<args>]\n\n"
+      "Commands:\n"
+      "   top                       Live view of event and target rates and latencies\n"
+      "   stats                     Dump all counters as JSON\n"
+      "   queues                    Dump delivery queue and spool sizes\n"
+      "   list                      List all configured events and targets\n"
+      "   checkpoint                Write the checkpoints of all sources now\n"
+      "   flush                     Deliver all queued events and flush all targets\n"
+      "   pause event <name>        Stop reading events for an event binding\n"
+      "   pause target <name>       Stop delivering events to a target\n"
+      "   resume event <name>       Resume a paused event binding\n"
+      "   resume target <name>      Resume a paused target\n"
+      "\n"
+      "Options:\n"
+      "   -S, --socket <path>       Path to the daemon's monitor socket\n"
+      "   -s, --spool_dir <dir>     Use the monitor socket in this spool dir\n"
+      "   -i, --interval <secs>     Refresh interval for top (default: 1)\n"
+      "   -?, --help                Display this help text and exit\n"
+      "   -V, --version             Display the version of this binary and exit\n"
+      "                                                       \n"
+      "Examples:                                              \n"
+      "   $ evcollectctl -s /var/spool/evcollect top\n"
+      "   $ evcollectctl -s /var/spool/evcollect pause target eventql1\n";
+}
+
+int sendCommand(
+    const std::string& socket_path,
+    const std::string& command,
+    std::string* response) {
+  auto rc = MonitorSocket::sendRequest(socket_path, command, response);
+  if (!rc.isSuccess()) {
+    std::cerr << "error: " << rc.getMessage() << std::endl;
+    return 1;
+  }
+
+  if (StringUtil::beginsWith(*response, "error: ")) {
+    std::cerr << *response;
+    return 1;
+  }
+
+  return 0;
+}
+
+int runTop(const std::string& socket_path, uint64_t interval_secs) {
+  /* the first sample only primes the rate counters */
+  std::string response;
+  if (sendCommand(socket_path, "top", &response) != 0) {
+    return 1;
+  }
+
+  while (true) {
+    sleep(interval_secs);
+
+    if (sendCommand(socket_path, "top", &response) != 0) {
+      return 1;
+    }
+
+    /* clear the screen and move the cursor home */
+    std::cout << "\033[2J\033[H" << response << std::flush;
+  }
+
+  return 0;
+}
+
+int main(int argc, const char** argv) {
+  signal(SIGPIPE, SIG_IGN);
+
+  FlagParser flags;
+
+  flags.defineFlag(
+      "help",
+      FlagParser::T_SWITCH,
+      false,
+      "?",
+      NULL);
+
+  flags.defineFlag(
+      "version",
+      FlagParser::T_SWITCH,
+      false,
+      "V",
+      NULL);
+
+  flags.defineFlag(
+      "socket",
+      ::FlagParser::T_STRING,
+      false,
+      "S",
+      NULL);
+
+  flags.defineFlag(
+      "spool_dir",
+      ::FlagParser::T_STRING,
+      false,
+      "s",
+      NULL);
+
+  flags.defineFlag(
+      "interval",
+      ::FlagParser::T_INTEGER,
+      false,
+      "i",
+      "1");
+
+  /* parse flags */
+  {
+    auto rc = flags.parseArgv(argc, argv);
+    if (!rc.isSuccess()) {
+      std::cerr << "error: " << rc.getMessage() << std::endl;
+      return 1;
+    }
+  }
+
+  /* print help */
+  if (flags.isSet("help") || flags.isSet("version")) {
+    std::cerr <<
+        StringUtil::format(
+            "evcollectctl $0\n"
+            "Copyright (c) 2016, DeepCortex GmbH. All rights reserved.\n\n",
+            EVCOLLECT_VERSION);
+  }
+
+  if (flags.isSet("version")) {
+    return 0;
+  }
+
+  const auto& args = flags.getArgv();
+  if (flags.isSet("help") || args.empty()) {
+    printUsage();
+    return flags.isSet("help") ? 0 : 1;
+  }
+
+  std::string socket_path;
+  if (flags.isSet("socket")) {
+    socket_path = flags.getString("socket");
+  } else if (flags.isSet("spool_dir")) {
+    socket_path = flags.getString("spool_dir") + "/" + kDefaultSocketName;
+  } else {
+    std::cerr << "error: --socket or --spool_dir is required" << std::endl;
+    return 1;
+  }
+
+  if (args[0] == "top") {
+    auto interval = flags.getInt("interval");
+    return runTop(socket_path, interval > 0 ? interval : 1);
+  }
+
+  std::string response;
+  if (sendCommand(socket_path, StringUtil::join(args, " "), &response) != 0) {
+    return 1;
+  }
+
+  std::cout << response;
+  return 0;
+}
@@ -113,6 +113,20 @@ int main(int argc, const char** argv) {
       NULL,
       NULL);
 
+  flags.defineFlag(
+      "monitor_socket",
+      FlagParser::T_STRING,
+      false,
+      NULL,
+      NULL);
+
+  flags.defineFlag(
+      "nomonitor",
+      FlagParser::T_SWITCH,
+      false,
+      NULL,
+      NULL);
+
   flags.defineFlag(
       "log_to_syslog",
       FlagParser::T_SWITCH,
@@ -170,6 +184,8 @@ int main(int argc, const char** argv) {
         "   -P, --plugin_path <dir>   Set the plugin search path\n"
         "   --daemonize               Daemonize the server\n"
         "   --pidfile <file>          Write a PID file\n"
+        "   --monitor_socket <path>   Monitor socket (default: <spool_dir>/evcollectd.sock)\n"
+        "   --nomonitor               Don't listen on the monitor socket\n"
         "   --loglevel <level>        Minimum log level (default: INFO)\n"
         "   --[no]log_to_syslog       Do[n't] log to syslog\n"
         "   --[no]log_to_stderr       Do[n't] log to stderr\n"
@@ -286,6 +302,19 @@ int main(int argc, const char** argv) {
     }
   }
 
+  /* listen on monitor socket */
+  if (rc.isSuccess() && !flags.isSet("nomonitor")) {
+    auto monitor_path = flags.getString("monitor_socket");
+    if (monitor_path.empty()) {
+      monitor_path = conf.spool_dir + "/evcollectd.sock";
+    }
+
+    auto monitor_rc = service->listenMonitor(monitor_path);
+    if (!monitor_rc.isSuccess()) {
+      logWarning("can't listen on monitor socket: $0", monitor_rc.getMessage());
+    }
+  }
+
   /* main service loop */
   if (rc.isSuccess()) {
     logInfo("Starting...");
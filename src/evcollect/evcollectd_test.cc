@@ -1,4 +1,126 @@
+#include <stdlib.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <evcollect/checkpoint_store.h>
+#include <evcollect/config.h>
+#include <evcollect/delivery_queue.h>
+#include <evcollect/event_names.h>
+#include <evcollect/file_output.h>
+#include <evcollect/generator.h>
+#include <evcollect/logfile.h>
+#include <evcollect/monitor.h>
+#include <evcollect/null_output.h>
+#include <evcollect/service.h>
+#include <evcollect/stream_output.h>
+#include <evcollect/util/jsonutil.h>
+#include <evcollect/util/histogram.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/msgpack.h>
 #include <evcollect/util/testing.h>
+#include <evcollect/util/time.h>
+#include <evcollect/util/time_parser.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace evcollect;
+
+/**
+ * A temporary directory that is removed together with its contents once it
+ * goes out of scope
+ */
+class TempDir {
+public:
+
+  TempDir() {
+    char path[] = "/tmp/evcollect_test.XXXXXX";
+    if (mkdtemp(path)) {
+      path_ = path;
+    }
+  }
+
+  ~TempDir() {
+    if (!path_.empty()) {
+      nftw(path_.c_str(), &removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+  }
+
+  const std::string& path() const {
+    return path_;
+  }
+
+  std::string file(const std::string& name) const {
+    return path_ + "/" + name;
+  }
+
+protected:
+
+  static int removeEntry(
+      const char* path,
+      const struct stat* st,
+      int type,
+      struct FTW* ftw) {
+    return remove(path);
+  }
+
+  std::string path_;
+};
+
+static PropertyList makeConfig(
+    const std::vector<std::pair<std::string, std::string>>& properties) {
+  PropertyList config;
+  for (const auto& p : properties) {
+    config.properties.emplace_back(
+        p.first,
+        std::vector<std::string>{ p.second });
+  }
+
+  return config;
+}
+
+static PluginConfig makePluginConfig(const TempDir& spool_dir) {
+  PluginConfig plugin_config;
+  plugin_config.spool_dir = spool_dir.path();
+  return plugin_config;
+}
+
+static std::vector<EventData> makeEvents(
+    size_t count,
+    const std::string& data,
+    uint64_t time = 0) {
+  std::vector<EventData> events(count);
+  for (auto& ev : events) {
+    ev.time = time;
+    ev.event_id = EventNameTable::get()->intern("test", &ev.event_name);
+    ev.event_data = std::make_shared<const std::string>(data);
+  }
+
+  return events;
+}
+
+/* reads events until the source has no more pending events */
+static std::vector<std::string> drainEvents(
+    SourcePlugin* plugin,
+    void* userdata) {
+  std::vector<std::string> events;
+  while (plugin->pluginHasPendingEvent(userdata)) {
+    std::string event;
+    EXPECT_TRUE(plugin->pluginGetNextEvent(userdata, &event).isSuccess());
+    events.emplace_back(event);
+  }
+
+  return events;
+}
 
 TEST(ConfigLexer, empty) {
   auto lexer = ConfigLexer::fromString("");
@@ -87,3 +209,1735 @@ TEST(ConfigParser, Blurb) {
   logf("Blurbed $0", "!");
   ASSERT_EQ(2, 1 + 1);
 }
+
+class CountingOutputPlugin : public OutputPlugin {
+public:
+  CountingOutputPlugin() : count(0), flushes(0), fail(false) {}
+  ReturnCode pluginEmitEvent(void* userdata, const EventData& evdata) override {
+    if (fail) {
+      return ReturnCode::error("EIO", "failed");
+    }
+
+    ++count;
+    return ReturnCode::success();
+  }
+  ReturnCode pluginFlush(void* userdata) override {
+    ++flushes;
+    return ReturnCode::success();
+  }
+  size_t count;
+  size_t flushes;
+  std::atomic<bool> fail;
+};
+
+TEST(CheckpointStore, reload) {
+  TempDir dir;
+  auto path = dir.file("checkpoints");
+
+  auto makeCheckpoint = [] (uint64_t inode, uint64_t offset) {
+    CheckpointStore::Checkpoint checkpoint;
+    checkpoint.inode = inode;
+    checkpoint.offset = offset;
+    checkpoint.fingerprint = inode * 7;
+    checkpoint.fingerprint_size = 1024;
+    return checkpoint;
+  };
+
+  {
+    CheckpointStore store(path);
+    ASSERT_TRUE(store.load().isSuccess());
+    store.set(SHA1::compute("a"), makeCheckpoint(1, 100));
+    store.set(SHA1::compute("b"), makeCheckpoint(2, 200));
+    store.set(SHA1::compute("c"), makeCheckpoint(3, 300));
+    store.remove(SHA1::compute("c"));
+    ASSERT_TRUE(store.flush().isSuccess());
+  }
+
+  {
+    CheckpointStore store(path);
+    ASSERT_TRUE(store.load().isSuccess());
+    EXPECT_EQ(2, store.size());
+
+    CheckpointStore::Checkpoint checkpoint;
+    ASSERT_TRUE(store.get(SHA1::compute("a"), &checkpoint));
+    EXPECT_EQ(1, checkpoint.inode);
+    EXPECT_EQ(100, checkpoint.offset);
+    EXPECT_EQ(7, checkpoint.fingerprint);
+    EXPECT_EQ(1024, checkpoint.fingerprint_size);
+    EXPECT_FALSE(store.get(SHA1::compute("c"), &checkpoint));
+  }
+
+  /* a record with a bad checksum is skipped, the others are still loaded */
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(8 + 20);
+    file.put(0x7f);
+  }
+
+  {
+    CheckpointStore store(path);
+    ASSERT_TRUE(store.load().isSuccess());
+    EXPECT_EQ(1, store.size());
+  }
+}
+
+class CapturingLogTarget : public LogTarget {
+public:
+
+  void log(LogLevel level, const std::string& message) override {
+    std::unique_lock<std::mutex> lk(mutex);
+    messages.emplace_back(message);
+  }
+
+  std::mutex mutex;
+  std::vector<std::string> messages;
+};
+
+TEST(CounterOutput, counts) {
+  static CapturingLogTarget log_target;
+  static std::once_flag log_target_added;
+  std::call_once(log_target_added, [] {
+    Logger::get()->addTarget(&log_target);
+  });
+
+  CounterOutputPlugin plugin;
+  PropertyList config;
+  config.properties.emplace_back(
+      "report_interval",
+      std::vector<std::string>{ "3600" });
+
+  void* userdata;
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  std::vector<std::pair<std::string, std::string>> input = {
+    { "counter.a", "123" },
+    { "counter.b", "1" },
+    { "counter.a", "12345" },
+    { "counter.unconfigured", "12" }
+  };
+
+  EventNameTable::get()->intern("counter.a");
+  EventNameTable::get()->intern("counter.b");
+  std::vector<EventData> events(input.size());
+  for (size_t i = 0; i < input.size(); ++i) {
+    EventNameTable::get()->setEventName(&events[i], input[i].first);
+    events[i].event_data = std::make_shared<const std::string>(
+        input[i].second);
+  }
+
+  ASSERT_TRUE(plugin.pluginEmitEvents(userdata, &events[0], 2).isSuccess());
+  ASSERT_TRUE(plugin.pluginEmitEvent(userdata, events[2]).isSuccess());
+  ASSERT_TRUE(plugin.pluginEmitEvent(userdata, events[3]).isSuccess());
+
+  Logger::get()->setMinimumLogLevel(LogLevel::kInfo);
+  {
+    std::unique_lock<std::mutex> lk(log_target.mutex);
+    log_target.messages.clear();
+  }
+
+  plugin.pluginDetach(userdata);
+  Logger::get()->setMinimumLogLevel(LogLevel::kNotice);
+
+  std::unique_lock<std::mutex> lk(log_target.mutex);
+  auto reported = [] (
+      const std::string& event_name,
+      const std::string& events,
+      const std::string& bytes) {
+    for (const auto& msg : log_target.messages) {
+      if (StringUtil::beginsWith(msg, "counter: " + events + " events (") &&
+          msg.find("), " + bytes + " bytes (") != std::string::npos &&
+          StringUtil::endsWith(msg, "for event '" + event_name + "'")) {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  EXPECT_EQ(3, log_target.messages.size());
+  EXPECT_TRUE(reported("counter.a", "2", "8"));
+  EXPECT_TRUE(reported("counter.b", "1", "1"));
+  EXPECT_TRUE(reported("<other>", "1", "2"));
+}
+
+TEST(DeliveryQueue, spillAndReplay) {
+  TempDir spool_dir;
+  auto config = makeConfig({
+    { "delivery_overflow", "spill" },
+    { "delivery_queue_length", "4" }
+  });
+
+  CountingOutputPlugin plugin;
+  DeliveryQueue queue("test", &plugin, nullptr);
+  ASSERT_TRUE(queue.configure(config, spool_dir.path()).isSuccess());
+
+  auto events = makeEvents(10, "{}");
+  ASSERT_TRUE(queue.enqueueEvents(events.data(), events.size()).isSuccess());
+  EXPECT_EQ(4, queue.getLength());
+  EXPECT_EQ(0, queue.getDroppedCount());
+  EXPECT_TRUE(queue.getSpilledBytes() > 0);
+
+  queue.start();
+  while (queue.getLength() > 0 || queue.getSpilledBytes() > 0) {
+    usleep(1000);
+  }
+
+  queue.stop();
+  EXPECT_EQ(10, plugin.count);
+}
+
+/* blocks in the second batch until released */
+class BlockingOutputPlugin : public OutputPlugin {
+public:
+  BlockingOutputPlugin() : batches(0), release(false) {}
+  ReturnCode pluginEmitEvent(void* userdata, const EventData& evdata) override {
+    return ReturnCode::success();
+  }
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override {
+    if (++batches > 1) {
+      while (!release) {
+        usleep(1000);
+      }
+    }
+
+    return ReturnCode::success();
+  }
+  std::atomic<size_t> batches;
+  std::atomic<bool> release;
+};
+
+TEST(DeliveryQueue, replayAfterCrash) {
+  TempDir spool_dir;
+  auto config = makeConfig({
+    { "delivery_overflow", "spill" },
+    { "delivery_queue_length", "4" }
+  });
+
+  BlockingOutputPlugin blocking_plugin;
+  DeliveryQueue queue("test", &blocking_plugin, nullptr);
+  ASSERT_TRUE(queue.configure(config, spool_dir.path()).isSuccess());
+
+  auto events = makeEvents(6, "{}");
+  ASSERT_TRUE(queue.enqueueEvents(events.data(), events.size()).isSuccess());
+  EXPECT_EQ(4, queue.getLength());
+  EXPECT_TRUE(queue.getSpilledBytes() > 0);
+
+  /* the spilled events were read back but their delivery hangs */
+  queue.start();
+  while (blocking_plugin.batches < 2) {
+    usleep(1000);
+  }
+
+  EXPECT_EQ(0, queue.getSpilledBytes());
+
+  /* a queue that is started on the same spool dir after a crash replays
+     them */
+  CountingOutputPlugin plugin;
+  {
+    DeliveryQueue replay_queue("test", &plugin, nullptr);
+    ASSERT_TRUE(replay_queue.configure(config, spool_dir.path()).isSuccess());
+    EXPECT_TRUE(replay_queue.getSpilledBytes() > 0);
+    replay_queue.start();
+    ASSERT_TRUE(replay_queue.flush().isSuccess());
+    replay_queue.stop();
+  }
+
+  EXPECT_EQ(2, plugin.count);
+
+  blocking_plugin.release = true;
+  queue.stop();
+}
+
+TEST(DeliveryQueue, pauseAndFlush) {
+  TempDir spool_dir;
+  auto config = makeConfig({ { "delivery_queue_length", "4" } });
+
+  CountingOutputPlugin plugin;
+  DeliveryQueue queue("test", &plugin, nullptr);
+  ASSERT_TRUE(queue.configure(config, spool_dir.path()).isSuccess());
+  ASSERT_TRUE(queue.start().isSuccess());
+  ASSERT_TRUE(queue.pause().isSuccess());
+
+  /* a paused queue spills instead of blocking */
+  auto events = makeEvents(10, "{}");
+  ASSERT_TRUE(queue.enqueueEvents(events.data(), events.size()).isSuccess());
+  EXPECT_EQ(4, queue.getLength());
+  EXPECT_TRUE(queue.getSpilledBytes() > 0);
+  EXPECT_FALSE(queue.flush(1000).isSuccess());
+
+  queue.resume();
+  ASSERT_TRUE(queue.flush().isSuccess());
+  EXPECT_EQ(10, plugin.count);
+  EXPECT_EQ(1, plugin.flushes);
+  EXPECT_EQ(0, queue.getLength());
+  EXPECT_EQ(0, queue.getSpilledBytes());
+
+  queue.stop();
+}
+
+TEST(DeliveryQueue, acknowledgedSequence) {
+  TempDir spool_dir;
+  auto config = makeConfig({ { "delivery_max_retries", "0" } });
+
+  CountingOutputPlugin plugin;
+  DeliveryQueue queue("test", &plugin, nullptr);
+  ASSERT_TRUE(queue.configure(config, spool_dir.path()).isSuccess());
+
+  uint64_t sequence = 0;
+  auto enqueue = [&queue, &sequence] (size_t n) {
+    auto events = makeEvents(n, "{}");
+    for (auto& ev : events) {
+      ev.sequence = ++sequence;
+    }
+
+    return queue.enqueueEvents(events.data(), events.size());
+  };
+
+  ASSERT_TRUE(enqueue(5).isSuccess());
+  EXPECT_EQ(0, queue.getAcknowledgedSequence());
+
+  queue.start();
+  ASSERT_TRUE(queue.flush().isSuccess());
+  EXPECT_EQ(5, queue.getAcknowledgedSequence());
+
+  /* lost events stop the acknowledged sequence */
+  plugin.fail = true;
+  ASSERT_TRUE(enqueue(3).isSuccess());
+  ASSERT_TRUE(queue.flush().isSuccess());
+  EXPECT_EQ(5, queue.getAcknowledgedSequence());
+
+  plugin.fail = false;
+  ASSERT_TRUE(enqueue(1).isSuccess());
+  ASSERT_TRUE(queue.flush().isSuccess());
+  EXPECT_EQ(6, plugin.count);
+  EXPECT_EQ(5, queue.getAcknowledgedSequence());
+
+  queue.stop();
+}
+
+static std::vector<size_t> emitted_batches;
+
+static int batchOutputEmitEvent(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t* ev) {
+  emitted_batches.emplace_back(1);
+  return 1;
+}
+
+static int batchOutputEmitEvents(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t** evs,
+    size_t evs_count) {
+  const char* data;
+  size_t size;
+  evcollect_event_getdata(evs[evs_count - 1], &data, &size);
+  if (std::string(data, size) == "fail") {
+    evcollect_seterror(ctx, "failed");
+    return 0;
+  }
+
+  emitted_batches.emplace_back(evs_count);
+  return 1;
+}
+
+TEST(DynamicOutputPlugin, emitEvents) {
+  PluginMap plugin_map("/tmp", "/tmp");
+  PluginContext ctx;
+  ctx.plugin_map = &plugin_map;
+
+  evcollect_output_plugin_register_batched(
+      &ctx,
+      "batched",
+      &batchOutputEmitEvent,
+      &batchOutputEmitEvents,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr);
+
+  evcollect_output_plugin_register(
+      &ctx,
+      "unbatched",
+      &batchOutputEmitEvent,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr);
+
+  std::vector<EventData> events(3);
+  for (auto& e : events) {
+    e.event_data = std::make_shared<const std::string>("{}");
+  }
+
+  OutputPlugin* batched;
+  ASSERT_TRUE(plugin_map.getOutputPlugin("batched", &batched).isSuccess());
+  emitted_batches.clear();
+  EXPECT_TRUE(batched->pluginEmitEvents(nullptr, events.data(), 3).isSuccess());
+  EXPECT_TRUE(batched->pluginEmitEvent(nullptr, events[0]).isSuccess());
+  EXPECT_TRUE(emitted_batches == std::vector<size_t>({ 3, 1 }));
+
+  events[2].event_data = std::make_shared<const std::string>("fail");
+  auto rc = batched->pluginEmitEvents(nullptr, events.data(), 3);
+  EXPECT_FALSE(rc.isSuccess());
+  EXPECT_EQ("pluginEmitEvents failed: failed", rc.getMessage());
+
+  OutputPlugin* unbatched;
+  ASSERT_TRUE(plugin_map.getOutputPlugin("unbatched", &unbatched).isSuccess());
+  emitted_batches.clear();
+  EXPECT_TRUE(
+      unbatched->pluginEmitEvents(nullptr, events.data(), 3).isSuccess());
+  EXPECT_TRUE(emitted_batches == std::vector<size_t>({ 1, 1, 1 }));
+}
+
+TEST(FileOutput, rotate) {
+  TempDir dir;
+  auto config = makeConfig({
+    { "directory", dir.path() },
+    { "segment_size", "100" },
+    { "fsync_interval", "0" }
+  });
+
+  FileOutputPlugin plugin;
+  void* userdata;
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  auto events = makeEvents(2, R"({"a":"xxxxxxxxxx"})", 1234);
+
+  for (size_t i = 0; i < 3; ++i) {
+    auto rc = plugin.pluginEmitEvents(userdata, events.data(), events.size());
+    ASSERT_TRUE(rc.isSuccess());
+  }
+
+  ASSERT_TRUE(plugin.pluginFlush(userdata).isSuccess());
+  plugin.pluginDetach(userdata);
+
+  std::vector<std::string> segments;
+  auto d = opendir(dir.path().c_str());
+  ASSERT_TRUE(d != nullptr);
+  while (auto entry = readdir(d)) {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..") {
+      segments.emplace_back(dir.file(name));
+    }
+  }
+  closedir(d);
+
+  /* every batch exceeds the segment size, so each one starts a new segment */
+  EXPECT_EQ(3, segments.size());
+  for (const auto& segment : segments) {
+    EXPECT_TRUE(StringUtil::endsWith(segment, ".ndjson"));
+
+    std::ifstream in(segment);
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(in, line)) {
+      EXPECT_EQ(
+          R"({"time":1234,"event":"test","data":{"a":"xxxxxxxxxx"}})",
+          line);
+      ++lines;
+    }
+
+    EXPECT_EQ(2, lines);
+  }
+}
+
+TEST(GeneratorSource, batches) {
+  GeneratorSourcePlugin plugin;
+
+  PropertyList config;
+  config.properties.emplace_back(
+      "batch_size",
+      std::vector<std::string>{ "10" });
+  config.properties.emplace_back(
+      "event_size",
+      std::vector<std::string>{ "200" });
+  config.properties.emplace_back(
+      "templates",
+      std::vector<std::string>{ "4" });
+  config.properties.emplace_back(
+      "nesting",
+      std::vector<std::string>{ "1" });
+
+  void* userdata;
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  std::set<std::string> distinct;
+  JSONObjectMerger merger;
+  for (size_t i = 0; i < 10; ++i) {
+    std::string event;
+    EXPECT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    EXPECT_EQ(200, event.size());
+    EXPECT_EQ(0, event.find(R"({"level0":{"field0":"value)"));
+
+    std::string merged;
+    EXPECT_TRUE(merger.merge(event, "{}", &merged));
+    EXPECT_EQ((i < 9), plugin.pluginHasPendingEvent(userdata));
+    distinct.insert(event);
+  }
+
+  EXPECT_TRUE(distinct.size() <= 4);
+  plugin.pluginDetach(userdata);
+}
+
+TEST(GeneratorSource, msgpackEncoding) {
+  GeneratorSourcePlugin plugin;
+
+  std::string events[2];
+  EventEncoding encodings[2];
+  const char* encoding_names[2] = { "json", "msgpack" };
+  for (size_t i = 0; i < 2; ++i) {
+    PropertyList config;
+    config.properties.emplace_back(
+        "encoding",
+        std::vector<std::string>{ encoding_names[i] });
+    config.properties.emplace_back(
+        "event_size",
+        std::vector<std::string>{ "0" });
+    config.properties.emplace_back(
+        "nesting",
+        std::vector<std::string>{ "2" });
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+    EXPECT_TRUE(plugin.pluginGetNextEvent(userdata, &events[i]).isSuccess());
+    encodings[i] = plugin.pluginGetEncoding(userdata);
+    plugin.pluginDetach(userdata);
+  }
+
+  EXPECT_TRUE(encodings[0] == EventEncoding::JSON);
+  EXPECT_TRUE(encodings[1] == EventEncoding::MSGPACK);
+  EXPECT_TRUE(events[1].size() < events[0].size());
+
+  std::string json;
+  ASSERT_TRUE(MsgPack::toJSON(events[1], &json));
+  EXPECT_EQ(events[0], json);
+}
+
+TEST(JSONObjectMerger, merge) {
+  JSONObjectMerger merger;
+  std::string out;
+
+  ASSERT_TRUE(merger.merge(R"({ "a": 1, "b": "x" })", R"({"c":[1,{"d":"}"}]})", &out));
+  EXPECT_EQ(R"({"a": 1,"b": "x","c":[1,{"d":"}"}]})", out);
+
+  ASSERT_TRUE(merger.merge(R"({"a":1,"b":2})", R"({"b":{"x":3}})", &out));
+  EXPECT_EQ(R"({"a":1,"b":{"x":3}})", out);
+
+  ASSERT_TRUE(merger.merge("{}", R"({"a":"\"}"})", &out));
+  EXPECT_EQ(R"({"a":"\"}"})", out);
+
+  EXPECT_FALSE(merger.merge("[1,2]", R"({"a":1})", &out));
+  EXPECT_FALSE(merger.merge(R"({"a":1)", R"({"a":1})", &out));
+}
+
+TEST(JSONUtil, validate) {
+  auto validate = [] (const std::string& json) {
+    return JSONUtil::validate(json.data(), json.data() + json.size());
+  };
+
+  EXPECT_TRUE(validate(R"({"a":[1,-2.5e+3,true,false,null,{}],"b":"\u00e4"})"));
+  EXPECT_TRUE(validate(" [ ] "));
+  EXPECT_TRUE(validate("\"\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80\""));
+  EXPECT_TRUE(validate("0"));
+
+  EXPECT_FALSE(validate(""));
+  EXPECT_FALSE(validate("{"));
+  EXPECT_FALSE(validate(R"({"a":1,})"));
+  EXPECT_FALSE(validate(R"({"a" 1})"));
+  EXPECT_FALSE(validate(R"({a:1})"));
+  EXPECT_FALSE(validate("[1 2]"));
+  EXPECT_FALSE(validate("{} {}"));
+  EXPECT_FALSE(validate("01"));
+  EXPECT_FALSE(validate("1."));
+  EXPECT_FALSE(validate("-"));
+  EXPECT_FALSE(validate("1e"));
+  EXPECT_FALSE(validate("tru"));
+  EXPECT_FALSE(validate(R"("\x")"));
+  EXPECT_FALSE(validate(R"("\u12g4")"));
+  EXPECT_FALSE(validate("\"a\tb\""));
+  EXPECT_FALSE(validate("\"\xc3\""));
+  EXPECT_FALSE(validate("\"\xc0\xaf\""));
+  EXPECT_FALSE(validate("\"\xed\xa0\x80\""));
+  EXPECT_FALSE(validate("\"\xff\""));
+  EXPECT_FALSE(validate(std::string(JSONUtil::kMaxDepth + 1, '[') +
+      std::string(JSONUtil::kMaxDepth + 1, ']')));
+  EXPECT_TRUE(validate(std::string(JSONUtil::kMaxDepth, '[') +
+      std::string(JSONUtil::kMaxDepth, ']')));
+}
+
+TEST(EventNameTable, intern) {
+  EventNameTable table;
+
+  const std::string* a_name;
+  auto a = table.intern("a", &a_name);
+  auto b = table.intern("b");
+  EXPECT_NE(EventNameTable::kUnknownEventID, a);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a, table.intern("a"));
+  EXPECT_EQ("a", *a_name);
+  EXPECT_TRUE(a_name == table.lookup(a));
+  EXPECT_EQ(3, table.size());
+  EXPECT_TRUE(table.lookup(3) == nullptr);
+}
+
+TEST(EventNameTable, setEventName) {
+  EventNameTable table;
+  auto a = table.intern("a");
+
+  EventData configured;
+  table.setEventName(&configured, "a");
+  EXPECT_EQ(a, configured.event_id);
+  EXPECT_TRUE(configured.event_name == table.lookup(a));
+
+  EventData runtime;
+  table.setEventName(&runtime, "host-1234");
+  EXPECT_EQ(EventNameTable::kUnknownEventID, runtime.event_id);
+  EXPECT_EQ("host-1234", *runtime.event_name);
+  EXPECT_EQ(2, table.size());
+
+  auto copy = runtime;
+  runtime = EventData();
+  EXPECT_EQ("host-1234", *copy.event_name);
+}
+
+TEST(LatencyHistogram, percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.getPercentile(0.5));
+
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    histogram.record(i);
+  }
+
+  EXPECT_EQ(1000, histogram.getCount());
+  EXPECT_EQ(500500, histogram.getSum());
+  EXPECT_EQ(1000, histogram.getMax());
+  EXPECT_EQ(511, histogram.getPercentile(0.5));
+  EXPECT_EQ(991, histogram.getPercentile(0.99));
+
+  /* values are accurate to within 1/16 over the full range */
+  for (uint64_t v = 1; v < (uint64_t(1) << 62); v = v * 3 + 1) {
+    auto idx = LatencyHistogram::getBucketIndex(v);
+    auto upper = LatencyHistogram::getBucketUpperBound(idx);
+    EXPECT_TRUE(upper >= v);
+    EXPECT_TRUE(upper - v <= v / LatencyHistogram::kSubBuckets);
+    EXPECT_TRUE(idx < LatencyHistogram::kNumBuckets);
+  }
+
+  EXPECT_EQ(
+      LatencyHistogram::kNumBuckets - 1,
+      LatencyHistogram::getBucketIndex(uint64_t(-1)));
+}
+
+TEST(LatencyHistogram, mergeShards) {
+  LatencyHistogram histogram;
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 8; ++i) {
+    threads.emplace_back([&histogram] {
+      for (uint64_t j = 0; j < 1000; ++j) {
+        histogram.record(j);
+      }
+    });
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  auto snapshot = histogram.getSnapshot();
+  EXPECT_EQ(8000, snapshot.count);
+  EXPECT_EQ(999, snapshot.max);
+
+  LatencyHistogram::Snapshot merged;
+  merged.merge(snapshot);
+  merged.merge(snapshot);
+  EXPECT_EQ(16000, merged.count);
+  EXPECT_EQ(snapshot.getPercentile(0.5), merged.getPercentile(0.5));
+}
+
+TEST(LogfileSource, acknowledge) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+  std::ofstream(logfile) << "l1\nl2\nl3\n";
+
+  auto config = makeConfig({ { "logfile", logfile } });
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    std::string event;
+    ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    plugin.pluginMarkPosition(userdata, 1);
+    event.clear();
+    ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    plugin.pluginMarkPosition(userdata, 2);
+
+    /* only the first line was delivered */
+    plugin.pluginAcknowledge(userdata, 1);
+    ASSERT_TRUE(plugin.pluginCheckpoint(userdata).isSuccess());
+    plugin.pluginDetach(userdata);
+    plugin.pluginFree();
+  }
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    std::string event;
+    ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    EXPECT_EQ(R"({ "data": "l2" })", event);
+    plugin.pluginDetach(userdata);
+  }
+}
+
+TEST(LogfileSource, glob) {
+  TempDir dir;
+  TempDir spool_dir;
+
+  auto append = [&dir] (const std::string& name, const std::string& data) {
+    std::ofstream out(dir.file(name), std::ios::app);
+    out << data;
+  };
+
+  append("a.log", "a1\n");
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(spool_dir)).isSuccess());
+
+  void* userdata;
+  auto config = makeConfig({ { "logfile", dir.file("*.log") } });
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  /* files are read in no particular order */
+  auto drain = [&plugin, userdata] () {
+    auto events = drainEvents(&plugin, userdata);
+    return std::set<std::string>(events.begin(), events.end());
+  };
+
+  EXPECT_TRUE(drain() == std::set<std::string>{ R"({ "data": "a1" })" });
+
+  /* new files are picked up from inotify, non-matching files are ignored */
+  append("b.log", "b1\n");
+  append("c.txt", "c1\n");
+  append("a.log", "a2\n");
+  EXPECT_TRUE(
+      drain() == std::set<std::string>({
+          R"({ "data": "a2" })",
+          R"({ "data": "b1" })" }));
+
+  PluginStats stats;
+  plugin.pluginGetStats(userdata, &stats);
+  EXPECT_TRUE(stats[0] == std::make_pair(std::string("files"), uint64_t(2)));
+  EXPECT_TRUE(
+      stats[1] == std::make_pair(std::string("active_files"), uint64_t(0)));
+
+  /* writes to the target of a symlink in another directory are picked up */
+  auto target = spool_dir.file("target");
+  std::ofstream(target) << "s1\n";
+  ASSERT_TRUE(symlink(target.c_str(), dir.file("s.log").c_str()) == 0);
+  EXPECT_TRUE(drain() == std::set<std::string>{ R"({ "data": "s1" })" });
+  std::ofstream(target, std::ios::app) << "s2\n";
+  EXPECT_TRUE(drain() == std::set<std::string>{ R"({ "data": "s2" })" });
+  unlink(dir.file("s.log").c_str());
+
+  /* removed files are dropped together with their checkpoint */
+  unlink(dir.file("b.log").c_str());
+  EXPECT_TRUE(drain().empty());
+  stats.clear();
+  plugin.pluginGetStats(userdata, &stats);
+  EXPECT_TRUE(stats[0] == std::make_pair(std::string("files"), uint64_t(1)));
+
+  plugin.pluginDetach(userdata);
+}
+
+TEST(LogfileSource, globMovedFile) {
+  TempDir dir;
+  TempDir spool_dir;
+
+  std::ofstream(dir.file("a.log")) << "a1\n";
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(spool_dir)).isSuccess());
+
+  void* userdata;
+  auto config = makeConfig({ { "logfile", dir.file("*.log") } });
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  EXPECT_TRUE(
+      drainEvents(&plugin, userdata) ==
+      std::vector<std::string>{ R"({ "data": "a1" })" });
+
+  /* lines written before the file was moved away are still read */
+  std::ofstream(dir.file("a.log"), std::ios::app) << "a2\na3\n";
+  ASSERT_TRUE(
+      rename(dir.file("a.log").c_str(), dir.file("a.log.1").c_str()) == 0);
+
+  EXPECT_TRUE(
+      drainEvents(&plugin, userdata) ==
+      std::vector<std::string>({
+          R"({ "data": "a2" })",
+          R"({ "data": "a3" })" }));
+
+  PluginStats stats;
+  plugin.pluginGetStats(userdata, &stats);
+  EXPECT_TRUE(stats[0] == std::make_pair(std::string("files"), uint64_t(0)));
+
+  plugin.pluginDetach(userdata);
+}
+
+TEST(LogfileSource, globSameDirectory) {
+  TempDir dir;
+  TempDir spool_dir;
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(spool_dir)).isSuccess());
+
+  /* both globs share one inotify watch although the directory is spelled
+     differently */
+  void* log_userdata;
+  auto log_config = makeConfig({ { "logfile", dir.file("*.log") } });
+  ASSERT_TRUE(plugin.pluginAttach(log_config, &log_userdata).isSuccess());
+
+  void* txt_userdata;
+  auto txt_config = makeConfig({ { "logfile", dir.file("./*.txt") } });
+  ASSERT_TRUE(plugin.pluginAttach(txt_config, &txt_userdata).isSuccess());
+
+  std::ofstream(dir.file("a.log")) << "a1\n";
+  std::ofstream(dir.file("b.txt")) << "b1\n";
+
+  EXPECT_TRUE(
+      drainEvents(&plugin, txt_userdata) ==
+      std::vector<std::string>{ R"({ "data": "b1" })" });
+  EXPECT_TRUE(
+      drainEvents(&plugin, log_userdata) ==
+      std::vector<std::string>{ R"({ "data": "a1" })" });
+
+  plugin.pluginDetach(txt_userdata);
+  plugin.pluginDetach(log_userdata);
+}
+
+TEST(LogfileSource, fieldTypes) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+  std::ofstream(logfile) <<
+      "2016-08-23T13:37:00.5Z 200 -12 0.25 yes\n" <<
+      "2016-08-23T13:37:01Z 007 99999999999999999999 1e3 off\n" <<
+      "x x x x x\n";
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+  /* the first timestamp has a fraction that the format does not allow */
+  auto config = makeConfig({
+    { "logfile", logfile },
+    { "regex", "^(?<t>\\S+) (?<a>\\S+) (?<b>\\S+) (?<c>\\S+) (?<d>\\S+)$" },
+    { "field_type", "t:timestamp:%FT%T%z" },
+    { "field_type", "a:int" },
+    { "field_type", "b:int" },
+    { "field_type", "c:float" },
+    { "field_type", "d:bool" }
+  });
+
+  void* userdata;
+  {
+    auto bad_config = config;
+    bad_config.properties.emplace_back(
+        "field_type",
+        std::vector<std::string>{ "x:int" });
+    EXPECT_FALSE(plugin.pluginAttach(bad_config, &userdata).isSuccess());
+  }
+
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  auto events = drainEvents(&plugin, userdata);
+  ASSERT_EQ(3, events.size());
+  EXPECT_EQ(
+      R"({"t":null,"a":200,"b":-12,"c":0.25,"d":true})",
+      events[0]);
+  EXPECT_EQ(
+      R"({"t":1471959421000000,"a":7,"b":null,"c":1e3,"d":false})",
+      events[1]);
+  EXPECT_EQ(R"({"t":null,"a":null,"b":null,"c":null,"d":null})", events[2]);
+
+  plugin.pluginDetach(userdata);
+}
+
+TEST(LogfileSource, eventTime) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+  std::ofstream(logfile) <<
+      "[23/Aug/2016:13:37:00 +0200] a\n" <<
+      "[garbage] b\n";
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+  auto config = makeConfig({
+    { "logfile", logfile },
+    { "regex", "^\\[(?<time>[^\\]]+)\\] (?<msg>.*)$" },
+    { "time_field", "time" }
+  });
+
+  void* userdata;
+  EXPECT_FALSE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  config.properties.emplace_back(
+      "time_format",
+      std::vector<std::string>{ "%d/%b/%Y:%H:%M:%S %z" });
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  std::string event;
+  uint64_t time = 0;
+  ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+  EXPECT_TRUE(plugin.pluginGetEventTime(userdata, &time));
+  EXPECT_EQ(1471952220000000, time);
+
+  event.clear();
+  ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+  EXPECT_EQ(R"({"time":"garbage","msg":"b"})", event);
+  EXPECT_FALSE(plugin.pluginGetEventTime(userdata, &time));
+
+  plugin.pluginDetach(userdata);
+}
+
+TEST(LogfileSource, formats) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+
+  auto read = [&dir, &logfile] (
+      const std::string& data,
+      std::vector<std::pair<std::string, std::string>> options,
+      PluginStats* stats = nullptr) {
+    std::ofstream(logfile) << data;
+    unlink(dir.file("logfile.checkpoints").c_str());
+
+    options.emplace_back("logfile", logfile);
+    auto config = makeConfig(options);
+
+    std::vector<std::string> events;
+    LogfileSourcePlugin plugin;
+    void* userdata;
+    if (!plugin.pluginInit(makePluginConfig(dir)).isSuccess() ||
+        !plugin.pluginAttach(config, &userdata).isSuccess()) {
+      return events;
+    }
+
+    events = drainEvents(&plugin, userdata);
+    if (stats) {
+      plugin.pluginGetStats(userdata, stats);
+    }
+
+    plugin.pluginDetach(userdata);
+    return events;
+  };
+
+  auto stat = [] (const PluginStats& stats, const std::string& name) {
+    for (const auto& s : stats) {
+      if (s.first == name) {
+        return s.second;
+      }
+    }
+
+    return uint64_t(-1);
+  };
+
+  {
+    auto events = read(
+        "a\t1\tx\n" "b\t\t\n" "c\n",
+        {
+          { "format", "delimiter" },
+          { "fields", "name,count," },
+          { "field_type", "count:int" }
+        });
+
+    ASSERT_EQ(3, events.size());
+    EXPECT_EQ(R"({"name":"a","count":1})", events[0]);
+    EXPECT_EQ(R"({"name":"b","count":null})", events[1]);
+    EXPECT_EQ(R"({"name":"c"})", events[2]);
+  }
+
+  {
+    auto events = read(
+        "  GET   /index.html 200\n",
+        {
+          { "format", "delimiter" },
+          { "delimiter", "space" },
+          { "fields", "method,path,status" }
+        });
+
+    ASSERT_EQ(1, events.size());
+    EXPECT_EQ(
+        R"({"method":"GET","path":"/index.html","status":"200"})",
+        events[0]);
+  }
+
+  {
+    auto events = read(
+        "level=info msg=\"say \\\"hi\\\"\" n=3 junk empty=\n",
+        {
+          { "format", "kv" },
+          { "field_type", "n:int" }
+        });
+
+    ASSERT_EQ(1, events.size());
+    EXPECT_EQ(
+        R"({"level":"info","msg":"say \"hi\"","n":3,"empty":""})",
+        events[0]);
+  }
+
+  {
+    PluginStats stats;
+    auto events = read(
+        "{\"a\": [1, {\"b\": 2}]}\n" "{\"a\": \n",
+        { { "format", "json" } },
+        &stats);
+
+    ASSERT_EQ(2, events.size());
+    EXPECT_EQ(R"({"a": [1, {"b": 2}]})", events[0]);
+    EXPECT_EQ(R"({ "data": "{\"a\": " })", events[1]);
+    EXPECT_EQ(1, stat(stats, "invalid_json_lines"));
+    EXPECT_EQ(0, stat(stats, "dropped_lines"));
+  }
+
+  {
+    PluginStats stats;
+    auto events = read(
+        "{\"a\": 1}\n" "{\"a\": 01}\n" "{\"a\": \"\x01\"}\n",
+        { { "format", "json" }, { "json_fallback", "drop" } },
+        &stats);
+
+    /* dropped lines produce no event */
+    ASSERT_EQ(3, events.size());
+    EXPECT_EQ(R"({"a": 1})", events[0]);
+    EXPECT_EQ("", events[1]);
+    EXPECT_EQ("", events[2]);
+    EXPECT_EQ(2, stat(stats, "invalid_json_lines"));
+    EXPECT_EQ(2, stat(stats, "dropped_lines"));
+  }
+
+  EXPECT_TRUE(read("{}\n", { { "json_fallback", "keep" } }).empty());
+
+  EXPECT_TRUE(read("x\n", { { "format", "delimiter" } }).empty());
+  EXPECT_TRUE(read("x\n", { { "format", "regex" } }).empty());
+}
+
+TEST(LogfileSource, followRotated) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+  std::ofstream(logfile) << "l1\nl2\nl3\n";
+
+  auto config = makeConfig({ { "logfile", logfile } });
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    std::string event;
+    ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    plugin.pluginMarkPosition(userdata, 1);
+    plugin.pluginAcknowledge(userdata, 1);
+    ASSERT_TRUE(plugin.pluginCheckpoint(userdata).isSuccess());
+    plugin.pluginDetach(userdata);
+    plugin.pluginFree();
+  }
+
+  /* rotate (and compress) the file while the collector is stopped */
+  auto rotated = logfile + ".1";
+  ASSERT_TRUE(rename(logfile.c_str(), rotated.c_str()) == 0);
+#ifdef HAVE_ZLIB
+  {
+    std::string data;
+    std::getline(std::ifstream(rotated), data, '\0');
+    unlink(rotated.c_str());
+    rotated += ".gz";
+    auto gz = gzopen(rotated.c_str(), "wb");
+    ASSERT_TRUE(gz != nullptr);
+    EXPECT_EQ(data.size(), gzwrite(gz, data.data(), data.size()));
+    gzclose(gz);
+  }
+#endif
+  std::ofstream(logfile) << "n1\n";
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    auto events = drainEvents(&plugin, userdata);
+    ASSERT_EQ(3, events.size());
+    EXPECT_EQ(R"({ "data": "l2" })", events[0]);
+    EXPECT_EQ(R"({ "data": "l3" })", events[1]);
+    EXPECT_EQ(R"({ "data": "n1" })", events[2]);
+    plugin.pluginDetach(userdata);
+  }
+}
+
+#ifdef HAVE_ZLIB
+TEST(LogfileSource, rotatedReadError) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+
+  std::string data;
+  for (size_t i = 0; i < 10000; ++i) {
+    data += StringUtil::format("line $0\n", i);
+  }
+
+  std::ofstream(logfile) << data;
+
+  auto config = makeConfig({ { "logfile", logfile } });
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    std::string event;
+    ASSERT_TRUE(plugin.pluginGetNextEvent(userdata, &event).isSuccess());
+    plugin.pluginMarkPosition(userdata, 1);
+    plugin.pluginAcknowledge(userdata, 1);
+    ASSERT_TRUE(plugin.pluginCheckpoint(userdata).isSuccess());
+    plugin.pluginDetach(userdata);
+    plugin.pluginFree();
+  }
+
+  /* rotate into a compressed file whose checksum doesn't match, so reading
+     fails once the end of the data is reached */
+  ASSERT_TRUE(rename(logfile.c_str(), (logfile + ".1").c_str()) == 0);
+  std::ofstream(logfile) << "n1\n";
+
+  auto rotated = logfile + ".1.gz";
+  {
+    auto gz = gzopen(rotated.c_str(), "wb");
+    ASSERT_TRUE(gz != nullptr);
+    EXPECT_EQ(data.size(), gzwrite(gz, data.data(), data.size()));
+    gzclose(gz);
+
+    std::fstream f(rotated, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(-8, std::ios::end);
+    char crc = f.get() ^ 0xff;
+    f.seekp(-8, std::ios::end);
+    f.put(crc);
+  }
+
+  unlink((logfile + ".1").c_str());
+
+  {
+    LogfileSourcePlugin plugin;
+    ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+    void* userdata;
+    ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+    /* the error is reported instead of looking like the end of the file */
+    std::vector<std::string> events;
+    size_t errors = 0;
+    while (plugin.pluginHasPendingEvent(userdata)) {
+      std::string event;
+      if (plugin.pluginGetNextEvent(userdata, &event).isSuccess()) {
+        events.emplace_back(event);
+      } else {
+        ++errors;
+      }
+    }
+
+    EXPECT_EQ(1, errors);
+    ASSERT_TRUE(events.size() > 1);
+    EXPECT_TRUE(events.size() < 10000);
+    EXPECT_EQ(R"({ "data": "line 1" })", events.front());
+    EXPECT_EQ(R"({ "data": "n1" })", events.back());
+    plugin.pluginDetach(userdata);
+  }
+}
+#endif
+
+TEST(LogfileSource, multiline) {
+  TempDir dir;
+  auto logfile = dir.file("test.log");
+  std::ofstream(logfile) <<
+      "2016 ERROR boom\n" <<
+      "java.lang.Error\n" <<
+      "  at Main.main\n" <<
+      "2016 WARN a\n" <<
+      " b\n" <<
+      " c\n" <<
+      " d\n" <<
+      "2016 INFO ok\n";
+
+  LogfileSourcePlugin plugin;
+  ASSERT_TRUE(plugin.pluginInit(makePluginConfig(dir)).isSuccess());
+
+  auto config = makeConfig({
+    { "logfile", logfile },
+    { "multiline_start", "^\\d{4} " },
+    { "multiline_max_lines", "3" },
+    { "multiline_timeout", "50" }
+  });
+
+  void* userdata;
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  auto events = drainEvents(&plugin, userdata);
+  ASSERT_EQ(3, events.size());
+  EXPECT_EQ(
+      R"({ "data": "2016 ERROR boom\njava.lang.Error\n  at Main.main" })",
+      events[0]);
+  EXPECT_EQ(R"({ "data": "2016 WARN a\n b\n c" })", events[1]);
+  EXPECT_EQ(R"({ "data": " d" })", events[2]);
+
+  /* the last record is held back until no line was appended for the timeout */
+  usleep(60000);
+  events = drainEvents(&plugin, userdata);
+  ASSERT_EQ(1, events.size());
+  EXPECT_EQ(R"({ "data": "2016 INFO ok" })", events[0]);
+
+  plugin.pluginDetach(userdata);
+}
+
+TEST(MsgPack, toJSON) {
+  std::string msgpack;
+  MsgPackWriter writer(&msgpack);
+  writer.appendMap(7);
+  writer.appendString("str");
+  writer.appendString("a\"b");
+  writer.appendString("uint");
+  writer.appendUInt(uint64_t(1) << 40);
+  writer.appendString("int");
+  writer.appendInt(-70000);
+  writer.appendString("double");
+  writer.appendDouble(0.5);
+  writer.appendString("list");
+  writer.appendArray(3);
+  writer.appendBool(true);
+  writer.appendNil();
+  writer.appendInt(-3);
+  writer.appendUInt(42);
+  writer.appendString("int_key");
+  writer.appendString(std::string(40, 'x'));
+  writer.appendMap(0);
+
+  std::string json;
+  ASSERT_TRUE(MsgPack::toJSON(msgpack, &json));
+  EXPECT_EQ(
+      R"({"str":"a\"b","uint":1099511627776,"int":-70000,"double":0.5,)"
+      R"("list":[true,null,-3],"42":"int_key",)"
+      R"("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx":{}})",
+      json);
+
+  /* truncated input and trailing bytes are rejected */
+  json.clear();
+  EXPECT_FALSE(MsgPack::toJSON(msgpack.data(), msgpack.size() - 1, &json));
+  json.clear();
+  EXPECT_FALSE(MsgPack::toJSON(msgpack + "\x01", &json));
+}
+
+TEST(MonitorSocket, request) {
+  auto socket_path = StringUtil::format(
+      "/tmp/evcollect_test_monitor_$0.sock",
+      getpid());
+
+  MonitorSocket monitor;
+  ASSERT_TRUE(monitor.listen(socket_path).isSuccess());
+
+  std::string response;
+  std::thread client([&socket_path, &response] {
+    MonitorSocket::sendRequest(socket_path, "stats", &response);
+  });
+
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(monitor.getFD(), &fds);
+  ASSERT_EQ(1, select(monitor.getFD() + 1, &fds, NULL, NULL, NULL));
+
+  std::string command;
+  auto rc = monitor.handleConnection(
+      [&command] (const std::string& cmd, std::string* resp) {
+        command = cmd;
+        *resp = "{}";
+      });
+
+  client.join();
+  EXPECT_TRUE(rc.isSuccess());
+  EXPECT_EQ("stats", command);
+  EXPECT_EQ("{}\n", response);
+
+  monitor.close();
+  EXPECT_TRUE(access(socket_path.c_str(), F_OK) != 0);
+}
+
+static std::mutex recorded_mutex;
+static std::vector<std::string> recorded_events;
+
+static int recordingOutputEmitEvent(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t* ev) {
+  const char* name;
+  size_t name_len;
+  evcollect_event_getname(ev, &name, &name_len);
+
+  std::unique_lock<std::mutex> lk(recorded_mutex);
+  recorded_events.emplace_back(name, name_len);
+  return 1;
+}
+
+static bool recordingPluginInit(evcollect_ctx_t* ctx) {
+  evcollect_output_plugin_register(
+      ctx,
+      "recorder",
+      &recordingOutputEmitEvent,
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr);
+
+  return true;
+}
+
+TEST(PropertyList, getUInt) {
+  auto config = makeConfig({
+    { "plain", "42" },
+    { "max", "18446744073709551615" },
+    { "overflow", "18446744073709551616" },
+    { "negative", "-1" },
+    { "plus", "+1" },
+    { "suffix", "10ms" },
+    { "space", " 10" },
+    { "empty", "" },
+  });
+
+  uint64_t value = 7;
+  EXPECT_TRUE(config.getUInt("missing", &value).isSuccess());
+  EXPECT_EQ(7, value);
+  EXPECT_TRUE(config.getUInt("plain", &value).isSuccess());
+  EXPECT_EQ(42, value);
+  EXPECT_TRUE(config.getUInt("max", &value).isSuccess());
+  EXPECT_TRUE(value == 18446744073709551615ULL);
+
+  value = 7;
+  for (const auto& key : std::vector<std::string>{
+      "overflow", "negative", "plus", "suffix", "space", "empty" }) {
+    EXPECT_TRUE(config.getUInt(key, &value).isError());
+  }
+
+  EXPECT_EQ(7, value);
+}
+
+TEST(Service, tickBudget) {
+  TempDir dir;
+  recorded_events.clear();
+
+  auto service = Service::createService(dir.path(), dir.path());
+  ASSERT_TRUE(service->loadPlugin(&recordingPluginInit).isSuccess());
+
+  /* the bulk event is due first and has a backlog of 100000 events, but may
+     only emit 100 per turn, so the small event is emitted in between */
+  std::vector<std::pair<std::string, std::string>> events = {
+    { "bulk", "100000" },
+    { "small", "1" }
+  };
+
+  for (const auto& e : events) {
+    EventConfig event;
+    event.event_name = e.first;
+    event.interval_micros = 100 * kMicrosPerMilli;
+    event.tick_budget_events = 100;
+    event.sources.emplace_back();
+    event.sources.back().plugin_name = "generator";
+    event.sources.back().properties.properties.emplace_back(
+        "batch_size",
+        std::vector<std::string>{ e.second });
+    ASSERT_TRUE(service->addEvent(&event).isSuccess());
+  }
+
+  TargetConfig target;
+  target.plugin_name = "recorder";
+  target.plugin_value = "recorder";
+  ASSERT_TRUE(service->addTarget(&target).isSuccess());
+
+  std::thread service_thread([&service] {
+    EXPECT_TRUE(service->run().isSuccess());
+  });
+
+  for (size_t i = 0; i < 500; ++i) {
+    {
+      std::unique_lock<std::mutex> lk(recorded_mutex);
+      if (recorded_events.size() > 100000) {
+        break;
+      }
+    }
+
+    usleep(10 * kMicrosPerMilli);
+  }
+
+  service->kill();
+  service_thread.join();
+  service.reset();
+
+  {
+    std::unique_lock<std::mutex> lk(recorded_mutex);
+    auto first_small = std::find(
+        recorded_events.begin(),
+        recorded_events.end(),
+        "small");
+
+    ASSERT_TRUE(recorded_events.size() > 100000);
+    EXPECT_TRUE(first_small - recorded_events.begin() < 100000);
+    EXPECT_EQ(0, (first_small - recorded_events.begin()) % 100);
+  }
+}
+
+TEST(Service, monitorThread) {
+  TempDir dir;
+  auto socket_path = dir.file("monitor.sock");
+  recorded_events.clear();
+
+  auto service = Service::createService(dir.path(), dir.path());
+  ASSERT_TRUE(service->loadPlugin(&recordingPluginInit).isSuccess());
+  ASSERT_TRUE(service->listenMonitor(socket_path).isSuccess());
+
+  EventConfig event;
+  event.event_name = "tick";
+  event.interval_micros = 10 * kMicrosPerMilli;
+  event.sources.emplace_back();
+  event.sources.back().plugin_name = "generator";
+  ASSERT_TRUE(service->addEvent(&event).isSuccess());
+
+  TargetConfig target;
+  target.plugin_name = "recorder";
+  target.plugin_value = "recorder";
+  ASSERT_TRUE(service->addTarget(&target).isSuccess());
+
+  std::thread service_thread([&service] {
+    EXPECT_TRUE(service->run().isSuccess());
+  });
+
+  /* a client that connects but never sends a request must not stop ticks */
+  int stuck_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  ASSERT_EQ(0, connect(stuck_fd, (struct sockaddr*) &addr, sizeof(addr)));
+
+  usleep(100 * kMicrosPerMilli);
+  size_t recorded_before;
+  {
+    std::unique_lock<std::mutex> lk(recorded_mutex);
+    recorded_before = recorded_events.size();
+  }
+
+  usleep(200 * kMicrosPerMilli);
+  {
+    std::unique_lock<std::mutex> lk(recorded_mutex);
+    EXPECT_TRUE(recorded_events.size() > recorded_before);
+  }
+
+  close(stuck_fd);
+
+  std::string response;
+  EXPECT_TRUE(
+      MonitorSocket::sendRequest(socket_path, "flush", &response).isSuccess());
+  EXPECT_EQ("ok\n", response);
+  EXPECT_TRUE(
+      MonitorSocket::sendRequest(socket_path, "pause event tick", &response)
+          .isSuccess());
+  EXPECT_EQ("ok\n", response);
+
+  service->kill();
+  service_thread.join();
+  service.reset();
+}
+
+static std::mutex retained_mutex;
+static std::vector<evcollect_event_t*> retained_events[2];
+static size_t retaining_targets;
+
+static int retainingOutputAttach(
+    evcollect_ctx_t* ctx,
+    const evcollect_plugin_cfg_t* cfg,
+    void** userdata) {
+  *userdata = &retained_events[retaining_targets++];
+  return 1;
+}
+
+static int retainingOutputEmitEvent(
+    evcollect_ctx_t* ctx,
+    void* userdata,
+    const evcollect_event_t* ev) {
+  std::unique_lock<std::mutex> lk(retained_mutex);
+  static_cast<std::vector<evcollect_event_t*>*>(userdata)->emplace_back(
+      evcollect_event_retain(ev));
+  return 1;
+}
+
+static bool retainingPluginInit(evcollect_ctx_t* ctx) {
+  evcollect_output_plugin_register(
+      ctx,
+      "retainer",
+      &retainingOutputEmitEvent,
+      &retainingOutputAttach,
+      nullptr,
+      nullptr,
+      nullptr);
+
+  return true;
+}
+
+TEST(Service, sharedEventPayload) {
+  TempDir dir;
+  retaining_targets = 0;
+
+  auto service = Service::createService(dir.path(), dir.path());
+  ASSERT_TRUE(service->loadPlugin(&retainingPluginInit).isSuccess());
+
+  EventConfig event;
+  event.event_name = "tick";
+  event.interval_micros = 10 * kMicrosPerMilli;
+  event.sources.emplace_back();
+  event.sources.back().plugin_name = "generator";
+  ASSERT_TRUE(service->addEvent(&event).isSuccess());
+
+  for (const auto& name : { "a", "b" }) {
+    TargetConfig target;
+    target.plugin_name = "retainer";
+    target.plugin_value = name;
+    ASSERT_TRUE(service->addTarget(&target).isSuccess());
+  }
+
+  std::thread service_thread([&service] {
+    EXPECT_TRUE(service->run().isSuccess());
+  });
+
+  for (size_t i = 0; i < 100; ++i) {
+    {
+      std::unique_lock<std::mutex> lk(retained_mutex);
+      if (!retained_events[0].empty() && !retained_events[1].empty()) {
+        break;
+      }
+    }
+
+    usleep(10 * kMicrosPerMilli);
+  }
+
+  service->kill();
+  service_thread.join();
+  service.reset();
+
+  ASSERT_FALSE(retained_events[0].empty());
+  ASSERT_FALSE(retained_events[1].empty());
+
+  /* both targets hold a reference to the same payload, which stays valid
+     until the last reference is released */
+  const char* data_a;
+  const char* data_b;
+  size_t size_a;
+  size_t size_b;
+  evcollect_event_getdata(retained_events[0][0], &data_a, &size_a);
+  evcollect_event_getdata(retained_events[1][0], &data_b, &size_b);
+  EXPECT_TRUE(data_a == data_b);
+  EXPECT_EQ(size_a, size_b);
+
+  std::string payload(data_b, size_b);
+  std::weak_ptr<const std::string> shared =
+      static_cast<EventData*>(retained_events[0][0])->event_data;
+
+  evcollect_event_release(retained_events[0][0]);
+  EXPECT_FALSE(shared.expired());
+  evcollect_event_getdata(retained_events[1][0], &data_b, &size_b);
+  EXPECT_EQ(payload, std::string(data_b, size_b));
+
+  evcollect_event_release(retained_events[1][0]);
+  EXPECT_TRUE(shared.expired());
+
+  for (auto& events : retained_events) {
+    for (size_t i = 1; i < events.size(); ++i) {
+      evcollect_event_release(events[i]);
+    }
+
+    events.clear();
+  }
+}
+
+static std::string readFrame(int fd) {
+  uint32_t len;
+  if (recv(fd, &len, sizeof(len), MSG_WAITALL) != sizeof(len)) {
+    return "<eof>";
+  }
+
+  std::string frame(ntohl(len), '\0');
+  if (recv(fd, &frame[0], frame.size(), MSG_WAITALL) != ssize_t(frame.size())) {
+    return "<eof>";
+  }
+
+  return frame;
+}
+
+TEST(StreamOutput, lengthFramingAndReconnect) {
+  auto socket_path = StringUtil::format(
+      "/tmp/evcollect_test_stream_$0.sock",
+      getpid());
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_TRUE(listen_fd >= 0);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socket_path.c_str());
+  ASSERT_EQ(0, bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, listen(listen_fd, 4));
+
+  PropertyList config;
+  config.properties.emplace_back(
+      "address",
+      std::vector<std::string>{ "unix://" + socket_path });
+  config.properties.emplace_back(
+      "framing",
+      std::vector<std::string>{ "length" });
+  config.properties.emplace_back(
+      "reconnect_backoff_min",
+      std::vector<std::string>{ "1" });
+
+  StreamOutputPlugin plugin;
+  void* userdata;
+  ASSERT_TRUE(plugin.pluginAttach(config, &userdata).isSuccess());
+
+  std::vector<EventData> events(2);
+  for (size_t i = 0; i < events.size(); ++i) {
+    events[i].time = i;
+    events[i].event_id = EventNameTable::get()->intern("test", &events[i].event_name);
+    events[i].event_data = std::make_shared<const std::string>(
+        StringUtil::format(R"({"n":$0})", i));
+  }
+
+  ASSERT_TRUE(plugin.pluginEmitEvents(userdata, events.data(), 2).isSuccess());
+
+  int conn_fd = accept(listen_fd, NULL, NULL);
+  ASSERT_TRUE(conn_fd >= 0);
+  EXPECT_EQ(R"({"time":0,"event":"test","data":{"n":0}})", readFrame(conn_fd));
+  EXPECT_EQ(R"({"time":1,"event":"test","data":{"n":1}})", readFrame(conn_fd));
+
+  /* the relay goes away; the next batch must go out on a new connection */
+  close(conn_fd);
+  ASSERT_TRUE(plugin.pluginEmitEvent(userdata, events[1]).isSuccess());
+
+  conn_fd = accept(listen_fd, NULL, NULL);
+  ASSERT_TRUE(conn_fd >= 0);
+  EXPECT_EQ(R"({"time":1,"event":"test","data":{"n":1}})", readFrame(conn_fd));
+
+  plugin.pluginDetach(userdata);
+  EXPECT_EQ("<eof>", readFrame(conn_fd));
+
+  close(conn_fd);
+  close(listen_fd);
+  unlink(socket_path.c_str());
+}
+
+TEST(TimeParser, formats) {
+  auto parse = [] (const std::string& format, const std::string& str) {
+    TimeParser parser;
+    EXPECT_TRUE(parser.compile(format).isSuccess());
+    uint64_t micros = 0;
+    if (!parser.parse(str.data(), str.size(), &micros)) {
+      return std::string("error");
+    }
+
+    return std::to_string(micros);
+  };
+
+  EXPECT_EQ("1471959420000000", parse("%F %T", "2016-08-23 13:37:00"));
+  EXPECT_EQ(
+      "1471952220000000",
+      parse("%d/%b/%Y:%H:%M:%S %z", "23/Aug/2016:13:37:00 +0200"));
+  EXPECT_EQ(
+      "1471959420123456",
+      parse("%Y-%m-%dT%H:%M:%S.%f%z", "2016-08-23T13:37:00.123456789Z"));
+  EXPECT_EQ(
+      "1471961220500000",
+      parse("%FT%T.%f%z", "2016-08-23T13:37:00.5-00:30"));
+  EXPECT_EQ("951782400000000", parse("%b %e %Y", "February 29  2000"));
+  EXPECT_EQ("1471959420000000", parse("%s", "1471959420"));
+  EXPECT_EQ("error", parse("%F %T", "2016-08-23 13:37:00 trailing"));
+  EXPECT_EQ("error", parse("%F %T", "2016-13-23 13:37:00"));
+  EXPECT_EQ("error", parse("%F", "1969-12-31"));
+
+  TimeParser parser;
+  EXPECT_FALSE(parser.compile("%Q").isSuccess());
+  EXPECT_FALSE(parser.compile("%T").isSuccess());
+}
+
+TEST(TimeParser, withoutYear) {
+  TimeParser parser;
+  ASSERT_TRUE(parser.compile("%b %e %T").isSuccess());
+
+  time_t now = WallClock::unixSeconds();
+  struct tm now_tm;
+  gmtime_r(&now, &now_tm);
+  int year = now_tm.tm_year + 1900;
+
+  auto parseYear = [&parser] (const std::string& str) {
+    uint64_t micros = 0;
+    if (!parser.parse(str.data(), str.size(), &micros)) {
+      return -1;
+    }
+
+    time_t t = micros / kMicrosPerSecond;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return tm.tm_year + 1900;
+  };
+
+  /* the start of the year is never in the future; the end of the year is
+     (except at the very end of the year), so it belongs to the previous
+     year */
+  EXPECT_EQ(year, parseYear("Jan  1 00:00:00"));
+  if (now_tm.tm_mon < 11 || now_tm.tm_mday < 30) {
+    EXPECT_EQ(year - 1, parseYear("Dec 31 23:59:59"));
+  }
+  EXPECT_EQ(-1, parseYear("Dec 31 2016 23:59:59"));
+}
+
+TEST(TimeParser, cachedPrefix) {
+  TimeParser parser;
+  ASSERT_TRUE(parser.compile("%d/%b/%Y:%H:%M:%S.%f %z").isSuccess());
+
+  auto parse = [&parser] (const std::string& str) {
+    uint64_t micros = 0;
+    if (!parser.parse(str.data(), str.size(), &micros)) {
+      return std::string("error");
+    }
+
+    return std::to_string(micros);
+  };
+
+  EXPECT_EQ("1471952220100000", parse("23/Aug/2016:13:37:00.1 +0200"));
+  EXPECT_EQ("1471959420200000", parse("23/Aug/2016:13:37:00.2 +0000"));
+  EXPECT_EQ("1471952221000000", parse("23/Aug/2016:13:37:01.0 +0200"));
+  EXPECT_EQ("error", parse("23/Aug/2016:13:37:01 +0200"));
+  EXPECT_EQ("1471952221300000", parse("23/Aug/2016:13:37:01.3 +0200"));
+
+  /* the cached prefix "...:1" is not a complete conversion here */
+  ASSERT_TRUE(parser.compile("%F %H:%M:%S").isSuccess());
+  EXPECT_EQ("3661000000", parse("1970-01-01 1:01:1"));
+  EXPECT_EQ("3672000000", parse("1970-01-01 1:01:12"));
+}
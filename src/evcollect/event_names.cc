@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <evcollect/event_names.h>
+
+namespace evcollect {
+
+EventNameTable* EventNameTable::get() {
+  static EventNameTable table;
+  return &table;
+}
+
+EventNameTable::EventNameTable() {
+  names_.emplace_back(); // kUnknownEventID
+}
+
+uint32_t EventNameTable::intern(
+    const char* name,
+    size_t name_len,
+    const std::string** name_ref /* = nullptr */) {
+  return intern(std::string(name, name_len), name_ref);
+}
+
+uint32_t EventNameTable::intern(
+    const std::string& name,
+    const std::string** name_ref /* = nullptr */) {
+  std::unique_lock<std::mutex> lk(mutex_);
+
+  uint32_t id;
+  auto iter = ids_.find(name);
+  if (iter == ids_.end()) {
+    id = names_.size();
+    names_.emplace_back(name);
+    ids_.emplace(name, id);
+  } else {
+    id = iter->second;
+  }
+
+  if (name_ref) {
+    *name_ref = &names_[id];
+  }
+
+  return id;
+}
+
+void EventNameTable::setEventName(
+    EventData* event,
+    const char* name,
+    size_t name_len) {
+  setEventName(event, std::string(name, name_len));
+}
+
+void EventNameTable::setEventName(EventData* event, const std::string& name) {
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto iter = ids_.find(name);
+    if (iter != ids_.end()) {
+      event->event_id = iter->second;
+      event->event_name = &names_[iter->second];
+      event->event_name_storage.reset();
+      return;
+    }
+  }
+
+  auto storage = std::make_shared<const std::string>(name);
+  event->event_id = kUnknownEventID;
+  event->event_name = storage.get();
+  event->event_name_storage = std::move(storage);
+}
+
+const std::string* EventNameTable::lookup(uint32_t id) const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (id < names_.size()) {
+    return &names_[id];
+  } else {
+    return nullptr;
+  }
+}
+
+uint32_t EventNameTable::size() const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  return names_.size();
+}
+
+} // namespace evcollect
+
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <evcollect/evcollect.h>
+
+namespace evcollect {
+
+/**
+ * Process-wide symbol table for event names. Names are interned once, when the
+ * event is configured, and are never freed. Events refer to their name by a
+ * small integer id and a pointer into this table, both of which stay valid for
+ * the lifetime of the process. Names set by plugins at runtime are not
+ * interned, see setEventName
+ */
+class EventNameTable {
+public:
+
+  /**
+   * The id of events that don't have a name
+   */
+  static const uint32_t kUnknownEventID = 0;
+
+  static EventNameTable* get();
+
+  EventNameTable();
+
+  /**
+   * Intern an event name and return its id. Interning the same name again
+   * returns the same id
+   *
+   * @param name_ref if not null, receives a pointer to the interned name
+   */
+  uint32_t intern(
+      const char* name,
+      size_t name_len,
+      const std::string** name_ref = nullptr);
+
+  uint32_t intern(
+      const std::string& name,
+      const std::string** name_ref = nullptr);
+
+  /**
+   * Set the name of an event at runtime. A name that was interned when the
+   * events were configured resolves to its id. Any other name is not interned,
+   * so that plugins that set dynamic names (e.g. per host) can't grow the
+   * table without bound; it is stored with the event under kUnknownEventID
+   */
+  void setEventName(EventData* event, const char* name, size_t name_len);
+
+  void setEventName(EventData* event, const std::string& name);
+
+  /**
+   * Return the interned name for an id or nullptr if the id is unknown
+   */
+  const std::string* lookup(uint32_t id) const;
+
+  /**
+   * Return the number of ids handed out so far; all ids are smaller than this
+   */
+  uint32_t size() const;
+
+protected:
+  mutable std::mutex mutex_;
+  std::deque<std::string> names_;
+  std::unordered_map<std::string, uint32_t> ids_;
+};
+
+} // namespace evcollect
+
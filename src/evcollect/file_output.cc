@@ -0,0 +1,504 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <evcollect/file_output.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace evcollect {
+
+namespace {
+
+const char kOpenSuffix[] = ".open";
+
+class Segment {
+public:
+
+  Segment(const std::string& path, bool compress);
+  ~Segment();
+
+  ReturnCode open();
+  ReturnCode write(const char* data, size_t size);
+  ReturnCode sync();
+
+  /**
+   * Flush, sync and close the segment and move it to its final name
+   */
+  ReturnCode close();
+
+  uint64_t getSize() const;
+
+protected:
+  std::string path_;
+  bool compress_;
+  int fd_;
+  uint64_t size_;
+#ifdef HAVE_ZLIB
+  gzFile gz_;
+#endif
+};
+
+struct FileTarget {
+  std::string directory;
+  std::string prefix;
+  uint64_t segment_size;
+  uint64_t segment_interval_micros;
+  uint64_t fsync_interval_micros;
+  uint64_t buffer_size;
+  bool compress;
+  std::unique_ptr<Segment> segment;
+  uint64_t segment_start;
+  uint64_t last_segment_time;
+  uint64_t last_fsync;
+  bool dirty;
+  std::string buffer;
+};
+
+Segment::Segment(
+    const std::string& path,
+    bool compress) :
+    path_(path),
+    compress_(compress),
+    fd_(-1),
+    size_(0) {
+#ifdef HAVE_ZLIB
+  gz_ = nullptr;
+#endif
+}
+
+Segment::~Segment() {
+  close();
+}
+
+ReturnCode Segment::open() {
+  auto open_path = path_ + kOpenSuffix;
+  fd_ = ::open(open_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "open('%s') failed: %s",
+        open_path.c_str(),
+        strerror(errno));
+  }
+
+#ifdef HAVE_ZLIB
+  if (compress_) {
+    gz_ = gzdopen(fd_, "wb");
+    if (!gz_) {
+      return ReturnCode::error(
+          "IOERR",
+          "gzdopen('%s') failed",
+          open_path.c_str());
+    }
+  }
+#endif
+
+  return ReturnCode::success();
+}
+
+ReturnCode Segment::write(const char* data, size_t size) {
+#ifdef HAVE_ZLIB
+  if (gz_) {
+    if (gzwrite(gz_, data, size) != int(size)) {
+      return ReturnCode::error("IOERR", "gzwrite('%s') failed", path_.c_str());
+    }
+
+    size_ += size;
+    return ReturnCode::success();
+  }
+#endif
+
+  for (size_t pos = 0; pos < size; ) {
+    auto rc = ::write(fd_, data + pos, size - pos);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return ReturnCode::error(
+          "IOERR",
+          "write('%s') failed: %s",
+          path_.c_str(),
+          strerror(errno));
+    }
+
+    pos += rc;
+  }
+
+  size_ += size;
+  return ReturnCode::success();
+}
+
+ReturnCode Segment::sync() {
+#ifdef HAVE_ZLIB
+  if (gz_ && gzflush(gz_, Z_SYNC_FLUSH) != Z_OK) {
+    return ReturnCode::error("IOERR", "gzflush('%s') failed", path_.c_str());
+  }
+#endif
+
+  if (fdatasync(fd_) < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "fdatasync('%s') failed: %s",
+        path_.c_str(),
+        strerror(errno));
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode Segment::close() {
+  if (fd_ < 0) {
+    return ReturnCode::success();
+  }
+
+  auto rc = ReturnCode::success();
+#ifdef HAVE_ZLIB
+  if (gz_) {
+    /* gzclose also closes the fd */
+    if (gzclose(gz_) != Z_OK) {
+      rc = ReturnCode::error("IOERR", "gzclose('%s') failed", path_.c_str());
+    }
+
+    gz_ = nullptr;
+    fd_ = ::open((path_ + kOpenSuffix).c_str(), O_WRONLY);
+  }
+#endif
+
+  if (fd_ >= 0) {
+    if (fdatasync(fd_) < 0 && rc.isSuccess()) {
+      rc = ReturnCode::error(
+          "IOERR",
+          "fdatasync('%s') failed: %s",
+          path_.c_str(),
+          strerror(errno));
+    }
+
+    ::close(fd_);
+  }
+
+  fd_ = -1;
+  if (rename((path_ + kOpenSuffix).c_str(), path_.c_str()) < 0 &&
+      rc.isSuccess()) {
+    rc = ReturnCode::error(
+        "IOERR",
+        "rename('%s') failed: %s",
+        path_.c_str(),
+        strerror(errno));
+  }
+
+  return rc;
+}
+
+uint64_t Segment::getSize() const {
+  return size_;
+}
+
+/**
+ * Segments that were still open when the process died are complete up to
+ * the last write; move them to their final name so they get shipped
+ */
+void recoverOpenSegments(const FileTarget* target) {
+  auto dir = opendir(target->directory.c_str());
+  if (!dir) {
+    return;
+  }
+
+  auto suffix_len = strlen(kOpenSuffix);
+  while (auto entry = readdir(dir)) {
+    std::string name(entry->d_name);
+    if (!StringUtil::beginsWith(name, target->prefix + ".") ||
+        !StringUtil::endsWith(name, kOpenSuffix)) {
+      continue;
+    }
+
+    auto path = target->directory + "/" + name;
+    auto final_path = path.substr(0, path.size() - suffix_len);
+    logWarning("Recovering incomplete segment $0", path);
+    if (rename(path.c_str(), final_path.c_str()) < 0) {
+      logWarning("rename('$0') failed", path);
+    }
+  }
+
+  closedir(dir);
+}
+
+ReturnCode openSegment(FileTarget* target, uint64_t now) {
+  /* segment names must be unique and sort in creation order */
+  auto segment_time = std::max(
+      WallClock::unixMicros(),
+      target->last_segment_time + 1);
+
+  auto path = StringUtil::format(
+      "$0/$1.$2.ndjson",
+      target->directory,
+      target->prefix,
+      segment_time);
+
+  if (target->compress) {
+    path += ".gz";
+  }
+
+  std::unique_ptr<Segment> segment(new Segment(path, target->compress));
+  auto rc = segment->open();
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  target->segment = std::move(segment);
+  target->segment_start = now;
+  target->last_segment_time = segment_time;
+  target->last_fsync = now;
+  return ReturnCode::success();
+}
+
+ReturnCode closeSegment(FileTarget* target) {
+  if (!target->segment) {
+    return ReturnCode::success();
+  }
+
+  auto rc = target->segment->close();
+  target->segment.reset();
+  target->dirty = false;
+  return rc;
+}
+
+ReturnCode writeBuffer(FileTarget* target) {
+  if (target->buffer.empty()) {
+    return ReturnCode::success();
+  }
+
+  auto now = MonotonicClock::now();
+  if (target->segment &&
+      (target->segment->getSize() >= target->segment_size ||
+       now - target->segment_start >= target->segment_interval_micros)) {
+    auto rc = closeSegment(target);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (!target->segment) {
+    auto rc = openSegment(target, now);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  auto rc = target->segment->write(
+      target->buffer.data(),
+      target->buffer.size());
+
+  if (!rc.isSuccess()) {
+    /* the delivery queue retries the whole batch, so drop what is buffered
+       and continue in a fresh segment */
+    target->buffer.clear();
+    closeSegment(target);
+    return rc;
+  }
+
+  target->buffer.clear();
+  target->dirty = true;
+  return ReturnCode::success();
+}
+
+ReturnCode syncSegment(FileTarget* target) {
+  if (!target->segment || !target->dirty) {
+    return ReturnCode::success();
+  }
+
+  auto rc = target->segment->sync();
+  if (rc.isSuccess()) {
+    target->dirty = false;
+    target->last_fsync = MonotonicClock::now();
+  }
+
+  return rc;
+}
+
+} // namespace
+
+void FileOutputPlugin::registerPlugin(PluginMap* plugin_map) {
+  plugin_map->registerOutputPlugin(
+      "file",
+      std::unique_ptr<OutputPlugin>(new FileOutputPlugin()));
+}
+
+ReturnCode FileOutputPlugin::pluginAttach(
+    const PropertyList& config,
+    void** userdata) {
+  std::unique_ptr<FileTarget> target(new FileTarget());
+  target->prefix = "events";
+  target->segment_size = kDefaultSegmentSize;
+  target->segment_start = 0;
+  target->last_segment_time = 0;
+  target->last_fsync = 0;
+  target->dirty = false;
+  target->compress = false;
+
+  if (!config.get("directory", &target->directory)) {
+    return ReturnCode::error("EINVAL", "file output needs a directory");
+  }
+
+  config.get("prefix", &target->prefix);
+
+  uint64_t segment_interval = kDefaultSegmentIntervalSecs;
+  uint64_t fsync_interval = kDefaultFsyncIntervalMillis;
+  uint64_t buffer_size = kDefaultBufferSize;
+
+  std::vector<std::pair<std::string, uint64_t*>> options = {
+    { "segment_size", &target->segment_size },
+    { "segment_interval", &segment_interval },
+    { "fsync_interval", &fsync_interval },
+    { "buffer_size", &buffer_size },
+  };
+
+  for (const auto& opt : options) {
+    auto rc = config.getUInt(opt.first, opt.second);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  target->segment_interval_micros = segment_interval * kMicrosPerSecond;
+  target->fsync_interval_micros = fsync_interval * kMicrosPerMilli;
+  target->buffer_size = buffer_size;
+  target->buffer.reserve(buffer_size);
+
+  std::string compress;
+  if (config.get("compress", &compress) && compress != "none") {
+    if (compress != "gzip") {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid compression '%s'; must be one of gzip, none",
+          compress.c_str());
+    }
+
+#ifdef HAVE_ZLIB
+    target->compress = true;
+#else
+    return ReturnCode::error(
+        "EINVAL",
+        "gzip compression is not supported (built without zlib)");
+#endif
+  }
+
+  struct stat st;
+  if (stat(target->directory.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+    return ReturnCode::error(
+        "EINVAL",
+        "not a directory: %s",
+        target->directory.c_str());
+  }
+
+  recoverOpenSegments(target.get());
+
+  *userdata = target.release();
+  return ReturnCode::success();
+}
+
+void FileOutputPlugin::pluginDetach(void* userdata) {
+  auto target = static_cast<FileTarget*>(userdata);
+
+  auto rc = writeBuffer(target);
+  if (rc.isSuccess()) {
+    rc = closeSegment(target);
+  }
+
+  if (!rc.isSuccess()) {
+    logError("error while closing segment: $0", rc.getMessage());
+  }
+
+  delete target;
+}
+
+ReturnCode FileOutputPlugin::pluginEmitEvent(
+    void* userdata,
+    const EventData& evdata) {
+  return pluginEmitEvents(userdata, &evdata, 1);
+}
+
+ReturnCode FileOutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  auto target = static_cast<FileTarget*>(userdata);
+
+  for (size_t i = 0; i < events_count; ++i) {
+    const auto& ev = events[i];
+
+    auto& buf = target->buffer;
+    buf += "{\"time\":";
+    buf += std::to_string(ev.time);
+    buf += ",\"event\":\"";
+    buf += StringUtil::jsonEscape(*ev.event_name);
+    buf += "\",\"data\":";
+    buf += *ev.event_data;
+    buf += "}\n";
+
+    if (buf.size() >= target->buffer_size) {
+      auto rc = writeBuffer(target);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+  }
+
+  auto rc = writeBuffer(target);
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  auto now = MonotonicClock::now();
+  if (now - target->last_fsync >= target->fsync_interval_micros) {
+    return syncSegment(target);
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode FileOutputPlugin::pluginFlush(void* userdata) {
+  auto target = static_cast<FileTarget*>(userdata);
+
+  auto rc = writeBuffer(target);
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  return syncSegment(target);
+}
+
+} // namespace evcollect
+
@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <evcollect/evcollect.h>
+#include <evcollect/plugin.h>
+
+namespace evcollect {
+
+/**
+ * Appends events as newline-delimited JSON to segment files in a local
+ * directory. Each line has the form
+ *
+ *   {"time":<micros>,"event":"<event name>","data":<event json>}
+ *
+ * The active segment is named <prefix>.<start micros>.ndjson.open and is
+ * renamed to <prefix>.<start micros>.ndjson (.gz if compressed) once it is
+ * complete, so a shipper only has to pick up files without the .open suffix.
+ *
+ * Events are collected in a userspace buffer and written once per delivered
+ * batch (or whenever the buffer is full); fsync is issued at most every
+ * fsync_interval. Rotation is checked whenever events are written.
+ *
+ * Options:
+ *   directory         directory for segment files (required)
+ *   prefix            segment file name prefix (default "events")
+ *   segment_size      rotate after this many bytes (default 64MB)
+ *   segment_interval  rotate after this many seconds (default 3600)
+ *   fsync_interval    milliseconds between fsyncs, 0 = every batch
+ *                     (default 1000)
+ *   buffer_size       size of the write buffer in bytes (default 1MB)
+ *   compress          "gzip" or "none" (default none; needs zlib)
+ */
+class FileOutputPlugin : public OutputPlugin {
+public:
+
+  static void registerPlugin(PluginMap* plugin_map);
+
+  static const uint64_t kDefaultSegmentSize = 64 * 1024 * 1024;
+  static const uint64_t kDefaultSegmentIntervalSecs = 3600;
+  static const uint64_t kDefaultFsyncIntervalMillis = 1000;
+  static const uint64_t kDefaultBufferSize = 1024 * 1024;
+
+  ReturnCode pluginAttach(
+      const PropertyList& config,
+      void** userdata) override;
+
+  void pluginDetach(
+      void* userdata) override;
+
+  ReturnCode pluginEmitEvent(
+      void* userdata,
+      const EventData& evdata) override;
+
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override;
+
+  ReturnCode pluginFlush(
+      void* userdata) override;
+
+};
+
+} // namespace evcollect
+
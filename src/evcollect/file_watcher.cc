@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/inotify.h>
+#include <evcollect/file_watcher.h>
+#include <evcollect/util/logging.h>
+
+namespace evcollect {
+
+namespace {
+
+const uint32_t kWatchMask =
+    IN_CREATE | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_CLOSE_WRITE | IN_ONLYDIR;
+
+} // namespace
+
+FileWatcher::FileWatcher() : fd_(-1) {}
+
+FileWatcher::~FileWatcher() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+ReturnCode FileWatcher::init() {
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "inotify_init1() failed: %s",
+        strerror(errno));
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode FileWatcher::watchDirectory(
+    const std::string& dir,
+    Listener* listener) {
+  auto iter = watch_ids_.find(dir);
+  if (iter != watch_ids_.end()) {
+    auto& listeners = watches_[iter->second].listeners;
+    if (std::find(listeners.begin(), listeners.end(), listener) ==
+        listeners.end()) {
+      listeners.emplace_back(listener);
+    }
+
+    return ReturnCode::success();
+  }
+
+  /* listeners are called with the canonical path so that they can match
+     events no matter how the directory was spelled when it was watched */
+  char real_dir[PATH_MAX];
+  if (!realpath(dir.c_str(), real_dir)) {
+    return ReturnCode::error(
+        "IOERR",
+        "realpath('%s') failed: %s",
+        dir.c_str(),
+        strerror(errno));
+  }
+
+  int wd = inotify_add_watch(fd_, real_dir, kWatchMask);
+  if (wd < 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "inotify_add_watch('%s') failed: %s",
+        dir.c_str(),
+        strerror(errno));
+  }
+
+  /* the kernel returns the existing watch id for a path that is already
+     watched under a different name */
+  auto& watch = watches_[wd];
+  if (watch.dir.empty()) {
+    watch.dir = real_dir;
+  }
+
+  if (std::find(watch.listeners.begin(), watch.listeners.end(), listener) ==
+      watch.listeners.end()) {
+    watch.listeners.emplace_back(listener);
+  }
+
+  watch_ids_[dir] = wd;
+  return ReturnCode::success();
+}
+
+void FileWatcher::unwatchDirectory(
+    const std::string& dir,
+    Listener* listener) {
+  auto iter = watch_ids_.find(dir);
+  if (iter == watch_ids_.end()) {
+    return;
+  }
+
+  auto wd = iter->second;
+  auto& listeners = watches_[wd].listeners;
+  listeners.erase(
+      std::remove(listeners.begin(), listeners.end(), listener),
+      listeners.end());
+
+  if (listeners.empty()) {
+    inotify_rm_watch(fd_, wd);
+    watches_.erase(wd);
+    for (auto i = watch_ids_.begin(); i != watch_ids_.end(); ) {
+      if (i->second == wd) {
+        i = watch_ids_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+}
+
+void FileWatcher::poll() {
+  if (fd_ < 0) {
+    return;
+  }
+
+  char buf[16384]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  for (;;) {
+    auto len = read(fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      return;
+    }
+
+    for (char* ptr = buf; ptr < buf + len; ) {
+      auto ev = reinterpret_cast<const struct inotify_event*>(ptr);
+      ptr += sizeof(struct inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        logWarning("inotify queue overflow, rescanning all watched files");
+        std::vector<Listener*> all;
+        for (const auto& w : watches_) {
+          for (auto l : w.second.listeners) {
+            if (std::find(all.begin(), all.end(), l) == all.end()) {
+              all.emplace_back(l);
+            }
+          }
+        }
+
+        for (auto l : all) {
+          l->onOverflow();
+        }
+
+        continue;
+      }
+
+      auto iter = watches_.find(ev->wd);
+      if (iter == watches_.end()) {
+        continue;
+      }
+
+      /* the directory itself is gone; the kernel removed the watch */
+      if (ev->mask & IN_IGNORED) {
+        for (auto i = watch_ids_.begin(); i != watch_ids_.end(); ) {
+          if (i->second == ev->wd) {
+            i = watch_ids_.erase(i);
+          } else {
+            ++i;
+          }
+        }
+
+        watches_.erase(iter);
+        continue;
+      }
+
+      if (ev->len == 0) {
+        continue;
+      }
+
+      /* copy, the listeners may add or remove watches */
+      auto dir = iter->second.dir;
+      auto listeners = iter->second.listeners;
+      std::string name(ev->name);
+      for (auto l : listeners) {
+        l->onFileEvent(dir, name, ev->mask);
+      }
+    }
+  }
+}
+
+} // namespace evcollect
+
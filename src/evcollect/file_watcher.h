@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <evcollect/util/return_code.h>
+
+namespace evcollect {
+
+/**
+ * Watches directories for changes using a single inotify instance that is
+ * shared by all listeners. Watching the same directory from multiple
+ * listeners only adds one kernel watch. Events are only delivered from poll()
+ * so all callbacks run on the caller's thread
+ */
+class FileWatcher {
+public:
+
+  class Listener {
+  public:
+    virtual ~Listener() = default;
+
+    /**
+     * Called for each change (IN_CREATE, IN_MODIFY, IN_DELETE, ...) of a file
+     * in a watched directory. dir is the canonical (realpath) directory, not
+     * necessarily the path that was passed to watchDirectory
+     */
+    virtual void onFileEvent(
+        const std::string& dir,
+        const std::string& name,
+        uint32_t mask) = 0;
+
+    /**
+     * Called if events were lost because the kernel queue overflowed
+     */
+    virtual void onOverflow() = 0;
+  };
+
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(const FileWatcher& o) = delete;
+  FileWatcher& operator=(const FileWatcher& o) = delete;
+
+  ReturnCode init();
+
+  ReturnCode watchDirectory(const std::string& dir, Listener* listener);
+  void unwatchDirectory(const std::string& dir, Listener* listener);
+
+  /**
+   * Read all pending events without blocking and dispatch them
+   */
+  void poll();
+
+protected:
+
+  struct Watch {
+    std::string dir;
+    std::vector<Listener*> listeners;
+  };
+
+  int fd_;
+  std::unordered_map<int, Watch> watches_;
+  std::unordered_map<std::string, int> watch_ids_;
+};
+
+} // namespace evcollect
+
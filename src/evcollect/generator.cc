@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <algorithm>
+#include <evcollect/generator.h>
+#include <evcollect/util/msgpack.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+struct Generator {
+  std::vector<std::string> templates;
+  EventEncoding encoding;
+  uint64_t rate;
+  uint64_t batch_size;
+  uint64_t start_time;
+  uint64_t scheduled;
+  uint64_t generated;
+  uint64_t pending;
+  uint64_t rng;
+};
+
+/* xorshift64 */
+uint64_t nextRandom(uint64_t* state) {
+  auto x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+std::string makeTemplate(
+    uint64_t* rng,
+    uint64_t fields,
+    uint64_t cardinality,
+    uint64_t event_size,
+    uint64_t nesting) {
+  std::string json;
+  for (uint64_t i = 0; i < nesting; ++i) {
+    json += StringUtil::format(R"({"level$0":)", i);
+  }
+
+  json += "{";
+  for (uint64_t i = 0; i < fields; ++i) {
+    auto value = nextRandom(rng) % std::max(cardinality, uint64_t(1));
+    if (i > 0) {
+      json += ",";
+    }
+
+    /* alternate between string and numeric fields */
+    if (i % 2 == 0) {
+      json += StringUtil::format(R"("field$0":"value$1")", i, value);
+    } else {
+      json += StringUtil::format(R"("field$0":$1)", i, value);
+    }
+  }
+
+  json += "}";
+  for (uint64_t i = 0; i < nesting; ++i) {
+    json += "}";
+  }
+
+  /* pad the outermost object up to the requested size */
+  static const char kPaddingPrefix[] = R"(,"padding":"")";
+  auto size = json.size() + sizeof(kPaddingPrefix) - 1;
+  if (size < event_size) {
+    json.pop_back();
+    json += R"(,"padding":")";
+    json += std::string(event_size - size, 'x');
+    json += "\"}";
+  }
+
+  return json;
+}
+
+void appendMsgPackFields(
+    MsgPackWriter* writer,
+    uint64_t* rng,
+    uint64_t fields,
+    uint64_t cardinality,
+    uint64_t nesting,
+    uint64_t level,
+    uint64_t padding) {
+  auto entries = level < nesting ? 1 : fields;
+  writer->appendMap(entries + (padding > 0 ? 1 : 0));
+
+  if (level < nesting) {
+    writer->appendString(StringUtil::format("level$0", level));
+    appendMsgPackFields(writer, rng, fields, cardinality, nesting, level + 1, 0);
+  } else {
+    for (uint64_t i = 0; i < fields; ++i) {
+      auto value = nextRandom(rng) % std::max(cardinality, uint64_t(1));
+      writer->appendString(StringUtil::format("field$0", i));
+
+      if (i % 2 == 0) {
+        writer->appendString(StringUtil::format("value$0", value));
+      } else {
+        writer->appendUInt(value);
+      }
+    }
+  }
+
+  if (padding > 0) {
+    writer->appendString("padding");
+    writer->appendString(std::string(padding, 'x'));
+  }
+}
+
+/**
+ * Same shape as makeTemplate, but MessagePack encoded. The padding is grown
+ * until the event reaches the requested size since the size of the headers
+ * depends on the padding length
+ */
+std::string makeMsgPackTemplate(
+    uint64_t* rng,
+    uint64_t fields,
+    uint64_t cardinality,
+    uint64_t event_size,
+    uint64_t nesting) {
+  auto rng_state = *rng;
+  uint64_t padding = 0;
+  for (;;) {
+    *rng = rng_state;
+    std::string msgpack;
+    MsgPackWriter writer(&msgpack);
+    appendMsgPackFields(&writer, rng, fields, cardinality, nesting, 0, padding);
+    if (msgpack.size() >= event_size) {
+      return msgpack;
+    }
+
+    padding += std::max(event_size - msgpack.size(), uint64_t(1));
+  }
+}
+
+} // namespace
+
+void GeneratorSourcePlugin::registerPlugin(PluginMap* plugin_map) {
+  plugin_map->registerSourcePlugin(
+      "generator",
+      std::unique_ptr<SourcePlugin>(new GeneratorSourcePlugin()));
+}
+
+ReturnCode GeneratorSourcePlugin::pluginAttach(
+    const PropertyList& config,
+    void** userdata) {
+  uint64_t rate = 0;
+  uint64_t batch_size = kDefaultBatchSize;
+  uint64_t fields = kDefaultFields;
+  uint64_t cardinality = kDefaultCardinality;
+  uint64_t event_size = kDefaultEventSize;
+  uint64_t nesting = 0;
+  uint64_t templates = kDefaultTemplates;
+
+  std::string encoding;
+  EventEncoding event_encoding = EventEncoding::JSON;
+  if (config.get("encoding", &encoding)) {
+    if (encoding == "msgpack") {
+      event_encoding = EventEncoding::MSGPACK;
+    } else if (encoding != "json") {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid encoding '%s'; must be one of json, msgpack",
+          encoding.c_str());
+    }
+  }
+
+  std::vector<std::pair<std::string, uint64_t*>> options = {
+    { "rate", &rate },
+    { "batch_size", &batch_size },
+    { "fields", &fields },
+    { "cardinality", &cardinality },
+    { "event_size", &event_size },
+    { "nesting", &nesting },
+    { "templates", &templates },
+  };
+
+  for (const auto& opt : options) {
+    auto rc = config.getUInt(opt.first, opt.second);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (templates == 0 || templates > kMaxTemplates) {
+    return ReturnCode::error(
+        "EINVAL",
+        "templates must be between 1 and %llu",
+        (unsigned long long) kMaxTemplates);
+  }
+
+  std::unique_ptr<Generator> generator(new Generator());
+  generator->encoding = event_encoding;
+  generator->rate = rate;
+  generator->batch_size = std::max(batch_size, uint64_t(1));
+  generator->start_time = 0;
+  generator->scheduled = 0;
+  generator->generated = 0;
+  generator->pending = 0;
+  generator->rng = 0x9e3779b97f4a7c15;
+
+  generator->templates.reserve(templates);
+  for (uint64_t i = 0; i < templates; ++i) {
+    auto make = event_encoding == EventEncoding::MSGPACK ?
+        &makeMsgPackTemplate :
+        &makeTemplate;
+
+    generator->templates.emplace_back(
+        make(
+            &generator->rng,
+            fields,
+            cardinality,
+            event_size,
+            nesting));
+  }
+
+  *userdata = generator.release();
+  return ReturnCode::success();
+}
+
+void GeneratorSourcePlugin::pluginDetach(void* userdata) {
+  delete static_cast<Generator*>(userdata);
+}
+
+ReturnCode GeneratorSourcePlugin::pluginGetNextEvent(
+    void* userdata,
+    std::string* event_json) {
+  auto generator = static_cast<Generator*>(userdata);
+
+  /* start a new batch: everything we owe according to the rate, but at most
+     one second worth of events so a stall does not cause an unbounded burst */
+  if (generator->pending == 0) {
+    if (generator->rate == 0) {
+      generator->pending = generator->batch_size;
+    } else {
+      auto now = MonotonicClock::now();
+      if (generator->start_time == 0) {
+        generator->start_time = now;
+      }
+
+      uint64_t owed =
+          double(now - generator->start_time) * generator->rate /
+          kMicrosPerSecond;
+
+      if (owed > generator->scheduled + generator->rate) {
+        generator->scheduled = owed - generator->rate;
+      }
+
+      generator->pending = owed - std::min(owed, generator->scheduled);
+      generator->scheduled = std::max(owed, generator->scheduled);
+    }
+
+    if (generator->pending == 0) {
+      return ReturnCode::success();
+    }
+  }
+
+  const auto& tpl = generator->templates[
+      nextRandom(&generator->rng) % generator->templates.size()];
+
+  event_json->assign(tpl);
+  --generator->pending;
+  ++generator->generated;
+  return ReturnCode::success();
+}
+
+EventEncoding GeneratorSourcePlugin::pluginGetEncoding(void* userdata) {
+  return static_cast<Generator*>(userdata)->encoding;
+}
+
+bool GeneratorSourcePlugin::pluginHasPendingEvent(void* userdata) {
+  return static_cast<Generator*>(userdata)->pending > 0;
+}
+
+void GeneratorSourcePlugin::pluginGetStats(
+    void* userdata,
+    PluginStats* stats) {
+  auto generator = static_cast<Generator*>(userdata);
+  stats->emplace_back("generated_events", generator->generated);
+  stats->emplace_back("templates", generator->templates.size());
+}
+
+} // namespace evcollect
+
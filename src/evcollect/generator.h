@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <evcollect/evcollect.h>
+#include <evcollect/plugin.h>
+
+namespace evcollect {
+
+/**
+ * Produces synthetic events for load testing. All events are pre-generated
+ * when the source is attached, so producing an event is a single copy.
+ *
+ * Options:
+ *   rate         events per second, 0 = as fast as possible (default)
+ *   batch_size   events per tick if rate is 0 (default 1000)
+ *   fields       number of fields per event (default 8)
+ *   cardinality  distinct values per field (default 100)
+ *   event_size   minimum size of an event in bytes, reached by adding a
+ *                padding field (default 256)
+ *   nesting      depth at which the fields are nested (default 0 = flat)
+ *   templates    number of distinct events to pre-generate (default 1024),
+ *                which also caps the effective cardinality
+ *   encoding     "json" (default) or "msgpack"
+ */
+class GeneratorSourcePlugin : public SourcePlugin {
+public:
+
+  static void registerPlugin(PluginMap* plugin_map);
+
+  static const uint64_t kDefaultBatchSize = 1000;
+  static const uint64_t kDefaultFields = 8;
+  static const uint64_t kDefaultCardinality = 100;
+  static const uint64_t kDefaultEventSize = 256;
+  static const uint64_t kDefaultTemplates = 1024;
+  static const uint64_t kMaxTemplates = 1 << 20;
+
+  ReturnCode pluginAttach(
+      const PropertyList& config,
+      void** userdata) override;
+
+  void pluginDetach(
+      void* userdata) override;
+
+  ReturnCode pluginGetNextEvent(
+      void* userdata,
+      std::string* event_json) override;
+
+  bool pluginHasPendingEvent(
+      void* userdata) override;
+
+  void pluginGetStats(
+      void* userdata,
+      PluginStats* stats) override;
+
+  EventEncoding pluginGetEncoding(
+      void* userdata) override;
+
+};
+
+} // namespace evcollect
+
@@ -23,19 +23,40 @@
  */
 #include <netdb.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/inotify.h>
 #include <sys/fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
 #include <unistd.h>
 #include <evcollect/util/stringutil.h>
+#include <evcollect/util/jsonutil.h>
 #include <evcollect/util/time.h>
 #include <evcollect/util/logging.h>
 #include <evcollect/util/sha1.h>
+#include <evcollect/util/crc32.h>
+#include <evcollect/util/time_parser.h>
 #include <evcollect/logfile.h>
+#include <evcollect/checkpoint_store.h>
+#include <evcollect/file_watcher.h>
 #include <evcollect/plugin.h>
 #include <pcre.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace evcollect {
 
@@ -45,67 +66,601 @@ void LogfileSourcePlugin::registerPlugin(PluginMap* plugin_map) {
       std::unique_ptr<SourcePlugin>(new LogfileSourcePlugin()));
 }
 
-class LogfileSource {
+namespace {
+
+ReturnCode compileRegex(const std::string& regex, pcre** handle) {
+  const char* error_msg = "";
+  int error_pos = 0;
+
+  *handle = pcre_compile(regex.c_str(), 0, &error_msg, &error_pos, 0);
+  if (!*handle) {
+    return ReturnCode::error("REGEX_ERROR", "invalid regex: %s", error_msg);
+  }
+
+  return ReturnCode::success();
+}
+
+bool matchRegex(pcre* handle, const char* data, size_t size) {
+  return pcre_exec(handle, 0, data, size, 0, 0, nullptr, 0) >= 0;
+}
+
+void appendUInt(uint64_t value, std::string* out) {
+  char buf[24];
+  char* p = buf + sizeof(buf);
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  out->append(p, buf + sizeof(buf) - p);
+}
+
+/* [+-]?[0-9]+ within the int64 range; written without leading zeros */
+bool appendJSONInt(const char* data, size_t size, std::string* out) {
+  const char* cur = data;
+  const char* end = data + size;
+  bool negative = false;
+  if (cur < end && (*cur == '-' || *cur == '+')) {
+    negative = *cur == '-';
+    ++cur;
+  }
+
+  if (cur == end) {
+    return false;
+  }
+
+  uint64_t limit = negative ? (1ull << 63) : (1ull << 63) - 1;
+  uint64_t value = 0;
+  for (; cur < end; ++cur) {
+    if (*cur < '0' || *cur > '9') {
+      return false;
+    }
+
+    uint64_t digit = *cur - '0';
+    if (value > (limit - digit) / 10) {
+      return false;
+    }
+
+    value = value * 10 + digit;
+  }
+
+  if (negative && value > 0) {
+    *out += '-';
+  }
+
+  appendUInt(value, out);
+  return true;
+}
+
+/* numbers that are valid JSON already are copied verbatim, others (e.g.
+   "+1", ".5" or "1.") go through strtod */
+bool appendJSONFloat(const char* data, size_t size, std::string* out) {
+  const char* cur = data;
+  const char* end = data + size;
+  auto digits = [&cur, end] () {
+    auto begin = cur;
+    while (cur < end && *cur >= '0' && *cur <= '9') {
+      ++cur;
+    }
+
+    return cur - begin;
+  };
+
+  if (cur < end && *cur == '-') {
+    ++cur;
+  }
+
+  bool valid = cur < end && (*cur == '0' ? (++cur, true) : digits() > 0);
+  if (valid && cur < end && *cur == '.') {
+    ++cur;
+    valid = digits() > 0;
+  }
+
+  if (valid && cur < end && (*cur == 'e' || *cur == 'E')) {
+    ++cur;
+    if (cur < end && (*cur == '+' || *cur == '-')) {
+      ++cur;
+    }
+
+    valid = digits() > 0;
+  }
+
+  if (valid && cur == end) {
+    out->append(data, size);
+    return true;
+  }
+
+  char buf[64];
+  if (size == 0 || size >= sizeof(buf)) {
+    return false;
+  }
+
+  memcpy(buf, data, size);
+  buf[size] = 0;
+
+  char* num_end;
+  double value = strtod(buf, &num_end);
+  if (num_end != buf + size || !std::isfinite(value)) {
+    return false;
+  }
+
+  int len = snprintf(buf, sizeof(buf), "%.17g", value);
+  out->append(buf, len);
+  return true;
+}
+
+/* strings without characters that need escaping are copied as they are */
+void appendJSONString(const char* data, size_t size, std::string* out) {
+  for (size_t i = 0; i < size; ++i) {
+    auto c = (unsigned char) data[i];
+    if (c < 0x20 || c == '"' || c == '\\' || c >= 0x7f) {
+      *out += '"';
+      *out += StringUtil::jsonEscape(std::string(data, size));
+      *out += '"';
+      return;
+    }
+  }
+
+  *out += '"';
+  out->append(data, size);
+  *out += '"';
+}
+
+inline bool isBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+bool appendJSONBool(const char* data, size_t size, std::string* out) {
+  static const char* const kTrue[] = { "true", "yes", "on", "1" };
+  static const char* const kFalse[] = { "false", "no", "off", "0" };
+
+  for (size_t i = 0; i < 4; ++i) {
+    if (strlen(kTrue[i]) == size && strncasecmp(data, kTrue[i], size) == 0) {
+      out->append("true");
+      return true;
+    }
+
+    if (strlen(kFalse[i]) == size && strncasecmp(data, kFalse[i], size) == 0) {
+      out->append("false");
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace
+
+/**
+ * Multiline records: a line that matches the continue regex (or, if only a
+ * start regex is set, a line that does not match the start regex) is appended
+ * to the previous record instead of starting a new one
+ */
+struct MultilineConfig {
+  static const uint64_t kDefaultMaxLines = 500;
+  static const uint64_t kDefaultTimeoutMillis = 1000;
+
+  MultilineConfig() :
+      max_lines(kDefaultMaxLines),
+      timeout_millis(kDefaultTimeoutMillis) {}
+
+  bool isEnabled() const {
+    return !start_regex.empty() || !continue_regex.empty();
+  }
+
+  std::string start_regex;
+  std::string continue_regex;
+  uint64_t max_lines;
+  uint64_t timeout_millis;
+};
+
+/**
+ * The type a field captured by the regex is converted to, written as
+ * <field>:<type>[:<format>]. Fields without a type are emitted as strings
+ */
+struct FieldType {
+  enum Kind { STRING, INT, FLOAT, BOOL, TIMESTAMP };
+
+  static ReturnCode parse(const std::string& spec, FieldType* type) {
+    auto sep = spec.find(':');
+    if (sep == std::string::npos || sep == 0) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid field_type, expected <field>:<type>: %s",
+          spec.c_str());
+    }
+
+    type->field = spec.substr(0, sep);
+    auto kind = spec.substr(sep + 1);
+    auto format_sep = kind.find(':');
+    if (format_sep != std::string::npos) {
+      type->format = kind.substr(format_sep + 1);
+      kind.erase(format_sep);
+    }
+
+    if (kind == "string") {
+      type->kind = STRING;
+    } else if (kind == "int") {
+      type->kind = INT;
+    } else if (kind == "float") {
+      type->kind = FLOAT;
+    } else if (kind == "bool") {
+      type->kind = BOOL;
+    } else if (kind == "timestamp") {
+      type->kind = TIMESTAMP;
+      TimeParser parser;
+      auto rc = parser.compile(type->format);
+      if (!rc.isSuccess() || type->format.empty()) {
+        return ReturnCode::error(
+            "EINVAL",
+            "invalid timestamp format for field %s: %s",
+            type->field.c_str(),
+            type->format.c_str());
+      }
+    } else {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid type for field %s: %s",
+          type->field.c_str(),
+          kind.c_str());
+    }
+
+    return ReturnCode::success();
+  }
+
+  std::string field;
+  Kind kind;
+  std::string format;
+};
+
+/**
+ * How lines are split into fields: by a regex with named capture groups, at
+ * a delimiter into named columns or into key=value pairs. Without a format
+ * the line is wrapped as { "data": <line> }; with the json format lines that
+ * are valid JSON objects are passed through as they are and invalid lines are
+ * wrapped or dropped depending on json_fallback
+ */
+struct FormatConfig {
+  enum Format { RAW, REGEX, DELIMITER, KV, JSON };
+  enum JSONFallback { WRAP, DROP };
+
+  FormatConfig() :
+      format(RAW),
+      delimiter('\t'),
+      kv_separator('='),
+      json_fallback(WRAP) {}
+
+  static ReturnCode parse(const PropertyList& config, FormatConfig* format) {
+    std::string name;
+    config.get("format", &name);
+    config.get("regex", &format->regex);
+
+    if (name.empty()) {
+      format->format = format->regex.empty() ? RAW : REGEX;
+    } else if (name == "regex") {
+      format->format = REGEX;
+    } else if (name == "delimiter") {
+      format->format = DELIMITER;
+    } else if (name == "kv") {
+      format->format = KV;
+    } else if (name == "json") {
+      format->format = JSON;
+    } else {
+      return ReturnCode::error(
+          "EINVAL",
+          "logfile: invalid format: %s",
+          name.c_str());
+    }
+
+    if ((format->format == REGEX) == format->regex.empty()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "logfile: a regex needs format regex and vice versa");
+    }
+
+    std::string delimiter;
+    if (config.get("delimiter", &delimiter)) {
+      if (delimiter == "tab" || delimiter == "\\t") {
+        format->delimiter = '\t';
+      } else if (delimiter == "space") {
+        format->delimiter = ' ';
+      } else if (delimiter.size() == 1) {
+        format->delimiter = delimiter[0];
+      } else {
+        return ReturnCode::error(
+            "EINVAL",
+            "logfile: the delimiter must be a single character: %s",
+            delimiter.c_str());
+      }
+    }
+
+    std::string columns;
+    if (config.get("fields", &columns)) {
+      format->columns = StringUtil::split(columns, ",");
+    }
+
+    if (format->format == DELIMITER && format->columns.empty()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "logfile: format delimiter needs a list of fields");
+    }
+
+    std::string kv_separator;
+    if (config.get("kv_separator", &kv_separator)) {
+      if (kv_separator.size() != 1) {
+        return ReturnCode::error(
+            "EINVAL",
+            "logfile: kv_separator must be a single character: %s",
+            kv_separator.c_str());
+      }
+
+      format->kv_separator = kv_separator[0];
+    }
+
+    std::string json_fallback;
+    if (config.get("json_fallback", &json_fallback)) {
+      if (json_fallback == "wrap") {
+        format->json_fallback = WRAP;
+      } else if (json_fallback == "drop") {
+        format->json_fallback = DROP;
+      } else {
+        return ReturnCode::error(
+            "EINVAL",
+            "logfile: invalid json_fallback, expected wrap or drop: %s",
+            json_fallback.c_str());
+      }
+    }
+
+    return ReturnCode::success();
+  }
+
+  Format format;
+  std::string regex;
+  char delimiter;
+  std::vector<std::string> columns;
+  char kv_separator;
+  JSONFallback json_fallback;
+};
+
+class LogfileReader {
+public:
+  virtual ~LogfileReader() = default;
+  virtual bool hasNextLine() = 0;
+  virtual ReturnCode getNextEvent(std::string* event_json) = 0;
+  virtual bool getEventTime(uint64_t* time) const = 0;
+  virtual void markPosition(uint64_t sequence) = 0;
+  virtual void acknowledge(uint64_t sequence) = 0;
+  virtual void updateCheckpoint() = 0;
+  virtual void getStats(PluginStats* stats) = 0;
+};
+
+class LogfileSource : public LogfileReader {
 public:
 
   LogfileSource(
       const std::string& filename,
-      const std::string& spool_dir);
+      const std::string& spool_dir,
+      CheckpointStore* checkpoints);
 
   ~LogfileSource();
 
-  ReturnCode setRegex(const std::string& regex);
+  ReturnCode setFormat(const FormatConfig& config);
+  ReturnCode setFieldTypes(const std::vector<FieldType>& types);
+  ReturnCode setTimeField(const std::string& field, const std::string& format);
+  ReturnCode setMultiline(const MultilineConfig& config);
 
-  bool hasNextLine();
+  bool hasNextLine() override;
   ReturnCode getNextLine(std::string* line);
-  ReturnCode getNextEvent(std::string* event_json);
+  ReturnCode getNextEvent(std::string* event_json) override;
+  bool getEventTime(uint64_t* time) const override;
+
+  void markPosition(uint64_t sequence) override;
+  void acknowledge(uint64_t sequence) override;
+  bool hasPendingMarks() const;
 
   ReturnCode readCheckpoint();
-  ReturnCode writeCheckpoint();
+  void updateCheckpoint() override;
+  void removeCheckpoint();
+
+  void getStats(PluginStats* stats) override;
 
 protected:
+
+  /* once this many marks are unacknowledged the oldest ones are discarded;
+     that only delays checkpoints, it never moves them past unacked events */
+  static const size_t kMaxPendingMarks = 1024;
+
+  static const size_t kNoField = (size_t) -1;
+
+  /* number of bytes at the start of a file that are hashed to recognize it
+     after it was rotated (and possibly compressed) */
+  static const size_t kFingerprintSize = 1024;
+
+  struct Mark {
+    uint64_t sequence;
+    CheckpointStore::Checkpoint position;
+  };
+
+  struct FieldConversion {
+    FieldType::Kind kind = FieldType::STRING;
+    std::unique_ptr<TimeParser> time_parser;
+  };
+
   std::string filename_;
-  std::string checkpoint_filename_;
+  SHA1Hash checkpoint_key_;
+  std::string legacy_checkpoint_filename_;
+  CheckpointStore* checkpoints_;
+  FormatConfig::Format format_;
+  char delimiter_;
+  char kv_separator_;
+  FormatConfig::JSONFallback json_fallback_;
+  uint64_t invalid_json_lines_;
+  uint64_t dropped_lines_;
   pcre* pcre_handle_;
-  std::vector<std::string> pcre_fields_;
+  std::vector<std::string> fields_;
+  std::vector<FieldConversion> field_types_;
+  size_t time_field_;
+  TimeParser time_parser_;
+  bool has_event_time_;
+  uint64_t event_time_;
   uint64_t inode_;
   uint64_t offset_;
   uint64_t consumed_offset_;
-  uint64_t checkpoint_inode_;
-  uint64_t checkpoint_offset_;
-  uint64_t checkpoint_interval_micros_;
-  uint64_t last_checkpoint_;
+  uint32_t fingerprint_;
+  uint32_t fingerprint_size_;
+  std::string rotated_filename_;
+  bool rotated_read_failed_;
+#ifdef HAVE_ZLIB
+  gzFile rotated_gz_;
+#endif
+  std::deque<Mark> marks_;
+  uint64_t acked_sequence_;
+  CheckpointStore::Checkpoint acked_;
+  CheckpointStore::Checkpoint checkpoint_;
   char buf_[8192];
   size_t buf_len_;
   size_t buf_pos_;
+  /* set if the last read failed; reported by the next getNextLine call */
+  std::string read_error_;
   std::list<std::string> line_buf_;
   uint64_t line_buf_maxsize_;
+  pcre* multiline_start_;
+  pcre* multiline_continue_;
+  uint64_t multiline_max_lines_;
+  uint64_t multiline_timeout_micros_;
+  bool record_open_;
+  uint64_t record_lines_;
+  uint64_t record_time_;
+  ReturnCode setRegex(const std::string& regex);
+  size_t findField(const char* name, size_t size);
+  size_t registerField(const std::string& name);
+  void splitRegex(const std::string& line, std::string* event_json);
+  void splitDelimited(const std::string& line, std::string* event_json);
+  void splitKeyValue(const std::string& line, std::string* event_json);
+  void appendMember(
+      size_t idx,
+      const char* name,
+      size_t name_size,
+      const char* data,
+      size_t size,
+      std::string* event_json);
   ReturnCode readLines();
+  ReturnCode readRotatedLines();
+  bool findRotatedFile();
+  void closeRotatedFile();
+  void updateFingerprint(int fd, uint64_t file_size);
+  CheckpointStore::Checkpoint getPosition() const;
+  void appendLine(std::string* line);
+  bool isContinuation(const std::string& line) const;
+  size_t getRecordCount();
+  void appendField(
+      size_t idx,
+      const char* data,
+      size_t size,
+      std::string* event_json);
   bool readLine(int fd, std::string* line);
   bool readNextByte(int fd, char* target);
 };
 
 LogfileSource::LogfileSource(
     const std::string& filename,
-    const std::string& spool_dir) :
+    const std::string& spool_dir,
+    CheckpointStore* checkpoints) :
     filename_(filename),
+    checkpoint_key_(SHA1::compute(filename)),
+    checkpoints_(checkpoints),
+    format_(FormatConfig::RAW),
+    delimiter_('\t'),
+    kv_separator_('='),
+    json_fallback_(FormatConfig::WRAP),
+    invalid_json_lines_(0),
+    dropped_lines_(0),
     pcre_handle_(nullptr),
+    time_field_(kNoField),
+    has_event_time_(false),
+    event_time_(0),
     inode_(0),
     offset_(0),
     consumed_offset_(0),
-    checkpoint_inode_(0),
-    checkpoint_offset_(0),
-    checkpoint_interval_micros_(10 * kMicrosPerSecond),
-    last_checkpoint_(0),
-    line_buf_maxsize_(8192) {
-  auto filename_hash = SHA1::compute(filename_);
-  checkpoint_filename_ = spool_dir + "/log_" + filename_hash.toString();
+    fingerprint_(0),
+    fingerprint_size_(0),
+    rotated_read_failed_(false),
+#ifdef HAVE_ZLIB
+    rotated_gz_(nullptr),
+#endif
+    acked_sequence_(0),
+    buf_len_(0),
+    buf_pos_(0),
+    line_buf_maxsize_(8192),
+    multiline_start_(nullptr),
+    multiline_continue_(nullptr),
+    multiline_max_lines_(0),
+    multiline_timeout_micros_(0),
+    record_open_(false),
+    record_lines_(0),
+    record_time_(0) {
+  legacy_checkpoint_filename_ =
+      spool_dir + "/log_" + checkpoint_key_.toString();
 }
 
 LogfileSource::~LogfileSource() {
+  closeRotatedFile();
+
   if (pcre_handle_) {
     pcre_free(pcre_handle_);
   }
+
+  if (multiline_start_) {
+    pcre_free(multiline_start_);
+  }
+
+  if (multiline_continue_) {
+    pcre_free(multiline_continue_);
+  }
+}
+
+ReturnCode LogfileSource::setMultiline(const MultilineConfig& config) {
+  if (!config.start_regex.empty()) {
+    auto rc = compileRegex(config.start_regex, &multiline_start_);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (!config.continue_regex.empty()) {
+    auto rc = compileRegex(config.continue_regex, &multiline_continue_);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  multiline_max_lines_ = config.max_lines;
+  multiline_timeout_micros_ = config.timeout_millis * kMicrosPerMilli;
+  return ReturnCode::success();
+}
+
+ReturnCode LogfileSource::setFormat(const FormatConfig& config) {
+  format_ = config.format;
+  switch (format_) {
+    case FormatConfig::REGEX:
+      return setRegex(config.regex);
+    case FormatConfig::DELIMITER:
+      delimiter_ = config.delimiter;
+      fields_ = config.columns;
+      field_types_.clear();
+      field_types_.resize(fields_.size());
+      break;
+    case FormatConfig::KV:
+      kv_separator_ = config.kv_separator;
+      break;
+    case FormatConfig::JSON:
+      json_fallback_ = config.json_fallback;
+      break;
+    default:
+      break;
+  }
+
+  return ReturnCode::success();
 }
 
 ReturnCode LogfileSource::setRegex(const std::string& regex) {
@@ -141,14 +696,15 @@ ReturnCode LogfileSource::setRegex(const std::string& regex) {
   int name_entry_size;
   pcre_fullinfo(pcre_handle_, NULL, PCRE_INFO_NAMETABLE, &name_table);
   pcre_fullinfo(pcre_handle_, NULL, PCRE_INFO_NAMEENTRYSIZE, &name_entry_size);
-  pcre_fields_.clear();
-  pcre_fields_.resize(capture_count + 1);
+  fields_.clear();
+  fields_.resize(capture_count + 1);
+  field_types_.clear();
+  field_types_.resize(capture_count + 1);
   auto tabptr = name_table;
   for (int i = 0; i < namecount; i++) {
     int idx = (tabptr[0] << 8) | tabptr[1];
-    pcre_fields_[idx] = std::string(
-        (const char*) tabptr + 2,
-        name_entry_size - 3);
+    /* entries are padded to the longest name */
+    fields_[idx] = std::string((const char*) tabptr + 2);
 
     tabptr += name_entry_size;
   }
@@ -156,42 +712,109 @@ ReturnCode LogfileSource::setRegex(const std::string& regex) {
   return ReturnCode::success();
 }
 
+ReturnCode LogfileSource::setFieldTypes(const std::vector<FieldType>& types) {
+  for (const auto& type : types) {
+    auto idx = registerField(type.field);
+    if (idx == kNoField) {
+      return ReturnCode::error(
+          "EINVAL",
+          "field_type for a field that the format does not extract: %s",
+          type.field.c_str());
+    }
+
+    auto& conversion = field_types_[idx];
+    conversion.kind = type.kind;
+    if (type.kind == FieldType::TIMESTAMP) {
+      conversion.time_parser.reset(new TimeParser());
+      auto rc = conversion.time_parser->compile(type.format);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode LogfileSource::setTimeField(
+    const std::string& field,
+    const std::string& format) {
+  auto idx = registerField(field);
+  if (idx == kNoField) {
+    return ReturnCode::error(
+        "EINVAL",
+        "time_field is not extracted by the format: %s",
+        field.c_str());
+  }
+
+  auto rc = time_parser_.compile(format);
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  time_field_ = idx;
+  return ReturnCode::success();
+}
+
+size_t LogfileSource::findField(const char* name, size_t size) {
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    if (fields_[i].size() == size &&
+        memcmp(fields_[i].data(), name, size) == 0) {
+      return i;
+    }
+  }
+
+  return kNoField;
+}
+
+/* key=value lines may contain any key, so only the keys that have a type or
+   are the time field are registered; other formats only know the fields
+   they were configured with */
+size_t LogfileSource::registerField(const std::string& name) {
+  auto idx = findField(name.data(), name.size());
+  if (idx != kNoField || format_ != FormatConfig::KV || name.empty()) {
+    return idx;
+  }
+
+  fields_.emplace_back(name);
+  field_types_.resize(fields_.size());
+  return fields_.size() - 1;
+}
+
 bool LogfileSource::hasNextLine() {
-  if (line_buf_.empty()) {
+  if (getRecordCount() == 0 && read_error_.empty()) {
     readLines();
   }
 
-  return !line_buf_.empty();
+  return getRecordCount() > 0 || !read_error_.empty();
 }
 
 ReturnCode LogfileSource::getNextLine(std::string* line) {
-  if (line_buf_.empty()) {
-    auto rc = readLines();
+  if (getRecordCount() == 0) {
+    auto rc = read_error_.empty() ?
+        readLines() :
+        ReturnCode::error("IOERR", "%s", read_error_.c_str());
+
+    read_error_.clear();
     if (!rc.isSuccess()) {
       return rc;
     }
   }
 
-  if (!line_buf_.empty()) {
-    *line = line_buf_.front();
-    line->resize(line->size() - 1);
-    consumed_offset_ += line_buf_.front().size();
+  if (getRecordCount() > 0) {
+    auto& record = line_buf_.front();
+    consumed_offset_ += record.size();
+    record.pop_back();
+    line->swap(record);
     line_buf_.pop_front();
   }
 
-  auto now = WallClock::unixMicros();
-  if (now - last_checkpoint_ >= checkpoint_interval_micros_) {
-    auto rc = writeCheckpoint();
-    if (!rc.isSuccess()) {
-      logWarning("error while writing checkpoint file: $0", rc.getMessage());
-    }
-    last_checkpoint_ = WallClock::unixMicros();
-  }
-
   return ReturnCode::success();
 }
 
 ReturnCode LogfileSource::getNextEvent(std::string* event_json) {
+  has_event_time_ = false;
+
   std::string raw_line;
   {
     auto rc = getNextLine(&raw_line);
@@ -204,120 +827,643 @@ ReturnCode LogfileSource::getNextEvent(std::string* event_json) {
     return ReturnCode::success();
   }
 
-  if (pcre_handle_) {
-    const size_t OV_COUNT = 3 * 36;
-    int ovector[OV_COUNT];
-
-    int pcre_rc = pcre_exec(
-        pcre_handle_,
-        0,
-        raw_line.data(),
-        raw_line.size(),
-        0,
-        0,
-        ovector,
-        OV_COUNT);
-
-    if (pcre_rc >= 0) {
-      *event_json += "{";
-      size_t n = 0;
-      for (int i = 1; i < pcre_rc; ++i) {
-        if (pcre_fields_[i].empty()) {
-          continue;
-        }
-
-        if (++n > 1) {
-          *event_json += ",";
-        }
-
-        std::string evdata(
-            raw_line.data() + ovector[2*i],
-            ovector[2*i+1] - ovector[2*i]);
-
-        *event_json += "\"" + StringUtil::jsonEscape(pcre_fields_[i]) + "\":";
-        *event_json += "\"" + StringUtil::jsonEscape(evdata) + "\"";
+  switch (format_) {
+    case FormatConfig::REGEX:
+      splitRegex(raw_line, event_json);
+      break;
+    case FormatConfig::DELIMITER:
+      splitDelimited(raw_line, event_json);
+      break;
+    case FormatConfig::KV:
+      splitKeyValue(raw_line, event_json);
+      break;
+    case FormatConfig::JSON: {
+      auto begin = raw_line.data();
+      auto end = begin + raw_line.size();
+      if (*begin == '{' && JSONUtil::validate(begin, end)) {
+        event_json->swap(raw_line);
+        break;
       }
 
-      *event_json += "}";
+      ++invalid_json_lines_;
+      if (json_fallback_ == FormatConfig::DROP) {
+        break;
+      }
     }
-  } else {
-    *event_json = StringUtil::format(
-        R"({ "data": "$0" })",
-        StringUtil::jsonEscape(raw_line));
+      /* fallthrough */
+    case FormatConfig::RAW:
+      *event_json = StringUtil::format(
+          R"({ "data": "$0" })",
+          StringUtil::jsonEscape(raw_line));
+      break;
+  }
+
+  /* the line didn't match the format or was invalid JSON with
+     json_fallback drop */
+  if (event_json->empty()) {
+    ++dropped_lines_;
   }
 
   return ReturnCode::success();
 }
 
-ReturnCode LogfileSource::readLines() {
-  struct stat file_st;
-  if (stat(filename_.c_str(), &file_st) < 0) {
-    return ReturnCode::error("IOERR", "fstat('%s') failed", filename_.c_str());
-  }
+void LogfileSource::splitRegex(
+    const std::string& line,
+    std::string* event_json) {
+  const size_t OV_COUNT = 3 * 36;
+  int ovector[OV_COUNT];
 
-  uint64_t file_inode = file_st.st_ino;
-  uint64_t file_size = file_st.st_size;
-  if (file_inode != inode_ || file_size < offset_) {
-    line_buf_.clear();
-    inode_ = file_inode;
-    offset_ = 0;
-    consumed_offset_ = 0;
-  }
+  int pcre_rc = pcre_exec(
+      pcre_handle_,
+      0,
+      line.data(),
+      line.size(),
+      0,
+      0,
+      ovector,
+      OV_COUNT);
 
-  if (file_size == offset_) {
-    return ReturnCode::success();
+  if (pcre_rc < 0) {
+    return;
   }
 
-  int fd = open(filename_.c_str(), O_RDONLY, 0);
-  if (fd < 0) {
-    return ReturnCode::error("IOERR", "open('%s') failed", filename_.c_str());
-  }
+  *event_json += "{";
+  for (int i = 1; i < pcre_rc; ++i) {
+    if (fields_[i].empty()) {
+      continue;
+    }
 
-  if (lseek(fd, offset_, SEEK_SET) < 0) {
-    close(fd);
-    return ReturnCode::error("IOERR", "lseek('%i') failed", fd);
+    appendMember(
+        i,
+        fields_[i].data(),
+        fields_[i].size(),
+        line.data() + ovector[2*i],
+        ovector[2*i+1] - ovector[2*i],
+        event_json);
   }
 
-  buf_len_ = 0;
-  buf_pos_ = 0;
+  *event_json += "}";
+}
 
-  std::string line;
-  while (readLine(fd, &line) && line_buf_.size() < line_buf_maxsize_) {
-    line_buf_.push_back(line);
-    offset_ += line.size();
+/* columns without a name (or beyond the last name) are skipped; a space
+   delimiter matches any number of spaces */
+void LogfileSource::splitDelimited(
+    const std::string& line,
+    std::string* event_json) {
+  const char* cur = line.data();
+  const char* end = cur + line.size();
+  if (delimiter_ == ' ') {
+    while (cur < end && *cur == ' ') {
+      ++cur;
+    }
   }
 
-  close(fd);
-  return ReturnCode::success();
-}
-
-bool LogfileSource::readLine(int fd, std::string* line) {
-  line->clear();
+  *event_json += "{";
+  for (size_t col = 0; col < fields_.size(); ++col) {
+    auto next = (const char*) memchr(cur, delimiter_, end - cur);
+    auto field_end = next ? next : end;
+    if (!fields_[col].empty()) {
+      appendMember(
+          col,
+          fields_[col].data(),
+          fields_[col].size(),
+          cur,
+          field_end - cur,
+          event_json);
+    }
 
-  char byte;
-  while (readNextByte(fd, &byte)) {
-    *line += byte;
+    if (!next) {
+      break;
+    }
 
-    if (byte == '\n') {
-      return true;
+    cur = next + 1;
+    if (delimiter_ == ' ') {
+      while (cur < end && *cur == ' ') {
+        ++cur;
+      }
     }
   }
 
-  return false;
+  *event_json += "}";
 }
 
-bool LogfileSource::readNextByte(int fd, char* target) {
-  if (buf_pos_ >= buf_len_) {
-    int bytes_read = read(fd, buf_, sizeof(buf_));
-    if (bytes_read <= 0) {
-      return false; // FIXME?
+/* pairs are separated by whitespace; values may be double quoted, in which
+   case \" and \\ are unescaped. Words without a separator are skipped */
+void LogfileSource::splitKeyValue(
+    const std::string& line,
+    std::string* event_json) {
+  const char* cur = line.data();
+  const char* end = cur + line.size();
+  std::string unescaped;
+
+  *event_json += "{";
+  while (cur < end) {
+    while (cur < end && isBlank(*cur)) {
+      ++cur;
     }
 
-    buf_pos_ = 0;
-    buf_len_ = bytes_read;
-  }
+    auto key = cur;
+    while (cur < end && !isBlank(*cur) && *cur != kv_separator_) {
+      ++cur;
+    }
 
-  if (buf_pos_ < buf_len_) {
+    if (cur == end || *cur != kv_separator_ || cur == key) {
+      while (cur < end && !isBlank(*cur)) {
+        ++cur;
+      }
+
+      continue;
+    }
+
+    auto key_size = cur - key;
+    auto value = ++cur;
+    size_t value_size;
+    if (cur < end && *cur == '"') {
+      value = ++cur;
+      bool escaped = false;
+      while (cur < end && *cur != '"') {
+        if (*cur == '\\' && cur + 1 < end) {
+          escaped = true;
+          ++cur;
+        }
+
+        ++cur;
+      }
+
+      value_size = cur - value;
+      if (cur < end) {
+        ++cur;
+      }
+
+      if (escaped) {
+        unescaped.clear();
+        for (auto p = value; p < value + value_size; ++p) {
+          if (*p == '\\' && p + 1 < value + value_size) {
+            ++p;
+          }
+
+          unescaped += *p;
+        }
+
+        value = unescaped.data();
+        value_size = unescaped.size();
+      }
+    } else {
+      while (cur < end && !isBlank(*cur)) {
+        ++cur;
+      }
+
+      value_size = cur - value;
+    }
+
+    appendMember(
+        findField(key, key_size),
+        key,
+        key_size,
+        value,
+        value_size,
+        event_json);
+  }
+
+  *event_json += "}";
+}
+
+/* lines whose timestamp can't be parsed keep the collection time */
+void LogfileSource::appendMember(
+    size_t idx,
+    const char* name,
+    size_t name_size,
+    const char* data,
+    size_t size,
+    std::string* event_json) {
+  if (event_json->size() > 1) {
+    *event_json += ",";
+  }
+
+  appendJSONString(name, name_size, event_json);
+  *event_json += ":";
+
+  if (idx == kNoField) {
+    appendJSONString(data, size, event_json);
+    return;
+  }
+
+  appendField(idx, data, size, event_json);
+  if (idx == time_field_) {
+    has_event_time_ = time_parser_.parse(data, size, &event_time_);
+  }
+}
+
+bool LogfileSource::getEventTime(uint64_t* time) const {
+  if (has_event_time_) {
+    *time = event_time_;
+  }
+
+  return has_event_time_;
+}
+
+/* typed fields that can't be converted (or were not captured) are null */
+void LogfileSource::appendField(
+    size_t idx,
+    const char* data,
+    size_t size,
+    std::string* event_json) {
+  const auto& conversion = field_types_[idx];
+  bool ok = true;
+  switch (conversion.kind) {
+    case FieldType::STRING:
+      appendJSONString(data, size, event_json);
+      return;
+    case FieldType::INT:
+      ok = appendJSONInt(data, size, event_json);
+      break;
+    case FieldType::FLOAT:
+      ok = appendJSONFloat(data, size, event_json);
+      break;
+    case FieldType::BOOL:
+      ok = appendJSONBool(data, size, event_json);
+      break;
+    case FieldType::TIMESTAMP: {
+      uint64_t micros;
+      ok = conversion.time_parser->parse(data, size, &micros);
+      if (ok) {
+        appendUInt(micros, event_json);
+      }
+      break;
+    }
+  }
+
+  if (!ok) {
+    *event_json += "null";
+  }
+}
+
+ReturnCode LogfileSource::readLines() {
+  if (!rotated_filename_.empty()) {
+    return readRotatedLines();
+  }
+
+  struct stat file_st;
+  if (stat(filename_.c_str(), &file_st) < 0) {
+    /* the file was moved away and not replaced (yet); finish reading it if
+       it is still next to its old name */
+    if (errno == ENOENT && inode_ != 0) {
+      if (!line_buf_.empty()) {
+        record_open_ = false;
+        return ReturnCode::success();
+      }
+
+      if (findRotatedFile()) {
+        return readRotatedLines();
+      }
+    }
+
+    return ReturnCode::error("IOERR", "fstat('%s') failed", filename_.c_str());
+  }
+
+  uint64_t file_inode = file_st.st_ino;
+  uint64_t file_size = file_st.st_size;
+  if (file_inode != inode_ || file_size < offset_) {
+    /* only switch files once all lines read from the previous one were
+       consumed so that the read position always refers to a single file */
+    if (!line_buf_.empty()) {
+      record_open_ = false;
+      return ReturnCode::success();
+    }
+
+    /* the file was rotated; finish reading the old file first */
+    if (file_inode != inode_ && inode_ != 0 && findRotatedFile()) {
+      return readRotatedLines();
+    }
+
+    inode_ = file_inode;
+    offset_ = 0;
+    consumed_offset_ = 0;
+    fingerprint_ = 0;
+    fingerprint_size_ = 0;
+  }
+
+  if (file_size == offset_) {
+    return ReturnCode::success();
+  }
+
+  int fd = open(filename_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return ReturnCode::error("IOERR", "open('%s') failed", filename_.c_str());
+  }
+
+  if (lseek(fd, offset_, SEEK_SET) < 0) {
+    close(fd);
+    return ReturnCode::error("IOERR", "lseek('%i') failed", fd);
+  }
+
+  updateFingerprint(fd, file_size);
+
+  buf_len_ = 0;
+  buf_pos_ = 0;
+
+  std::string line;
+  while (line_buf_.size() < line_buf_maxsize_ && readLine(fd, &line)) {
+    offset_ += line.size();
+    appendLine(&line);
+  }
+
+  close(fd);
+
+  if (!read_error_.empty()) {
+    return ReturnCode::error("IOERR", "%s", read_error_.c_str());
+  }
+
+  return ReturnCode::success();
+}
+
+/* reads the remaining lines from the rotated file and then switches back to
+   the live file */
+ReturnCode LogfileSource::readRotatedLines() {
+  int fd = -1;
+#ifdef HAVE_ZLIB
+  if (!rotated_gz_) {
+#endif
+    fd = open(rotated_filename_.c_str(), O_RDONLY, 0);
+    if (fd >= 0 && lseek(fd, offset_, SEEK_SET) < 0) {
+      close(fd);
+      fd = -1;
+    }
+
+    if (fd < 0) {
+      logWarning(
+          "logfile: can't read rotated file, skipping it: $0",
+          rotated_filename_);
+
+      line_buf_.clear();
+      record_open_ = false;
+      closeRotatedFile();
+      inode_ = 0;
+      return readLines();
+    }
+
+    buf_len_ = 0;
+    buf_pos_ = 0;
+#ifdef HAVE_ZLIB
+  }
+#endif
+
+  bool eof = false;
+  std::string line;
+  while (line_buf_.size() < line_buf_maxsize_) {
+    if (rotated_read_failed_ || !readLine(fd, &line)) {
+      eof = true;
+      break;
+    }
+
+    offset_ += line.size();
+    appendLine(&line);
+  }
+
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  /* zlib can't resume after a failed read, so the rest of the rotated file
+     is skipped once the error was reported */
+  if (!read_error_.empty()) {
+    rotated_read_failed_ = true;
+    return ReturnCode::error("IOERR", "%s", read_error_.c_str());
+  }
+
+  if (!eof) {
+    return ReturnCode::success();
+  }
+
+  if (!line_buf_.empty()) {
+    record_open_ = false;
+    return ReturnCode::success();
+  }
+
+  /* the rotated file was drained; continue with the live file from its
+     start */
+  closeRotatedFile();
+  inode_ = 0;
+  return readLines();
+}
+
+/* looks for the rotated file in the log directory: an uncompressed file is
+   recognized by its inode, a gzip compressed one by the fingerprint of its
+   first bytes */
+bool LogfileSource::findRotatedFile() {
+  std::string dirname = ".";
+  std::string basename = filename_;
+  auto slash = filename_.find_last_of('/');
+  if (slash != std::string::npos) {
+    dirname = slash == 0 ? "/" : filename_.substr(0, slash);
+    basename = filename_.substr(slash + 1);
+  }
+
+  auto dir = opendir(dirname.c_str());
+  if (!dir) {
+    return false;
+  }
+
+  std::vector<std::string> candidates;
+  for (struct dirent* entry; (entry = readdir(dir)) != nullptr; ) {
+    std::string name(entry->d_name);
+    if (name.size() > basename.size() &&
+        name.compare(0, basename.size(), basename) == 0) {
+      candidates.emplace_back(dirname + "/" + name);
+    }
+  }
+
+  closedir(dir);
+
+  /* inodes are reused, so an uncompressed file must match the fingerprint,
+     too */
+  for (const auto& path : candidates) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 ||
+        !S_ISREG(st.st_mode) ||
+        st.st_ino != inode_) {
+      continue;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      continue;
+    }
+
+    char head[kFingerprintSize];
+    bool match =
+        fingerprint_size_ == 0 || (
+        pread(fd, head, fingerprint_size_, 0) == fingerprint_size_ &&
+        CRC32::compute(head, fingerprint_size_) == fingerprint_);
+
+    close(fd);
+
+    if (match) {
+      rotated_filename_ = path;
+      return true;
+    }
+  }
+
+#ifdef HAVE_ZLIB
+  if (fingerprint_size_ == 0) {
+    return false;
+  }
+
+  for (const auto& path : candidates) {
+    if (!StringUtil::endsWith(path, ".gz")) {
+      continue;
+    }
+
+    auto gz = gzopen(path.c_str(), "rb");
+    if (!gz) {
+      continue;
+    }
+
+    char head[kFingerprintSize];
+    if (gzread(gz, head, fingerprint_size_) == (int) fingerprint_size_ &&
+        CRC32::compute(head, fingerprint_size_) == fingerprint_ &&
+        gzseek(gz, offset_, SEEK_SET) == (z_off_t) offset_) {
+      rotated_filename_ = path;
+      rotated_gz_ = gz;
+      buf_len_ = 0;
+      buf_pos_ = 0;
+      return true;
+    }
+
+    gzclose(gz);
+  }
+#endif
+
+  return false;
+}
+
+void LogfileSource::closeRotatedFile() {
+#ifdef HAVE_ZLIB
+  if (rotated_gz_) {
+    gzclose(rotated_gz_);
+    rotated_gz_ = nullptr;
+  }
+#endif
+
+  rotated_filename_.clear();
+  rotated_read_failed_ = false;
+}
+
+void LogfileSource::updateFingerprint(int fd, uint64_t file_size) {
+  if (fingerprint_size_ >= kFingerprintSize ||
+      fingerprint_size_ >= file_size) {
+    return;
+  }
+
+  auto size = std::min(file_size, (uint64_t) kFingerprintSize);
+  char head[kFingerprintSize];
+  if (pread(fd, head, size, 0) == (ssize_t) size) {
+    fingerprint_ = CRC32::compute(head, size);
+    fingerprint_size_ = size;
+  }
+}
+
+CheckpointStore::Checkpoint LogfileSource::getPosition() const {
+  CheckpointStore::Checkpoint position;
+  position.inode = inode_;
+  position.offset = consumed_offset_;
+  position.fingerprint = fingerprint_;
+  position.fingerprint_size = fingerprint_size_;
+  return position;
+}
+
+/* the last record in the buffer stays open for continuation lines until the
+   next record starts, it reaches the maximum number of lines or no line was
+   appended for the flush timeout */
+void LogfileSource::appendLine(std::string* line) {
+  if (!multiline_start_ && !multiline_continue_) {
+    line_buf_.emplace_back(std::move(*line));
+    return;
+  }
+
+  if (record_open_ && isContinuation(*line)) {
+    line_buf_.back().append(*line);
+    ++record_lines_;
+  } else {
+    line_buf_.emplace_back(std::move(*line));
+    record_lines_ = 1;
+  }
+
+  record_open_ = record_lines_ < multiline_max_lines_;
+  record_time_ = MonotonicClock::now();
+}
+
+bool LogfileSource::isContinuation(const std::string& line) const {
+  /* match without the trailing newline */
+  auto size = line.size() - (line.back() == '\n' ? 1 : 0);
+  if (multiline_continue_) {
+    return matchRegex(multiline_continue_, line.data(), size);
+  } else {
+    return !matchRegex(multiline_start_, line.data(), size);
+  }
+}
+
+size_t LogfileSource::getRecordCount() {
+  if (record_open_ &&
+      MonotonicClock::now() - record_time_ >= multiline_timeout_micros_) {
+    record_open_ = false;
+  }
+
+  return line_buf_.size() - (record_open_ ? 1 : 0);
+}
+
+bool LogfileSource::readLine(int fd, std::string* line) {
+  line->clear();
+
+  char byte;
+  while (readNextByte(fd, &byte)) {
+    *line += byte;
+
+    if (byte == '\n') {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool LogfileSource::readNextByte(int fd, char* target) {
+  if (buf_pos_ >= buf_len_) {
+    int bytes_read;
+#ifdef HAVE_ZLIB
+    if (rotated_gz_) {
+      bytes_read = gzread(rotated_gz_, buf_, sizeof(buf_));
+    } else {
+      bytes_read = read(fd, buf_, sizeof(buf_));
+    }
+#else
+    bytes_read = read(fd, buf_, sizeof(buf_));
+#endif
+    if (bytes_read < 0) {
+      const char* error = strerror(errno);
+#ifdef HAVE_ZLIB
+      int gz_errnum;
+      if (rotated_gz_) {
+        error = gzerror(rotated_gz_, &gz_errnum);
+      }
+#endif
+      read_error_ = StringUtil::format(
+          "read('$0') failed: $1",
+          rotated_filename_.empty() ? filename_ : rotated_filename_,
+          error);
+
+      return false;
+    }
+
+    if (bytes_read == 0) {
+      return false;
+    }
+
+    buf_pos_ = 0;
+    buf_len_ = bytes_read;
+  }
+
+  if (buf_pos_ < buf_len_) {
     *target = buf_[buf_pos_++];
     return true;
   } else {
@@ -326,66 +1472,630 @@ bool LogfileSource::readNextByte(int fd, char* target) {
 }
 
 ReturnCode LogfileSource::readCheckpoint() {
-  inode_ = 0;
-  offset_ = 0;
+  CheckpointStore::Checkpoint checkpoint;
+  if (!checkpoints_->get(checkpoint_key_, &checkpoint)) {
+    /* migrate a checkpoint written by a previous version */
+    int fd = open(legacy_checkpoint_filename_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      unsigned char cdata[sizeof(uint64_t) * 2];
+      if (read(fd, cdata, sizeof(cdata)) == sizeof(cdata)) {
+        memcpy(&checkpoint.inode, &cdata[0], sizeof(uint64_t));
+        memcpy(&checkpoint.offset, &cdata[sizeof(uint64_t)], sizeof(uint64_t));
+      }
 
-  int fd = open(checkpoint_filename_.c_str(), O_RDONLY);
-  if (fd > 0) {
-    unsigned char cdata[sizeof(uint64_t) * 2];
-    if (read(fd, cdata, sizeof(cdata)) == sizeof(cdata)) {
-      memcpy(&inode_, &cdata[sizeof(uint64_t) * 0], sizeof(uint64_t));
-      memcpy(&offset_, &cdata[sizeof(uint64_t) * 1], sizeof(uint64_t));
-    }
+      close(fd);
 
-    close(fd);
+      checkpoints_->set(checkpoint_key_, checkpoint);
+      if (checkpoints_->flush().isSuccess()) {
+        unlink(legacy_checkpoint_filename_.c_str());
+      }
+    }
   }
 
+  inode_ = checkpoint.inode;
+  offset_ = checkpoint.offset;
   consumed_offset_ = offset_;
-  checkpoint_inode_ = inode_;
-  checkpoint_offset_ = offset_;
+  fingerprint_ = checkpoint.fingerprint;
+  fingerprint_size_ = checkpoint.fingerprint_size;
+  acked_ = checkpoint;
+  checkpoint_ = checkpoint;
   return ReturnCode::success();
 }
 
-ReturnCode LogfileSource::writeCheckpoint() {
-  if (checkpoint_inode_ == inode_ && checkpoint_offset_ == consumed_offset_) {
-    return ReturnCode::success();
+void LogfileSource::markPosition(uint64_t sequence) {
+  auto position = getPosition();
+  const auto& last = marks_.empty() ? acked_ : marks_.back().position;
+  if (last == position) {
+    return;
   }
 
-  checkpoint_inode_ = inode_;
-  checkpoint_offset_ = consumed_offset_;
+  /* everything up to sequence was delivered already, e.g. if the lines read
+     since the last mark produced no events */
+  if (marks_.empty() && sequence <= acked_sequence_) {
+    acked_ = position;
+    updateCheckpoint();
+    return;
+  }
 
-  unsigned char cdata[sizeof(uint64_t) * 2];
-  memcpy(&cdata[sizeof(uint64_t) * 0], &checkpoint_inode_, sizeof(uint64_t));
-  memcpy(&cdata[sizeof(uint64_t) * 1], &checkpoint_offset_, sizeof(uint64_t));
+  if (marks_.size() >= kMaxPendingMarks) {
+    marks_.pop_front();
+  }
 
-  int fd = open(
-      checkpoint_filename_.c_str(),
-      O_WRONLY | O_TRUNC | O_CREAT,
-      0666);
+  Mark mark;
+  mark.sequence = sequence;
+  mark.position = position;
+  marks_.emplace_back(mark);
+}
 
-  if (fd < 0) {
-    return ReturnCode::error(
-        "IOERR",
-        "open('%s') failed",
-        checkpoint_filename_.c_str());
+void LogfileSource::acknowledge(uint64_t sequence) {
+  if (sequence > acked_sequence_) {
+    acked_sequence_ = sequence;
+  }
+
+  bool advanced = false;
+  while (!marks_.empty() && marks_.front().sequence <= sequence) {
+    acked_ = marks_.front().position;
+    marks_.pop_front();
+    advanced = true;
+  }
+
+  if (advanced) {
+    updateCheckpoint();
+  }
+}
+
+bool LogfileSource::hasPendingMarks() const {
+  return !marks_.empty();
+}
+
+/* only positions acknowledged by all outputs are checkpointed */
+void LogfileSource::updateCheckpoint() {
+  if (checkpoint_ == acked_) {
+    return;
   }
 
-  if (write(fd, cdata, sizeof(cdata)) < 0) {
+  checkpoint_ = acked_;
+  checkpoints_->set(checkpoint_key_, checkpoint_);
+}
+
+void LogfileSource::removeCheckpoint() {
+  checkpoints_->remove(checkpoint_key_);
+}
+
+void LogfileSource::getStats(PluginStats* stats) {
+  struct stat file_st;
+  if (stat(filename_.c_str(), &file_st) < 0) {
+    return;
+  }
+
+  uint64_t file_inode = file_st.st_ino;
+  uint64_t file_size = file_st.st_size;
+  auto lag = [file_inode, file_size] (uint64_t inode, uint64_t offset) {
+    if (inode != file_inode || offset > file_size) {
+      return file_size;
+    } else {
+      return file_size - offset;
+    }
+  };
+
+  stats->emplace_back("file_size", file_size);
+  stats->emplace_back("read_offset", consumed_offset_);
+  stats->emplace_back("read_lag_bytes", lag(inode_, consumed_offset_));
+  stats->emplace_back("checkpoint_offset", checkpoint_.offset);
+  stats->emplace_back(
+      "checkpoint_lag_bytes",
+      lag(checkpoint_.inode, checkpoint_.offset));
+  stats->emplace_back("reading_rotated", !rotated_filename_.empty());
+  stats->emplace_back("dropped_lines", dropped_lines_);
+  if (format_ == FormatConfig::JSON) {
+    stats->emplace_back("invalid_json_lines", invalid_json_lines_);
+  }
+}
+
+/**
+ * Tails all files in a directory that match a glob pattern. Files are
+ * discovered and marked active by the plugin's shared FileWatcher, so only
+ * files that changed since they were last drained are read. File descriptors
+ * are only held while a file is read and each file keeps its own checkpoint
+ */
+class LogfileGlobSource : public LogfileReader, public FileWatcher::Listener {
+public:
+
+  LogfileGlobSource(
+      FileWatcher* watcher,
+      const std::string& directory,
+      const std::string& pattern,
+      const std::string& spool_dir,
+      CheckpointStore* checkpoints);
+
+  ~LogfileGlobSource();
+
+  ReturnCode setFormat(const FormatConfig& config);
+  ReturnCode setFieldTypes(const std::vector<FieldType>& types);
+  ReturnCode setTimeField(const std::string& field, const std::string& format);
+  ReturnCode setMultiline(const MultilineConfig& config);
+  ReturnCode start();
+
+  bool hasNextLine() override;
+  ReturnCode getNextEvent(std::string* event_json) override;
+  bool getEventTime(uint64_t* time) const override;
+  void markPosition(uint64_t sequence) override;
+  void acknowledge(uint64_t sequence) override;
+  void updateCheckpoint() override;
+  void getStats(PluginStats* stats) override;
+
+  void onFileEvent(
+      const std::string& dir,
+      const std::string& name,
+      uint32_t mask) override;
+
+  void onOverflow() override;
+
+protected:
+
+  static const uint64_t kPollIntervalMicros = 100000;
+
+  struct File {
+    std::string name;
+    std::string target;
+    std::string target_dir;
+    std::unique_ptr<LogfileSource> source;
+    bool active;
+    bool removed;
+  };
+
+  void scan();
+  File* addFile(const std::string& name);
+  void removeFile(File* file);
+  void markActive(File* file);
+  void resolveTarget(File* file);
+  void releaseTarget(File* file);
+
+  FileWatcher* watcher_;
+  std::string directory_;
+  std::string real_directory_;
+  std::string pattern_;
+  std::string spool_dir_;
+  CheckpointStore* checkpoints_;
+  FormatConfig format_;
+  std::vector<FieldType> field_types_;
+  std::string time_field_;
+  std::string time_format_;
+  bool has_event_time_;
+  uint64_t event_time_;
+  MultilineConfig multiline_;
+  std::unordered_map<std::string, std::unique_ptr<File>> files_;
+  std::unordered_map<std::string, File*> targets_;
+  std::unordered_map<std::string, size_t> target_dirs_;
+  std::deque<File*> active_;
+  std::unordered_set<File*> read_since_mark_;
+  std::unordered_set<File*> marked_;
+  uint64_t last_poll_;
+  bool watching_;
+};
+
+LogfileGlobSource::LogfileGlobSource(
+    FileWatcher* watcher,
+    const std::string& directory,
+    const std::string& pattern,
+    const std::string& spool_dir,
+    CheckpointStore* checkpoints) :
+    watcher_(watcher),
+    directory_(directory),
+    pattern_(pattern),
+    spool_dir_(spool_dir),
+    checkpoints_(checkpoints),
+    has_event_time_(false),
+    event_time_(0),
+    last_poll_(0),
+    watching_(false) {}
+
+LogfileGlobSource::~LogfileGlobSource() {
+  if (watching_) {
+    watcher_->unwatchDirectory(directory_, this);
+  }
+
+  for (const auto& d : target_dirs_) {
+    watcher_->unwatchDirectory(d.first, this);
+  }
+}
+
+ReturnCode LogfileGlobSource::setFormat(const FormatConfig& config) {
+  /* compile once up front so that a bad regex fails the attach even if no
+     file matches yet */
+  LogfileSource probe(directory_, spool_dir_, checkpoints_);
+  auto rc = probe.setFormat(config);
+  if (rc.isSuccess()) {
+    format_ = config;
+  }
+
+  return rc;
+}
+
+ReturnCode LogfileGlobSource::setFieldTypes(
+    const std::vector<FieldType>& types) {
+  LogfileSource probe(directory_, spool_dir_, checkpoints_);
+  probe.setFormat(format_);
+  auto rc = probe.setFieldTypes(types);
+  if (rc.isSuccess()) {
+    field_types_ = types;
+  }
+
+  return rc;
+}
+
+ReturnCode LogfileGlobSource::setTimeField(
+    const std::string& field,
+    const std::string& format) {
+  LogfileSource probe(directory_, spool_dir_, checkpoints_);
+  probe.setFormat(format_);
+  probe.setFieldTypes(field_types_);
+  auto rc = probe.setTimeField(field, format);
+  if (rc.isSuccess()) {
+    time_field_ = field;
+    time_format_ = format;
+  }
+
+  return rc;
+}
+
+ReturnCode LogfileGlobSource::setMultiline(const MultilineConfig& config) {
+  LogfileSource probe(directory_, spool_dir_, checkpoints_);
+  auto rc = probe.setMultiline(config);
+  if (rc.isSuccess()) {
+    multiline_ = config;
+  }
+
+  return rc;
+}
+
+ReturnCode LogfileGlobSource::start() {
+  char real_directory[PATH_MAX];
+  if (!realpath(directory_.c_str(), real_directory)) {
     return ReturnCode::error(
         "IOERR",
-        "write('%s') failed",
-        checkpoint_filename_.c_str());
+        "realpath('%s') failed: %s",
+        directory_.c_str(),
+        strerror(errno));
   }
 
-  close(fd);
+  real_directory_ = real_directory;
+
+  /* watch before scanning so that no file created in between is missed */
+  auto rc = watcher_->watchDirectory(directory_, this);
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  watching_ = true;
+  scan();
   return ReturnCode::success();
 }
 
+void LogfileGlobSource::scan() {
+  auto dir = opendir(directory_.c_str());
+  if (!dir) {
+    logWarning("opendir('$0') failed: $1", directory_, strerror(errno));
+    return;
+  }
+
+  std::unordered_map<std::string, bool> seen;
+  for (struct dirent* ent; (ent = readdir(dir)) != nullptr; ) {
+    std::string name(ent->d_name);
+    if (fnmatch(pattern_.c_str(), name.c_str(), FNM_PERIOD) != 0) {
+      continue;
+    }
+
+    File* file;
+    auto iter = files_.find(name);
+    if (iter == files_.end()) {
+      file = addFile(name);
+    } else {
+      file = iter->second.get();
+    }
+
+    if (file) {
+      file->removed = false;
+      seen[name] = true;
+      markActive(file);
+    }
+  }
+
+  closedir(dir);
+
+  for (const auto& f : files_) {
+    if (seen.count(f.first) == 0) {
+      f.second->removed = true;
+      markActive(f.second.get());
+    }
+  }
+}
+
+LogfileGlobSource::File* LogfileGlobSource::addFile(const std::string& name) {
+  auto path = directory_ + "/" + name;
+
+  struct stat file_st;
+  if (stat(path.c_str(), &file_st) < 0 || !S_ISREG(file_st.st_mode)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<File> file(new File());
+  file->name = name;
+  file->active = false;
+  file->removed = false;
+  file->source.reset(new LogfileSource(path, spool_dir_, checkpoints_));
+  file->source->readCheckpoint();
+
+  file->source->setFormat(format_);
+  file->source->setFieldTypes(field_types_);
+  if (!time_field_.empty()) {
+    file->source->setTimeField(time_field_, time_format_);
+  }
+
+  if (multiline_.isEnabled()) {
+    file->source->setMultiline(multiline_);
+  }
+
+  resolveTarget(file.get());
+
+  auto file_ptr = file.get();
+  files_.emplace(name, std::move(file));
+  return file_ptr;
+}
+
+void LogfileGlobSource::removeFile(File* file) {
+  read_since_mark_.erase(file);
+  marked_.erase(file);
+  releaseTarget(file);
+  file->source->removeCheckpoint();
+  files_.erase(file->name);
+}
+
+void LogfileGlobSource::markActive(File* file) {
+  if (!file->active) {
+    file->active = true;
+    active_.emplace_back(file);
+  }
+}
+
+/* changes to the target of a symlink are not reported for the directory
+   containing the link, so the target's directory is watched as well */
+void LogfileGlobSource::resolveTarget(File* file) {
+  releaseTarget(file);
+
+  char target[PATH_MAX];
+  if (!realpath((directory_ + "/" + file->name).c_str(), target)) {
+    return;
+  }
+
+  std::string target_path(target);
+  if (target_path == real_directory_ + "/" + file->name) {
+    return;
+  }
+
+  auto target_dir = target_path.substr(0, target_path.find_last_of('/'));
+  if (target_dir.empty()) {
+    target_dir = "/";
+  }
+
+  if (target_dir != real_directory_) {
+    if (target_dirs_[target_dir]++ == 0) {
+      auto rc = watcher_->watchDirectory(target_dir, this);
+      if (!rc.isSuccess()) {
+        logWarning(
+            "can't watch symlink target of $0: $1",
+            file->name,
+            rc.getMessage());
+      }
+    }
+
+    file->target_dir = target_dir;
+  }
+
+  file->target = target_path;
+  targets_[target_path] = file;
+}
+
+void LogfileGlobSource::releaseTarget(File* file) {
+  if (file->target.empty()) {
+    return;
+  }
+
+  auto iter = targets_.find(file->target);
+  if (iter != targets_.end() && iter->second == file) {
+    targets_.erase(iter);
+  }
+
+  if (!file->target_dir.empty() && --target_dirs_[file->target_dir] == 0) {
+    target_dirs_.erase(file->target_dir);
+    watcher_->unwatchDirectory(file->target_dir, this);
+  }
+
+  file->target.clear();
+  file->target_dir.clear();
+}
+
+void LogfileGlobSource::onFileEvent(
+    const std::string& dir,
+    const std::string& name,
+    uint32_t mask) {
+  auto target = targets_.find(dir + "/" + name);
+  if (target != targets_.end()) {
+    markActive(target->second);
+  }
+
+  if (dir != real_directory_) {
+    return;
+  }
+
+  if (fnmatch(pattern_.c_str(), name.c_str(), FNM_PERIOD) != 0) {
+    return;
+  }
+
+  /* a removed file stays active until its source has read the lines that
+     were written before it was moved away */
+  auto iter = files_.find(name);
+  if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+    if (iter != files_.end()) {
+      iter->second->removed = true;
+      markActive(iter->second.get());
+    }
+
+    return;
+  }
+
+  File* file;
+  if (iter == files_.end()) {
+    file = addFile(name);
+    if (!file) {
+      return;
+    }
+  } else {
+    file = iter->second.get();
+    if (file->removed) {
+      file->removed = false;
+      resolveTarget(file);
+    }
+  }
+
+  markActive(file);
+}
+
+void LogfileGlobSource::onOverflow() {
+  scan();
+}
+
+bool LogfileGlobSource::hasNextLine() {
+  auto now = MonotonicClock::now();
+  if (active_.empty() || now - last_poll_ >= kPollIntervalMicros) {
+    watcher_->poll();
+    last_poll_ = now;
+  }
+
+  while (!active_.empty()) {
+    auto file = active_.front();
+    if (file->source->hasNextLine()) {
+      return true;
+    }
+
+    active_.pop_front();
+    file->active = false;
+    if (file->removed) {
+      removeFile(file);
+    }
+  }
+
+  return false;
+}
+
+ReturnCode LogfileGlobSource::getNextEvent(std::string* event_json) {
+  if (!hasNextLine()) {
+    return ReturnCode::success();
+  }
+
+  /* round robin between all active files */
+  auto file = active_.front();
+  active_.pop_front();
+  active_.emplace_back(file);
+  read_since_mark_.insert(file);
+  auto rc = file->source->getNextEvent(event_json);
+  has_event_time_ = file->source->getEventTime(&event_time_);
+  return rc;
+}
+
+bool LogfileGlobSource::getEventTime(uint64_t* time) const {
+  if (has_event_time_) {
+    *time = event_time_;
+  }
+
+  return has_event_time_;
+}
+
+void LogfileGlobSource::markPosition(uint64_t sequence) {
+  for (auto file : read_since_mark_) {
+    file->source->markPosition(sequence);
+    if (file->source->hasPendingMarks()) {
+      marked_.insert(file);
+    }
+  }
+
+  read_since_mark_.clear();
+}
+
+void LogfileGlobSource::acknowledge(uint64_t sequence) {
+  for (auto iter = marked_.begin(); iter != marked_.end(); ) {
+    auto source = (*iter)->source.get();
+    source->acknowledge(sequence);
+    if (source->hasPendingMarks()) {
+      ++iter;
+    } else {
+      iter = marked_.erase(iter);
+    }
+  }
+}
+
+void LogfileGlobSource::updateCheckpoint() {
+  for (const auto& f : files_) {
+    f.second->source->updateCheckpoint();
+  }
+}
+
+void LogfileGlobSource::getStats(PluginStats* stats) {
+  uint64_t read_lag_bytes = 0;
+  uint64_t checkpoint_lag_bytes = 0;
+  uint64_t invalid_json_lines = 0;
+  uint64_t dropped_lines = 0;
+  for (const auto& f : files_) {
+    PluginStats file_stats;
+    f.second->source->getStats(&file_stats);
+    for (const auto& s : file_stats) {
+      if (s.first == "read_lag_bytes") {
+        read_lag_bytes += s.second;
+      } else if (s.first == "checkpoint_lag_bytes") {
+        checkpoint_lag_bytes += s.second;
+      } else if (s.first == "invalid_json_lines") {
+        invalid_json_lines += s.second;
+      } else if (s.first == "dropped_lines") {
+        dropped_lines += s.second;
+      }
+    }
+  }
+
+  stats->emplace_back("files", files_.size());
+  stats->emplace_back("active_files", active_.size());
+  stats->emplace_back("read_lag_bytes", read_lag_bytes);
+  stats->emplace_back("checkpoint_lag_bytes", checkpoint_lag_bytes);
+  stats->emplace_back("dropped_lines", dropped_lines);
+  if (format_.format == FormatConfig::JSON) {
+    stats->emplace_back("invalid_json_lines", invalid_json_lines);
+  }
+}
+
+LogfileSourcePlugin::LogfileSourcePlugin() {}
+
+LogfileSourcePlugin::~LogfileSourcePlugin() {}
+
 ReturnCode LogfileSourcePlugin::pluginInit(const PluginConfig& config) {
   spool_dir_ = config.spool_dir;
+  checkpoints_.reset(new CheckpointStore(spool_dir_ + "/logfile.checkpoints"));
+
+  auto rc = checkpoints_->load();
+  if (!rc.isSuccess()) {
+    logWarning("error while reading checkpoint file: $0", rc.getMessage());
+  }
+
   return ReturnCode::success();
 }
 
+void LogfileSourcePlugin::pluginFree() {
+  if (checkpoints_) {
+    auto rc = checkpoints_->flush();
+    if (!rc.isSuccess()) {
+      logWarning("error while writing checkpoint file: $0", rc.getMessage());
+    }
+  }
+}
+
 ReturnCode LogfileSourcePlugin::pluginAttach(
     const PropertyList& config,
     void** userdata) {
@@ -394,38 +2104,232 @@ ReturnCode LogfileSourcePlugin::pluginAttach(
     return ReturnCode::error("EINVAL", "logfile needs a filename");
   }
 
-  std::unique_ptr<LogfileSource> logfile(
-      new LogfileSource(filename, spool_dir_));
+  FormatConfig format;
+  {
+    auto rc = FormatConfig::parse(config, &format);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  std::vector<FieldType> field_types;
+  {
+    std::vector<std::vector<std::string>> specs;
+    config.get("field_type", &specs);
+    for (const auto& spec : specs) {
+      FieldType type;
+      auto rc = FieldType::parse(spec.empty() ? "" : spec[0], &type);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+
+      field_types.emplace_back(type);
+    }
+  }
 
-  logfile->readCheckpoint();
+  std::string time_field;
+  std::string time_format;
+  config.get("time_field", &time_field);
+  config.get("time_format", &time_format);
+  for (const auto& type : field_types) {
+    if (time_format.empty() &&
+        type.field == time_field &&
+        type.kind == FieldType::TIMESTAMP) {
+      time_format = type.format;
+    }
+  }
 
-  std::string regex;
-  if (config.get("regex", &regex)) {
-    auto rc = logfile->setRegex(regex);
+  if (!time_field.empty() && time_format.empty()) {
+    return ReturnCode::error(
+        "EINVAL",
+        "logfile: time_field needs a time_format: %s",
+        time_field.c_str());
+  }
+
+  MultilineConfig multiline;
+  config.get("multiline_start", &multiline.start_regex);
+  config.get("multiline_continue", &multiline.continue_regex);
+  {
+    auto rc = config.getUInt("multiline_max_lines", &multiline.max_lines);
+    if (rc.isSuccess()) {
+      rc = config.getUInt("multiline_timeout", &multiline.timeout_millis);
+    }
+
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  struct stat file_st;
+  bool is_directory =
+      stat(filename.c_str(), &file_st) == 0 && S_ISDIR(file_st.st_mode);
+
+  if (!is_directory && filename.find_first_of("*?[") == std::string::npos) {
+    std::unique_ptr<LogfileSource> logfile(
+        new LogfileSource(filename, spool_dir_, checkpoints_.get()));
+
+    logfile->readCheckpoint();
+
+    {
+      auto rc = logfile->setFormat(format);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+
+    {
+      auto rc = logfile->setFieldTypes(field_types);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+
+    if (!time_field.empty()) {
+      auto rc = logfile->setTimeField(time_field, time_format);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+
+    if (multiline.isEnabled()) {
+      auto rc = logfile->setMultiline(multiline);
+      if (!rc.isSuccess()) {
+        return rc;
+      }
+    }
+
+    *userdata = static_cast<LogfileReader*>(logfile.release());
+    return ReturnCode::success();
+  }
+
+  std::string directory = filename;
+  std::string pattern = "*";
+  if (!is_directory) {
+    auto slash = filename.find_last_of('/');
+    if (slash == std::string::npos) {
+      directory = ".";
+      pattern = filename;
+    } else {
+      directory = slash == 0 ? "/" : filename.substr(0, slash);
+      pattern = filename.substr(slash + 1);
+    }
+
+    if (directory.find_first_of("*?[") != std::string::npos) {
+      return ReturnCode::error(
+          "EINVAL",
+          "logfile: wildcards are only supported in the file name: %s",
+          filename.c_str());
+    }
+  }
+
+  if (!watcher_) {
+    std::unique_ptr<FileWatcher> watcher(new FileWatcher());
+    auto rc = watcher->init();
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+
+    watcher_ = std::move(watcher);
+  }
+
+  std::unique_ptr<LogfileGlobSource> logfile(
+      new LogfileGlobSource(
+          watcher_.get(),
+          directory,
+          pattern,
+          spool_dir_,
+          checkpoints_.get()));
+
+  {
+    auto rc = logfile->setFormat(format);
     if (!rc.isSuccess()) {
       return rc;
     }
   }
 
-  *userdata = logfile.release();
+  {
+    auto rc = logfile->setFieldTypes(field_types);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (!time_field.empty()) {
+    auto rc = logfile->setTimeField(time_field, time_format);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  if (multiline.isEnabled()) {
+    auto rc = logfile->setMultiline(multiline);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  auto rc = logfile->start();
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  *userdata = static_cast<LogfileReader*>(logfile.release());
   return ReturnCode::success();
 }
 
 void LogfileSourcePlugin::pluginDetach(void* userdata) {
-  auto logfile = static_cast<LogfileSource*>(userdata);
-  logfile->writeCheckpoint();
+  auto logfile = static_cast<LogfileReader*>(userdata);
+  logfile->updateCheckpoint();
   delete logfile;
+
+  /* the final snapshot is written in pluginFree */
+  checkpoints_->flushIfDue();
 }
 
 ReturnCode LogfileSourcePlugin::pluginGetNextEvent(
     void* userdata,
     std::string* event_json) {
-  return static_cast<LogfileSource*>(userdata)->getNextEvent(event_json);
+  return static_cast<LogfileReader*>(userdata)->getNextEvent(event_json);
 }
 
 bool LogfileSourcePlugin::pluginHasPendingEvent(
     void* userdata) {
-  return static_cast<LogfileSource*>(userdata)->hasNextLine();
+  return static_cast<LogfileReader*>(userdata)->hasNextLine();
+}
+
+bool LogfileSourcePlugin::pluginGetEventTime(
+    void* userdata,
+    uint64_t* time) {
+  return static_cast<LogfileReader*>(userdata)->getEventTime(time);
+}
+
+void LogfileSourcePlugin::pluginMarkPosition(
+    void* userdata,
+    uint64_t sequence) {
+  static_cast<LogfileReader*>(userdata)->markPosition(sequence);
+}
+
+void LogfileSourcePlugin::pluginAcknowledge(
+    void* userdata,
+    uint64_t sequence) {
+  static_cast<LogfileReader*>(userdata)->acknowledge(sequence);
+
+  auto rc = checkpoints_->flushIfDue();
+  if (!rc.isSuccess()) {
+    logWarning("error while writing checkpoint file: $0", rc.getMessage());
+  }
+}
+
+void LogfileSourcePlugin::pluginGetStats(
+    void* userdata,
+    PluginStats* stats) {
+  static_cast<LogfileReader*>(userdata)->getStats(stats);
+}
+
+ReturnCode LogfileSourcePlugin::pluginCheckpoint(
+    void* userdata) {
+  static_cast<LogfileReader*>(userdata)->updateCheckpoint();
+  return checkpoints_->flush();
 }
 
 } // namespace evcollect
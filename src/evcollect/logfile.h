@@ -22,20 +22,33 @@
  * code of your own applications
  */
 #pragma once
+#include <memory>
 #include <string>
 #include <evcollect/evcollect.h>
 #include <evcollect/plugin.h>
 
 namespace evcollect {
+class CheckpointStore;
+class FileWatcher;
 
+/**
+ * Tails a logfile. If the logfile is a directory or its file name contains
+ * glob wildcards (*, ?, [...]) all matching files in the directory are tailed;
+ * new files are discovered using an inotify instance shared by all sources
+ */
 class LogfileSourcePlugin : public SourcePlugin {
 public:
 
   static void registerPlugin(PluginMap* plugin_map);
 
+  LogfileSourcePlugin();
+  ~LogfileSourcePlugin();
+
   ReturnCode pluginInit(
       const PluginConfig& config) override;
 
+  void pluginFree() override;
+
   ReturnCode pluginAttach(
       const PropertyList& config,
       void** userdata) override;
@@ -50,8 +63,29 @@ public:
   bool pluginHasPendingEvent(
       void* userdata) override;
 
+  bool pluginGetEventTime(
+      void* userdata,
+      uint64_t* time) override;
+
+  void pluginMarkPosition(
+      void* userdata,
+      uint64_t sequence) override;
+
+  void pluginAcknowledge(
+      void* userdata,
+      uint64_t sequence) override;
+
+  void pluginGetStats(
+      void* userdata,
+      PluginStats* stats) override;
+
+  ReturnCode pluginCheckpoint(
+      void* userdata) override;
+
 protected:
   std::string spool_dir_;
+  std::unique_ptr<CheckpointStore> checkpoints_;
+  std::unique_ptr<FileWatcher> watcher_;
 };
 
 } // namespace evcollect
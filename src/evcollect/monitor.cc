@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <evcollect/monitor.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+ReturnCode makeAddress(const std::string& socket_path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr->sun_path)) {
+    return ReturnCode::error(
+        "EINVAL",
+        "socket path too long: %s",
+        socket_path.c_str());
+  }
+
+  memcpy(addr->sun_path, socket_path.data(), socket_path.size());
+  return ReturnCode::success();
+}
+
+void setTimeout(int fd, uint64_t micros) {
+  struct timeval tv;
+  tv.tv_sec = micros / kMicrosPerSecond;
+  tv.tv_usec = micros % kMicrosPerSecond;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool writeAll(int fd, const std::string& data) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    auto rc = ::write(fd, data.data() + pos, data.size() - pos);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (rc <= 0) {
+      return false;
+    }
+
+    pos += rc;
+  }
+
+  return true;
+}
+
+} // namespace
+
+MonitorSocket::MonitorSocket() : fd_(-1) {}
+
+MonitorSocket::~MonitorSocket() {
+  close();
+}
+
+ReturnCode MonitorSocket::listen(const std::string& socket_path) {
+  if (fd_ >= 0) {
+    return ReturnCode::error("RTERROR", "monitor socket is already listening");
+  }
+
+  struct sockaddr_un addr;
+  {
+    auto rc = makeAddress(socket_path, &addr);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return ReturnCode::error("IOERR", "socket() failed: %s", strerror(errno));
+  }
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  unlink(socket_path.c_str());
+
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    auto rc = ReturnCode::error(
+        "IOERR",
+        "bind('%s') failed: %s",
+        socket_path.c_str(),
+        strerror(errno));
+
+    ::close(fd);
+    return rc;
+  }
+
+  if (::listen(fd, 16) < 0) {
+    auto rc = ReturnCode::error("IOERR", "listen() failed: %s", strerror(errno));
+    ::close(fd);
+    unlink(socket_path.c_str());
+    return rc;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  fd_ = fd;
+  socket_path_ = socket_path;
+  return ReturnCode::success();
+}
+
+void MonitorSocket::close() {
+  if (fd_ < 0) {
+    return;
+  }
+
+  ::close(fd_);
+  unlink(socket_path_.c_str());
+  fd_ = -1;
+}
+
+int MonitorSocket::getFD() const {
+  return fd_;
+}
+
+ReturnCode MonitorSocket::handleConnection(HandlerFn handler) {
+  int client_fd = accept(fd_, NULL, NULL);
+  if (client_fd < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return ReturnCode::success();
+    }
+
+    return ReturnCode::error("IOERR", "accept() failed: %s", strerror(errno));
+  }
+
+  /* the accepted socket might inherit O_NONBLOCK; we want blocking reads */
+  fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) & ~O_NONBLOCK);
+  fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+  setTimeout(client_fd, kClientTimeoutMicros);
+
+  std::string request;
+  char buf[512];
+  while (request.find('\n') == std::string::npos &&
+         request.size() < kMaxRequestSize) {
+    auto rc = ::read(client_fd, buf, sizeof(buf));
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (rc <= 0) {
+      break;
+    }
+
+    request.append(buf, rc);
+  }
+
+  auto eol = request.find('\n');
+  if (eol == std::string::npos) {
+    ::close(client_fd);
+    return ReturnCode::error("EINVAL", "incomplete monitor request");
+  }
+
+  request.resize(eol);
+  if (!request.empty() && request.back() == '\r') {
+    request.pop_back();
+  }
+
+  std::string response;
+  handler(request, &response);
+  if (response.empty() || response.back() != '\n') {
+    response += "\n";
+  }
+
+  auto write_ok = writeAll(client_fd, response);
+  ::close(client_fd);
+
+  if (!write_ok) {
+    return ReturnCode::error("IOERR", "write() failed: %s", strerror(errno));
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode MonitorSocket::sendRequest(
+    const std::string& socket_path,
+    const std::string& command,
+    std::string* response) {
+  struct sockaddr_un addr;
+  {
+    auto rc = makeAddress(socket_path, &addr);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return ReturnCode::error("IOERR", "socket() failed: %s", strerror(errno));
+  }
+
+  if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    auto rc = ReturnCode::error(
+        "IOERR",
+        "connect('%s') failed: %s",
+        socket_path.c_str(),
+        strerror(errno));
+
+    ::close(fd);
+    return rc;
+  }
+
+  if (!writeAll(fd, command + "\n")) {
+    auto rc = ReturnCode::error("IOERR", "write() failed: %s", strerror(errno));
+    ::close(fd);
+    return rc;
+  }
+
+  response->clear();
+  char buf[4096];
+  while (true) {
+    auto rc = ::read(fd, buf, sizeof(buf));
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (rc < 0) {
+      auto err = ReturnCode::error(
+          "IOERR",
+          "read() failed: %s",
+          strerror(errno));
+
+      ::close(fd);
+      return err;
+    }
+
+    if (rc == 0) {
+      break;
+    }
+
+    response->append(buf, rc);
+  }
+
+  ::close(fd);
+  return ReturnCode::success();
+}
+
+} // namespace evcollect
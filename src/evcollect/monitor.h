@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <functional>
+#include <evcollect/util/return_code.h>
+
+namespace evcollect {
+
+/**
+ * A unix domain socket that serves simple line-based requests. A client
+ * connects, sends one command line and receives the response; the connection
+ * is closed after the response has been written
+ */
+class MonitorSocket {
+public:
+
+  static const uint64_t kClientTimeoutMicros = 1000000;
+  static const size_t kMaxRequestSize = 4096;
+
+  using HandlerFn = std::function<void (
+      const std::string& command,
+      std::string* response)>;
+
+  MonitorSocket();
+  ~MonitorSocket();
+
+  /**
+   * Bind and listen on the provided path. A stale socket file at the same path
+   * is removed
+   */
+  ReturnCode listen(const std::string& socket_path);
+
+  /**
+   * Close the socket and remove the socket file
+   */
+  void close();
+
+  /**
+   * Return the listening fd or -1 if the socket is not listening
+   */
+  int getFD() const;
+
+  /**
+   * Accept and serve one pending connection. The client must send its request
+   * within kClientTimeoutMicros, so a stuck client can't stall the caller
+   */
+  ReturnCode handleConnection(HandlerFn handler);
+
+  /**
+   * Connect to a monitor socket, send the command and read the response
+   */
+  static ReturnCode sendRequest(
+      const std::string& socket_path,
+      const std::string& command,
+      std::string* response);
+
+protected:
+  std::string socket_path_;
+  int fd_;
+};
+
+} // namespace evcollect
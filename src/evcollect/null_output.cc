@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <evcollect/null_output.h>
+#include <evcollect/event_names.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+struct EventCounter {
+  EventCounter() :
+      events(0),
+      bytes(0),
+      reported_events(0),
+      reported_bytes(0) {}
+
+  uint64_t events;
+  uint64_t bytes;
+  uint64_t reported_events;
+  uint64_t reported_bytes;
+};
+
+struct CounterTarget {
+  /* indexed by event id */
+  std::vector<std::unique_ptr<EventCounter>> counters;
+  uint64_t report_interval_micros;
+  uint64_t last_report;
+};
+
+void reportCounters(CounterTarget* target, uint64_t now) {
+  double elapsed_secs =
+      double(now - target->last_report) / kMicrosPerSecond;
+
+  for (size_t id = 0; id < target->counters.size(); ++id) {
+    auto counter = target->counters[id].get();
+    if (!counter) {
+      continue;
+    }
+
+    auto events = counter->events;
+    auto bytes = counter->bytes;
+    auto event_name = id == EventNameTable::kUnknownEventID ?
+        nullptr :
+        EventNameTable::get()->lookup(id);
+
+    /* no rate if the last report was in the same microsecond */
+    uint64_t events_rate = 0;
+    uint64_t bytes_rate = 0;
+    if (elapsed_secs > 0) {
+      events_rate = (events - counter->reported_events) / elapsed_secs;
+      bytes_rate = (bytes - counter->reported_bytes) / elapsed_secs;
+    }
+
+    logInfo(
+        "counter: $0 events ($1/s), $2 bytes ($3/s) for event '$4'",
+        events,
+        events_rate,
+        bytes,
+        bytes_rate,
+        event_name ? *event_name : "<other>");
+
+    counter->reported_events = events;
+    counter->reported_bytes = bytes;
+  }
+
+  target->last_report = now;
+}
+
+} // namespace
+
+void NullOutputPlugin::registerPlugin(PluginMap* plugin_map) {
+  plugin_map->registerOutputPlugin(
+      "null",
+      std::unique_ptr<OutputPlugin>(new NullOutputPlugin()));
+}
+
+ReturnCode NullOutputPlugin::pluginEmitEvent(
+    void* userdata,
+    const EventData& evdata) {
+  return ReturnCode::success();
+}
+
+ReturnCode NullOutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  return ReturnCode::success();
+}
+
+bool NullOutputPlugin::pluginAcceptsEncoding(EventEncoding encoding) {
+  return true;
+}
+
+void CounterOutputPlugin::registerPlugin(PluginMap* plugin_map) {
+  plugin_map->registerOutputPlugin(
+      "counter",
+      std::unique_ptr<OutputPlugin>(new CounterOutputPlugin()));
+}
+
+ReturnCode CounterOutputPlugin::pluginAttach(
+    const PropertyList& config,
+    void** userdata) {
+  uint64_t report_interval = kDefaultReportIntervalSecs;
+
+  auto rc = config.getUInt("report_interval", &report_interval);
+  if (!rc.isSuccess()) {
+    return rc;
+  }
+
+  auto target = new CounterTarget();
+  target->report_interval_micros = report_interval * kMicrosPerSecond;
+  target->last_report = MonotonicClock::now();
+  *userdata = target;
+  return ReturnCode::success();
+}
+
+void CounterOutputPlugin::pluginDetach(void* userdata) {
+  auto target = static_cast<CounterTarget*>(userdata);
+  reportCounters(target, MonotonicClock::now());
+  delete target;
+}
+
+ReturnCode CounterOutputPlugin::pluginEmitEvent(
+    void* userdata,
+    const EventData& evdata) {
+  return pluginEmitEvents(userdata, &evdata, 1);
+}
+
+ReturnCode CounterOutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  auto target = static_cast<CounterTarget*>(userdata);
+
+  for (size_t i = 0; i < events_count; ++i) {
+    const auto& ev = events[i];
+    if (ev.event_id >= target->counters.size()) {
+      target->counters.resize(ev.event_id + 1);
+    }
+
+    auto& counter = target->counters[ev.event_id];
+    if (!counter) {
+      counter.reset(new EventCounter());
+    }
+
+    ++counter->events;
+    counter->bytes += ev.event_data->size();
+  }
+
+  auto now = MonotonicClock::now();
+  if (now - target->last_report >= target->report_interval_micros) {
+    reportCounters(target, now);
+  }
+
+  return ReturnCode::success();
+}
+
+bool CounterOutputPlugin::pluginAcceptsEncoding(EventEncoding encoding) {
+  return true;
+}
+
+} // namespace evcollect
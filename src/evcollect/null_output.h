@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <evcollect/evcollect.h>
+#include <evcollect/plugin.h>
+
+namespace evcollect {
+
+/**
+ * Discards all events. Useful to measure the throughput of sources and of the
+ * pipeline without any output overhead
+ */
+class NullOutputPlugin : public OutputPlugin {
+public:
+
+  static void registerPlugin(PluginMap* plugin_map);
+
+  ReturnCode pluginEmitEvent(
+      void* userdata,
+      const EventData& evdata) override;
+
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override;
+
+  bool pluginAcceptsEncoding(
+      EventEncoding encoding) override;
+
+};
+
+/**
+ * Discards all events but keeps per-event-name event and byte counts and logs
+ * the totals and rates every report_interval seconds (default 10) and when
+ * the target is detached
+ */
+class CounterOutputPlugin : public OutputPlugin {
+public:
+
+  static void registerPlugin(PluginMap* plugin_map);
+
+  static const uint64_t kDefaultReportIntervalSecs = 10;
+
+  ReturnCode pluginAttach(
+      const PropertyList& config,
+      void** userdata) override;
+
+  void pluginDetach(
+      void* userdata) override;
+
+  ReturnCode pluginEmitEvent(
+      void* userdata,
+      const EventData& evdata) override;
+
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override;
+
+  bool pluginAcceptsEncoding(
+      EventEncoding encoding) override;
+
+};
+
+} // namespace evcollect
+
@@ -27,6 +27,8 @@
 #include <sys/stat.h>
 #include <evcollect/plugin.h>
 #include <evcollect/service.h>
+#include <evcollect/event_names.h>
+#include <evcollect/util/histogram.h>
 #include <evcollect/util/logging.h>
 
 namespace evcollect {
@@ -46,6 +48,24 @@ ReturnCode SourcePlugin::pluginAttach(
 
 void SourcePlugin::pluginDetach(void* userdata) {}
 
+void SourcePlugin::pluginGetStats(void* userdata, PluginStats* stats) {}
+
+ReturnCode SourcePlugin::pluginCheckpoint(void* userdata) {
+  return ReturnCode::success();
+}
+
+EventEncoding SourcePlugin::pluginGetEncoding(void* userdata) {
+  return EventEncoding::JSON;
+}
+
+bool SourcePlugin::pluginGetEventTime(void* userdata, uint64_t* time) {
+  return false;
+}
+
+void SourcePlugin::pluginMarkPosition(void* userdata, uint64_t sequence) {}
+
+void SourcePlugin::pluginAcknowledge(void* userdata, uint64_t sequence) {}
+
 DynamicSourcePlugin::DynamicSourcePlugin(
     PluginContext* ctx,
     evcollect_plugin_getnextevent_fn getnextevent_fn,
@@ -102,9 +122,14 @@ ReturnCode DynamicSourcePlugin::pluginGetNextEvent(
     void* userdata,
     std::string* data) {
   EventData evdata;
+  evdata.event_id = EventNameTable::kUnknownEventID;
+  evdata.event_name = nullptr;
 
   if (getnextevent_fn_(ctx_, userdata, &evdata)) {
-    *data = evdata.event_data;
+    if (evdata.event_data) {
+      *data = *evdata.event_data;
+    }
+
     return ReturnCode::success();
   } else {
     return ReturnCode::error(
@@ -137,15 +162,40 @@ ReturnCode OutputPlugin::pluginAttach(
 
 void OutputPlugin::pluginDetach(void* userdata) {}
 
+ReturnCode OutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  auto rc_aggr = ReturnCode::success();
+  for (size_t i = 0; i < events_count; ++i) {
+    auto rc = pluginEmitEvent(userdata, events[i]);
+    if (!rc.isSuccess()) {
+      rc_aggr = rc;
+    }
+  }
+
+  return rc_aggr;
+}
+
+ReturnCode OutputPlugin::pluginFlush(void* userdata) {
+  return ReturnCode::success();
+}
+
+bool OutputPlugin::pluginAcceptsEncoding(EventEncoding encoding) {
+  return encoding == EventEncoding::JSON;
+}
+
 DynamicOutputPlugin::DynamicOutputPlugin(
     PluginContext* ctx,
     evcollect_plugin_emitevent_fn emitevent_fn,
+    evcollect_plugin_emitevents_fn emitevents_fn,
     evcollect_plugin_attach_fn attach_fn,
     evcollect_plugin_detach_fn detach_fn,
     evcollect_plugin_init_fn init_fn,
     evcollect_plugin_free_fn free_fn) :
     ctx_(ctx),
     emitevent_fn_(emitevent_fn),
+    emitevents_fn_(emitevents_fn),
     attach_fn_(attach_fn),
     detach_fn_(detach_fn),
     init_fn_(init_fn),
@@ -190,13 +240,43 @@ void DynamicOutputPlugin::pluginDetach(void* userdata) {
 ReturnCode DynamicOutputPlugin::pluginEmitEvent(
     void* userdata,
     const EventData& event) {
-  if (emitevent_fn_(ctx_, userdata, &event)) {
+  /* events are emitted from the delivery threads; use a per-call context */
+  PluginContext ctx;
+  ctx.plugin_map = ctx_->plugin_map;
+
+  if (emitevent_fn_(&ctx, userdata, &event)) {
     return ReturnCode::success();
   } else {
     return ReturnCode::error(
         "EPLUGIN",
         "pluginEmitEvent failed: %s",
-        ctx_->error.c_str());
+        ctx.error.c_str());
+  }
+}
+
+ReturnCode DynamicOutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  if (!emitevents_fn_) {
+    return OutputPlugin::pluginEmitEvents(userdata, events, events_count);
+  }
+
+  std::vector<const evcollect_event_t*> evs(events_count);
+  for (size_t i = 0; i < events_count; ++i) {
+    evs[i] = &events[i];
+  }
+
+  PluginContext ctx;
+  ctx.plugin_map = ctx_->plugin_map;
+
+  if (emitevents_fn_(&ctx, userdata, evs.data(), evs.size())) {
+    return ReturnCode::success();
+  } else {
+    return ReturnCode::error(
+        "EPLUGIN",
+        "pluginEmitEvents failed: %s",
+        ctx.error.c_str());
   }
 }
 
@@ -402,8 +482,13 @@ void evcollect_event_getname(
     const char** data,
     size_t* size) {
   auto ev_ = static_cast<const evcollect::EventData*>(ev);
-  *data = ev_->event_name.data();
-  *size = ev_->event_name.size();
+  if (ev_->event_name) {
+    *data = ev_->event_name->data();
+    *size = ev_->event_name->size();
+  } else {
+    *data = "";
+    *size = 0;
+  }
 }
 
 void evcollect_event_setname(
@@ -411,7 +496,17 @@ void evcollect_event_setname(
     const char* data,
     size_t size) {
   auto ev_ = static_cast<evcollect::EventData*>(ev);
-  ev_->event_name = std::string(data, size);
+  evcollect::EventNameTable::get()->setEventName(ev_, data, size);
+}
+
+uint32_t evcollect_event_getid(const evcollect_event_t* ev) {
+  auto ev_ = static_cast<const evcollect::EventData*>(ev);
+  return ev_->event_id;
+}
+
+uint64_t evcollect_event_gettime(const evcollect_event_t* ev) {
+  auto ev_ = static_cast<const evcollect::EventData*>(ev);
+  return ev_->time;
 }
 
 void evcollect_event_getdata(
@@ -419,8 +514,13 @@ void evcollect_event_getdata(
     const char** data,
     size_t* size) {
   auto ev_ = static_cast<const evcollect::EventData*>(ev);
-  *data = ev_->event_data.data();
-  *size = ev_->event_data.size();
+  if (ev_->event_data) {
+    *data = ev_->event_data->data();
+    *size = ev_->event_data->size();
+  } else {
+    *data = "";
+    *size = 0;
+  }
 }
 
 void evcollect_event_setdata(
@@ -428,7 +528,26 @@ void evcollect_event_setdata(
     const char* data,
     size_t size) {
   auto ev_ = static_cast<evcollect::EventData*>(ev);
-  ev_->event_data = std::string(data, size);
+  ev_->event_data = std::make_shared<const std::string>(data, size);
+}
+
+evcollect_event_t* evcollect_event_retain(const evcollect_event_t* ev) {
+  auto ev_ = static_cast<const evcollect::EventData*>(ev);
+  return new evcollect::EventData(*ev_);
+}
+
+void evcollect_event_release(evcollect_event_t* ev) {
+  delete static_cast<evcollect::EventData*>(ev);
+}
+
+evcollect_histogram_t* evcollect_histogram_get(const char* name) {
+  return HistogramRegistry::get()->getHistogram(name);
+}
+
+void evcollect_histogram_record(
+    evcollect_histogram_t* histogram,
+    uint64_t value) {
+  static_cast<LatencyHistogram*>(histogram)->record(value);
 }
 
 void evcollect_source_plugin_register(
@@ -462,6 +581,26 @@ void evcollect_output_plugin_register(
     evcollect_plugin_detach_fn detach_fn /* = nullptr */,
     evcollect_plugin_init_fn init_fn /* = nullptr */,
     evcollect_plugin_free_fn free_fn /* = nullptr */) {
+  evcollect_output_plugin_register_batched(
+      ctx,
+      plugin_name,
+      emitevent_fn,
+      nullptr,
+      attach_fn,
+      detach_fn,
+      init_fn,
+      free_fn);
+}
+
+void evcollect_output_plugin_register_batched(
+    evcollect_ctx_t* ctx,
+    const char* plugin_name,
+    evcollect_plugin_emitevent_fn emitevent_fn,
+    evcollect_plugin_emitevents_fn emitevents_fn /* = nullptr */,
+    evcollect_plugin_attach_fn attach_fn /* = nullptr */,
+    evcollect_plugin_detach_fn detach_fn /* = nullptr */,
+    evcollect_plugin_init_fn init_fn /* = nullptr */,
+    evcollect_plugin_free_fn free_fn /* = nullptr */) {
   auto ctx_ = static_cast<evcollect::PluginContext*>(ctx);
   ctx_->plugin_map->registerOutputPlugin(
       plugin_name,
@@ -469,6 +608,7 @@ void evcollect_output_plugin_register(
           new evcollect::DynamicOutputPlugin(
               ctx_,
               emitevent_fn,
+              emitevents_fn,
               attach_fn,
               detach_fn,
               init_fn,
@@ -24,6 +24,7 @@
 #pragma once
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <mutex>
 #include <evcollect/evcollect.h>
 #include <evcollect/config.h>
@@ -41,6 +42,8 @@ struct PluginContext {
   PluginMap* plugin_map;
 };
 
+using PluginStats = std::vector<std::pair<std::string, uint64_t>>;
+
 class SourcePlugin {
 public:
 
@@ -70,7 +73,10 @@ public:
       void* userdata);
 
   /**
-   * Produce the next event
+   * Produce the next event. The event is encoded as returned by
+   * pluginGetEncoding. Leaving event_json empty means the source has no event
+   * this round, e.g. because the input was dropped; sources should count such
+   * drops in pluginGetStats
    */
   virtual ReturnCode pluginGetNextEvent(
       void* userdata,
@@ -82,6 +88,61 @@ public:
   virtual bool pluginHasPendingEvent(
       void* userdata) = 0;
 
+  /**
+   * Report plugin specific counters to the monitor, e.g. how far the
+   * checkpoint of a tailed file lags behind the end of the file. Called from
+   * the same thread as pluginGetNextEvent. The default implementation reports
+   * nothing
+   */
+  virtual void pluginGetStats(
+      void* userdata,
+      PluginStats* stats);
+
+  /**
+   * Persist the current read position now instead of waiting for the next
+   * periodic checkpoint. The default implementation does nothing
+   */
+  virtual ReturnCode pluginCheckpoint(
+      void* userdata);
+
+  /**
+   * Returns the encoding of the events produced by pluginGetNextEvent. The
+   * default implementation returns JSON
+   */
+  virtual EventEncoding pluginGetEncoding(
+      void* userdata);
+
+  /**
+   * Returns the time of the event produced by the last pluginGetNextEvent
+   * call in microseconds since epoch, e.g. a timestamp parsed from a log
+   * line. Returns false if the event has no time of its own; it is then
+   * stamped with the time at which it was collected. The default
+   * implementation returns false
+   */
+  virtual bool pluginGetEventTime(
+      void* userdata,
+      uint64_t* time);
+
+  /**
+   * Called by the service after the events read so far have been emitted;
+   * the source's current read position covers all events up to and
+   * including sequence. Called at most once per tick and every few thousand
+   * events, not per event. The default implementation does nothing
+   */
+  virtual void pluginMarkPosition(
+      void* userdata,
+      uint64_t sequence);
+
+  /**
+   * Called by the service once all events up to and including sequence have
+   * been delivered by every output. A source should only checkpoint
+   * positions that were marked with a sequence <= the acknowledged one. The
+   * default implementation does nothing
+   */
+  virtual void pluginAcknowledge(
+      void* userdata,
+      uint64_t sequence);
+
 };
 
 class DynamicSourcePlugin : public SourcePlugin {
@@ -148,6 +209,31 @@ public:
       void* userdata,
       const EventData& evdata) = 0;
 
+  /**
+   * Emit a batch of events. The default implementation calls pluginEmitEvent
+   * for each event in the batch
+   */
+  virtual ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count);
+
+  /**
+   * Called from the delivery thread after all queued events have been emitted
+   * to make sure they are written out before returning. The default
+   * implementation does nothing
+   */
+  virtual ReturnCode pluginFlush(
+      void* userdata);
+
+  /**
+   * Returns true if the plugin accepts events in the provided encoding. Events
+   * in other encodings are converted to JSON before they are emitted. The
+   * default implementation only accepts JSON
+   */
+  virtual bool pluginAcceptsEncoding(
+      EventEncoding encoding);
+
 };
 
 class DynamicOutputPlugin : public OutputPlugin {
@@ -156,6 +242,7 @@ public:
   DynamicOutputPlugin(
       PluginContext* ctx,
       evcollect_plugin_emitevent_fn emitevent_fn,
+      evcollect_plugin_emitevents_fn emitevents_fn,
       evcollect_plugin_attach_fn attach_fn,
       evcollect_plugin_detach_fn detach_fn,
       evcollect_plugin_init_fn init_fn,
@@ -166,10 +253,15 @@ public:
   ReturnCode pluginAttach(const PropertyList& config, void** userdata) override;
   void pluginDetach(void* userdata) override;
   ReturnCode pluginEmitEvent(void* userdata, const EventData& evdata) override;
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override;
 
 protected:
   PluginContext* ctx_;
   evcollect_plugin_emitevent_fn emitevent_fn_;
+  evcollect_plugin_emitevents_fn emitevents_fn_;
   evcollect_plugin_attach_fn attach_fn_;
   evcollect_plugin_detach_fn detach_fn_;
   evcollect_plugin_init_fn init_fn_;
@@ -23,7 +23,13 @@
  */
 #include <string>
 #include <set>
+#include <atomic>
+#include <thread>
 #include <regex>
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
 #include <dlfcn.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -32,37 +38,89 @@
 #include <evcollect/config.h>
 #include <evcollect/plugin.h>
 #include <evcollect/logfile.h>
+#include <evcollect/generator.h>
+#include <evcollect/file_output.h>
+#include <evcollect/stream_output.h>
+#include <evcollect/null_output.h>
+#include <evcollect/delivery_queue.h>
+#include <evcollect/event_names.h>
+#include <evcollect/monitor.h>
 #include <evcollect/util/logging.h>
 #include <evcollect/util/time.h>
+#include <evcollect/util/jsonutil.h>
+#include <evcollect/util/msgpack.h>
+#include <evcollect/util/histogram.h>
 
 namespace evcollect {
 
 namespace {
 
-std::string mergeEvents(const std::string& base, const std::string& overlay) {
-  return overlay;
-}
+/**
+ * Computes the rate of a monotonic counter over the interval since the last
+ * call
+ */
+struct RateCounter {
+  uint64_t last_value;
+  uint64_t last_time;
+
+  RateCounter() : last_value(0), last_time(MonotonicClock::now()) {}
+
+  double update(uint64_t value, uint64_t now) {
+    double rate = 0;
+    if (now > last_time && value >= last_value) {
+      rate = double(value - last_value) * kMicrosPerSecond / (now - last_time);
+    }
+
+    last_value = value;
+    last_time = now;
+    return rate;
+  }
+};
 
 struct EventSourceBinding {
+  std::string label;
   SourcePlugin* plugin;
   void* userdata;
+  EventEncoding encoding;
+  std::unique_ptr<LatencyHistogram> latency;
 };
 
 struct EventBinding {
-  std::string event_name;
+  uint32_t event_id;
+  const std::string* event_name;
   uint64_t interval_micros;
   std::vector<EventSourceBinding> sources;
   uint64_t next_tick;
+  uint64_t tick_budget_events;
+  uint64_t tick_budget_bytes;
+  uint64_t tick_budget_micros;
+  /* set if the last tick ran out of budget while the sources had pending
+     events */
+  bool backlogged;
+  std::atomic<uint64_t> budget_exhausted_total;
+  std::atomic<uint64_t> events_total;
+  std::atomic<uint64_t> bytes_total;
+  std::atomic<uint64_t> errors_total;
+  RateCounter rate;
+  bool paused;
+  LatencyHistogram tick_lateness;
 };
 
 struct TargetBinding {
+  std::string plugin_name;
   OutputPlugin* plugin;
   void* userdata;
+  bool accepts_msgpack;
+  std::unique_ptr<DeliveryQueue> queue;
+  RateCounter rate;
+  LatencyHistogram enqueue_latency;
 };
 
 class ServiceImpl : public Service {
 public:
 
+  static const size_t kMaxBatchSize = 1024;
+
   ServiceImpl(
       const std::string& spool_dir,
       const std::string& plugin_dir);
@@ -75,19 +133,67 @@ public:
   ReturnCode loadPlugin(const std::string& plugin) override;
   ReturnCode loadPlugin(bool (*init_fn)(evcollect_ctx_t* ctx)) override;
 
+  ReturnCode listenMonitor(const std::string& socket_path) override;
+
   ReturnCode run() override;
   void kill() override;
 
 protected:
 
+  static const uint64_t kFlushTimeoutMicros = 10 * kMicrosPerSecond;
+
+  /**
+   * Monitor connections are accepted and served by the monitor thread so that
+   * slow clients don't stall the scheduler. Commands are passed to the run()
+   * loop and executed between ticks, except for waiting on the delivery
+   * queues during a flush, which happens on the monitor thread
+   */
+  struct MonitorRequest {
+    std::string command;
+    std::string response;
+    bool done;
+  };
+
+  void runMonitorThread();
+  void stopMonitorThread();
+  void serveMonitorRequest(const std::string& command, std::string* response);
+  void handleMonitorRequest(const std::string& command, std::string* response);
+  ReturnCode flushTargets();
+  void getStats(std::string* json);
+  void getTop(std::string* out);
+  void getQueues(std::string* out);
+  void getBindings(std::string* out);
+  ReturnCode checkpoint();
+  ReturnCode setPaused(const std::vector<std::string>& args, bool paused);
+  void dumpHistograms();
+
   ReturnCode processEvent(EventBinding* binding);
 
   ReturnCode emitEvent(
       EventBinding* binding,
       uint64_t time,
-      const std::string& event_data);
+      EventEncoding encoding,
+      std::string* event_data);
+
+  ReturnCode deliverEvents();
+
+  /**
+   * Pass the sequence up to which all outputs have settled their events to
+   * the sources so that they can checkpoint the corresponding positions
+   */
+  void acknowledgeEvents();
+
+  /**
+   * Tell the sources of binding that their current read positions are
+   * covered by the events emitted so far
+   */
+  void markSourcePositions(EventBinding* binding);
 
-  ReturnCode deliverEvent(const EventData& evdata);
+  /**
+   * Convert the MessagePack events in event_batch_ to JSON for outputs that
+   * don't accept MessagePack. Events that can't be converted are dropped
+   */
+  void convertEventBatch();
 
   std::string spool_dir_;
   std::string plugin_dir_;
@@ -95,10 +201,24 @@ protected:
   PluginContext plugin_ctx_;
   std::vector<std::unique_ptr<EventBinding>> event_bindings_;
   std::vector<std::unique_ptr<TargetBinding>> targets_;
+  std::vector<EventData> event_batch_;
+  bool event_batch_has_msgpack_;
+  std::vector<EventData> event_batch_json_;
+  uint64_t last_sequence_;
+  uint64_t acked_sequence_;
+  JSONObjectMerger event_merger_;
   std::multiset<
       EventBinding*,
       std::function<bool (EventBinding*, EventBinding*)>> queue_;
-  int listen_fd_;
+  MonitorSocket monitor_;
+  std::thread monitor_thread_;
+  std::mutex monitor_mutex_;
+  std::condition_variable monitor_cv_;
+  MonitorRequest* monitor_request_;
+  bool monitor_shutdown_;
+  int monitor_pipe_[2];
+  int monitor_stop_pipe_[2];
+  uint64_t start_time_;
   int wakeup_pipe_[2];
 };
 
@@ -108,20 +228,45 @@ ServiceImpl::ServiceImpl(
     spool_dir_(spool_dir),
     plugin_dir_(plugin_dir),
     plugin_map_(spool_dir, plugin_dir),
+    event_batch_has_msgpack_(false),
+    last_sequence_(0),
+    acked_sequence_(0),
     queue_([] (EventBinding* a, EventBinding* b) {
       return a->next_tick < b->next_tick;
     }),
-    listen_fd_(-1) {
+    monitor_request_(nullptr),
+    monitor_shutdown_(false),
+    start_time_(MonotonicClock::now()) {
   plugin_ctx_.plugin_map = &plugin_map_;
   LogfileSourcePlugin::registerPlugin(&plugin_map_);
-
-  if (pipe(wakeup_pipe_) < 0) {
+  GeneratorSourcePlugin::registerPlugin(&plugin_map_);
+  NullOutputPlugin::registerPlugin(&plugin_map_);
+  CounterOutputPlugin::registerPlugin(&plugin_map_);
+  FileOutputPlugin::registerPlugin(&plugin_map_);
+  StreamOutputPlugin::registerPlugin(&plugin_map_);
+
+  if (pipe(wakeup_pipe_) < 0 ||
+      pipe(monitor_pipe_) < 0 ||
+      pipe(monitor_stop_pipe_) < 0) {
     logFatal("pipe() failed");
     abort();
   }
 }
 
 ServiceImpl::~ServiceImpl() {
+  for (auto& binding : targets_) {
+    if (binding->queue) {
+      binding->queue->stop();
+    }
+  }
+
+  dumpHistograms();
+
+  monitor_.close();
+
+  /* the queues delivered everything they held when they were stopped */
+  acknowledgeEvents();
+
   for (auto& binding : event_bindings_) {
     for (auto& source : binding->sources) {
       source.plugin->pluginDetach(source.userdata);
@@ -134,15 +279,36 @@ ServiceImpl::~ServiceImpl() {
 
   close(wakeup_pipe_[0]);
   close(wakeup_pipe_[1]);
+  close(monitor_pipe_[0]);
+  close(monitor_pipe_[1]);
+  close(monitor_stop_pipe_[0]);
+  close(monitor_stop_pipe_[1]);
 }
 
 ReturnCode ServiceImpl::addEvent(const EventConfig* binding) {
   std::unique_ptr<EventBinding> ev_binding(new EventBinding());
-  ev_binding->event_name = binding->event_name;
+  ev_binding->event_id = EventNameTable::get()->intern(
+      binding->event_name,
+      &ev_binding->event_name);
   ev_binding->interval_micros = binding->interval_micros;
+  ev_binding->events_total = 0;
+  ev_binding->bytes_total = 0;
+  ev_binding->errors_total = 0;
+  ev_binding->paused = false;
+  ev_binding->tick_budget_events = binding->tick_budget_events;
+  ev_binding->tick_budget_bytes = binding->tick_budget_bytes;
+  ev_binding->tick_budget_micros = binding->tick_budget_micros;
+  ev_binding->backlogged = false;
+  ev_binding->budget_exhausted_total = 0;
 
   for (const auto& source : binding->sources) {
     EventSourceBinding ev_source;
+    ev_source.label = source.plugin_name;
+    if (!source.plugin_value.empty()) {
+      ev_source.label += " " + source.plugin_value;
+    }
+
+    ev_source.latency.reset(new LatencyHistogram());
     {
       auto rc = plugin_map_.getSourcePlugin(
           source.plugin_name,
@@ -163,7 +329,10 @@ ReturnCode ServiceImpl::addEvent(const EventConfig* binding) {
       }
     }
 
-    ev_binding->sources.emplace_back(ev_source);
+    ev_source.encoding = ev_source.plugin->pluginGetEncoding(
+        ev_source.userdata);
+
+    ev_binding->sources.emplace_back(std::move(ev_source));
   }
 
   ev_binding->next_tick = MonotonicClock::now() + ev_binding->interval_micros;
@@ -174,6 +343,7 @@ ReturnCode ServiceImpl::addEvent(const EventConfig* binding) {
 
 ReturnCode ServiceImpl::addTarget(const TargetConfig* binding) {
   std::unique_ptr<TargetBinding> trgt_binding(new TargetBinding());
+  trgt_binding->plugin_name = binding->plugin_name;
 
   {
     auto rc = plugin_map_.getOutputPlugin(
@@ -185,6 +355,9 @@ ReturnCode ServiceImpl::addTarget(const TargetConfig* binding) {
     }
   }
 
+  trgt_binding->accepts_msgpack =
+      trgt_binding->plugin->pluginAcceptsEncoding(EventEncoding::MSGPACK);
+
   {
     auto rc = trgt_binding->plugin->pluginAttach(
         binding->properties,
@@ -195,6 +368,32 @@ ReturnCode ServiceImpl::addTarget(const TargetConfig* binding) {
     }
   }
 
+  auto target_name = binding->plugin_value;
+  if (target_name.empty()) {
+    target_name = StringUtil::format(
+        "$0.$1",
+        binding->plugin_name,
+        targets_.size());
+  }
+
+  trgt_binding->queue.reset(
+      new DeliveryQueue(
+          target_name,
+          trgt_binding->plugin,
+          trgt_binding->userdata));
+
+  {
+    auto rc = trgt_binding->queue->configure(binding->properties, spool_dir_);
+    if (rc.isSuccess()) {
+      rc = trgt_binding->queue->start();
+    }
+
+    if (!rc.isSuccess()) {
+      trgt_binding->plugin->pluginDetach(trgt_binding->userdata);
+      return rc;
+    }
+  }
+
   targets_.emplace_back(std::move(trgt_binding));
   return ReturnCode::success();
 }
@@ -267,51 +466,145 @@ ReturnCode ServiceImpl::loadPlugin(bool (*init_fn)(evcollect_ctx_t* ctx)) {
 ReturnCode ServiceImpl::emitEvent(
     EventBinding* binding,
     uint64_t time,
-    const std::string& event_data) {
-  EventData evdata;
+    EventEncoding encoding,
+    std::string* event_data) {
+  event_batch_.emplace_back();
+  auto& evdata = event_batch_.back();
   evdata.time = time;
+  evdata.event_id = binding->event_id;
   evdata.event_name = binding->event_name;
-  evdata.event_data = event_data;
+  evdata.event_data = std::make_shared<const std::string>(
+      std::move(*event_data));
+  evdata.encoding = encoding;
+  evdata.sequence = ++last_sequence_;
+
+  if (encoding != EventEncoding::JSON) {
+    event_batch_has_msgpack_ = true;
+  }
+
+  binding->events_total.fetch_add(1, std::memory_order_relaxed);
+  binding->bytes_total.fetch_add(
+      evdata.event_data->size(),
+      std::memory_order_relaxed);
 
-  logDebug("EMIT: $0 => $1", evdata.event_name, evdata.event_data);
-  return deliverEvent(evdata);
+  logDebug(
+      "EMIT: $0 => $1",
+      evdata.event_name->c_str(),
+      evdata.event_data->c_str());
+
+  if (event_batch_.size() >= kMaxBatchSize) {
+    return deliverEvents();
+  } else {
+    return ReturnCode::success();
+  }
 }
 
-ReturnCode ServiceImpl::deliverEvent(const EventData& evdata) {
+ReturnCode ServiceImpl::deliverEvents() {
+  if (event_batch_.empty()) {
+    return ReturnCode::success();
+  }
+
   auto rc_aggr = ReturnCode::success();
+  bool converted = false;
   for (const auto& t : targets_) {
-    auto rc = t->plugin->pluginEmitEvent(t->userdata, evdata);
+    auto batch = &event_batch_;
+    if (event_batch_has_msgpack_ && !t->accepts_msgpack) {
+      if (!converted) {
+        convertEventBatch();
+        converted = true;
+      }
+
+      batch = &event_batch_json_;
+    }
+
+    auto t0 = MonotonicClock::now();
+    auto rc = t->queue->enqueueEvents(batch->data(), batch->size());
+
+    t->enqueue_latency.record(MonotonicClock::now() - t0);
+
     if (!rc.isSuccess()) {
       rc_aggr = rc;
     }
   }
 
+  event_batch_.clear();
+  event_batch_json_.clear();
+  event_batch_has_msgpack_ = false;
   return rc_aggr;
 }
 
+void ServiceImpl::acknowledgeEvents() {
+  auto acked = last_sequence_;
+  for (const auto& t : targets_) {
+    acked = std::min(acked, t->queue->getAcknowledgedSequence());
+  }
+
+  if (acked <= acked_sequence_) {
+    return;
+  }
+
+  acked_sequence_ = acked;
+  for (const auto& binding : event_bindings_) {
+    for (const auto& src : binding->sources) {
+      src.plugin->pluginAcknowledge(src.userdata, acked);
+    }
+  }
+}
+
+void ServiceImpl::convertEventBatch() {
+  event_batch_json_.clear();
+  event_batch_json_.reserve(event_batch_.size());
+
+  std::string json;
+  for (const auto& ev : event_batch_) {
+    if (ev.encoding == EventEncoding::JSON) {
+      event_batch_json_.emplace_back(ev);
+      continue;
+    }
+
+    json.clear();
+    if (!MsgPack::toJSON(*ev.event_data, &json)) {
+      logWarning("Dropping invalid MessagePack event '$0'", *ev.event_name);
+      continue;
+    }
+
+    event_batch_json_.emplace_back(ev);
+    auto& converted = event_batch_json_.back();
+    converted.event_data = std::make_shared<const std::string>(json);
+    converted.encoding = EventEncoding::JSON;
+  }
+}
+
 ReturnCode ServiceImpl::run() {
   if (queue_.size() == 0) {
     return ReturnCode::success();
   }
 
+  if (monitor_.getFD() >= 0) {
+    monitor_thread_ = std::thread(
+        std::bind(&ServiceImpl::runMonitorThread, this));
+  }
+
   while (true) {
     auto now = MonotonicClock::now();
     auto job = *queue_.begin();
-    auto sleep = job->next_tick - now;
+    uint64_t sleep = 0;
+    if (job->next_tick > now) {
+      sleep = job->next_tick - now;
+    }
 
     fd_set sleep_fdset;
     FD_ZERO(&sleep_fdset);
     FD_SET(wakeup_pipe_[0], &sleep_fdset);
-    if (listen_fd_ > 0) {
-      FD_SET(listen_fd_, &sleep_fdset);
-    }
+    FD_SET(monitor_pipe_[0], &sleep_fdset);
+    int max_fd = std::max(wakeup_pipe_[0], monitor_pipe_[0]);
 
     struct timeval sleep_tv;
     sleep_tv.tv_sec = sleep / 1000000;
     sleep_tv.tv_usec = sleep % 1000000;
 
     int select_rc = select(
-        wakeup_pipe_[0] + 1,
+        max_fd + 1,
         &sleep_fdset,
         NULL,
         NULL,
@@ -319,11 +612,26 @@ ReturnCode ServiceImpl::run() {
 
     if (select_rc > 0) {
       if (FD_ISSET(wakeup_pipe_[0], &sleep_fdset)) {
+        stopMonitorThread();
         return ReturnCode::success();
       }
-      if (listen_fd_ > 0 && FD_ISSET(listen_fd_, &sleep_fdset)) {
-        logInfo("Monitor attached");
-        continue;
+
+      /* execute the pending monitor command, then run the job if it is due
+         so that a stream of monitor requests can't hold back the ticks */
+      if (FD_ISSET(monitor_pipe_[0], &sleep_fdset)) {
+        char data;
+        if (read(monitor_pipe_[0], &data, 1) == 1) {
+          std::unique_lock<std::mutex> lk(monitor_mutex_);
+          if (monitor_request_) {
+            handleMonitorRequest(
+                monitor_request_->command,
+                &monitor_request_->response);
+
+            monitor_request_->done = true;
+            monitor_request_ = nullptr;
+            monitor_cv_.notify_all();
+          }
+        }
       }
     }
 
@@ -332,23 +640,37 @@ ReturnCode ServiceImpl::run() {
       continue;
     }
 
-    auto rc = processEvent(job);
+    /* how late the tick started compared to its schedule */
+    job->tick_lateness.record(now - job->next_tick);
+
+    auto rc = job->paused ? ReturnCode::success() : processEvent(job);
     if (!rc.isSuccess()) {
+      job->errors_total.fetch_add(1, std::memory_order_relaxed);
       logError(
           "Error while processing event '$0': $1",
-          job->event_name,
+          *job->event_name,
           rc.getMessage());
     }
 
+    acknowledgeEvents();
+
     queue_.erase(queue_.begin());
 
     now = MonotonicClock::now();
+    if (job->backlogged && !job->paused) {
+      /* continue reading the backlog once every other event that is due by
+         now had its tick (equal keys are inserted after existing ones) */
+      job->next_tick = now;
+      queue_.insert(job);
+      continue;
+    }
+
     job->next_tick = job->next_tick + job->interval_micros;
     if (job->next_tick < now) {
       logWarning(
           "Processing event '$0' took longer than the configured " \
           "interval, skipping samples",
-          job->event_name);
+          *job->event_name);
 
       job->next_tick = now;
     }
@@ -358,34 +680,77 @@ ReturnCode ServiceImpl::run() {
 }
 
 ReturnCode ServiceImpl::processEvent(EventBinding* binding) {
+  binding->backlogged = false;
   if (binding->sources.empty()) {
     return ReturnCode::success();
   }
 
   auto now = WallClock::unixMicros();
+  auto tick_start = MonotonicClock::now();
 
   std::string event_merged;
   std::string event_buf;
+  std::string merge_buf;
+  size_t emitted = 0;
+  uint64_t emitted_bytes = 0;
   for (bool cont = true; cont; ) {
     cont = false;
     event_merged.clear();
+    uint64_t event_time = 0;
 
     for (const auto& src : binding->sources) {
       event_buf.clear();
       {
+        auto t0 = MonotonicClock::now();
         auto rc = src.plugin->pluginGetNextEvent(
             src.userdata,
             &event_buf);
 
+        src.latency->record(MonotonicClock::now() - t0);
+
         if (!rc.isSuccess()) {
+          deliverEvents();
           return rc;
         }
       }
 
-      if (event_merged.empty()) {
-        event_merged = event_buf;
+      /* events from multiple sources are merged as JSON */
+      if (src.encoding == EventEncoding::MSGPACK &&
+          binding->sources.size() > 1 &&
+          !event_buf.empty()) {
+        merge_buf.clear();
+        if (MsgPack::toJSON(event_buf, &merge_buf)) {
+          event_buf.swap(merge_buf);
+        } else {
+          logWarning(
+              "Dropping invalid MessagePack event from '$0'",
+              src.label);
+
+          binding->errors_total.fetch_add(1, std::memory_order_relaxed);
+          event_buf.clear();
+        }
+      }
+
+      /* merged events take the time of the first source that has one */
+      uint64_t source_time;
+      if (!event_buf.empty() &&
+          event_time == 0 &&
+          src.plugin->pluginGetEventTime(src.userdata, &source_time)) {
+        event_time = source_time;
+      }
+
+      if (event_buf.empty()) {
+        /* source has no event for this round */
+      } else if (event_merged.empty()) {
+        event_merged.swap(event_buf);
+      } else if (event_merger_.merge(event_merged, event_buf, &merge_buf)) {
+        event_merged.swap(merge_buf);
       } else {
-        event_merged = mergeEvents(event_merged, event_buf);
+        logWarning(
+            "Can't merge events for '$0': not a JSON object",
+            *binding->event_name);
+
+        event_merged.swap(event_buf);
       }
 
       if (src.plugin->pluginHasPendingEvent(src.userdata)) {
@@ -394,14 +759,554 @@ ReturnCode ServiceImpl::processEvent(EventBinding* binding) {
     }
 
     if (!event_merged.empty()) {
-      auto rc = emitEvent(binding, now, event_merged);
+      auto encoding = binding->sources.size() == 1 ?
+          binding->sources[0].encoding :
+          EventEncoding::JSON;
+
+      emitted_bytes += event_merged.size();
+      auto rc = emitEvent(
+          binding,
+          event_time ? event_time : now,
+          encoding,
+          &event_merged);
       if (!rc.isSuccess()) {
+        event_batch_.clear();
+        event_batch_has_msgpack_ = false;
         return rc;
       }
+
+      if (++emitted % kMaxBatchSize == 0) {
+        markSourcePositions(binding);
+      }
+    }
+
+    /* yield to the other events if the sources have a backlog that exceeds
+       the tick budget */
+    if (cont &&
+        ((binding->tick_budget_events &&
+          emitted >= binding->tick_budget_events) ||
+         (binding->tick_budget_bytes &&
+          emitted_bytes >= binding->tick_budget_bytes) ||
+         (binding->tick_budget_micros &&
+          MonotonicClock::now() - tick_start >=
+              binding->tick_budget_micros))) {
+      binding->backlogged = true;
+      binding->budget_exhausted_total.fetch_add(1, std::memory_order_relaxed);
+      break;
     }
   }
 
-  return ReturnCode::success();
+  auto rc = deliverEvents();
+  markSourcePositions(binding);
+  return rc;
+}
+
+void ServiceImpl::markSourcePositions(EventBinding* binding) {
+  for (const auto& src : binding->sources) {
+    src.plugin->pluginMarkPosition(src.userdata, last_sequence_);
+  }
+}
+
+ReturnCode ServiceImpl::listenMonitor(const std::string& socket_path) {
+  auto rc = monitor_.listen(socket_path);
+  if (rc.isSuccess()) {
+    logInfo("Monitor listening on $0", socket_path);
+  }
+
+  return rc;
+}
+
+void ServiceImpl::runMonitorThread() {
+  int monitor_fd = monitor_.getFD();
+  int max_fd = std::max(monitor_fd, monitor_stop_pipe_[0]);
+
+  while (true) {
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(monitor_fd, &fdset);
+    FD_SET(monitor_stop_pipe_[0], &fdset);
+
+    int select_rc = select(max_fd + 1, &fdset, NULL, NULL, NULL);
+    if (select_rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      logError("select() failed in monitor thread: $0", strerror(errno));
+      return;
+    }
+
+    if (FD_ISSET(monitor_stop_pipe_[0], &fdset)) {
+      return;
+    }
+
+    auto rc = monitor_.handleConnection(
+        std::bind(
+            &ServiceImpl::serveMonitorRequest,
+            this,
+            std::placeholders::_1,
+            std::placeholders::_2));
+
+    if (!rc.isSuccess()) {
+      logWarning("Error while handling monitor request: $0", rc.getMessage());
+    }
+  }
+}
+
+void ServiceImpl::stopMonitorThread() {
+  {
+    std::unique_lock<std::mutex> lk(monitor_mutex_);
+    monitor_shutdown_ = true;
+    if (monitor_request_) {
+      monitor_request_->response = "error: shutting down";
+      monitor_request_->done = true;
+      monitor_request_ = nullptr;
+      monitor_cv_.notify_all();
+    }
+  }
+
+  if (monitor_thread_.joinable()) {
+    char data = 0;
+    int rc = write(monitor_stop_pipe_[1], &data, 1);
+    (void) rc;
+    monitor_thread_.join();
+  }
+}
+
+void ServiceImpl::serveMonitorRequest(
+    const std::string& command,
+    std::string* response) {
+  MonitorRequest request;
+  request.command = command;
+  request.done = false;
+
+  {
+    std::unique_lock<std::mutex> lk(monitor_mutex_);
+    if (monitor_shutdown_) {
+      *response = "error: shutting down";
+      return;
+    }
+
+    monitor_request_ = &request;
+    char data = 0;
+    if (write(monitor_pipe_[1], &data, 1) != 1) {
+      monitor_request_ = nullptr;
+      *response = "error: write() failed";
+      return;
+    }
+
+    while (!request.done) {
+      monitor_cv_.wait(lk);
+    }
+  }
+
+  /* the run() loop handed all emitted events to the delivery queues; wait
+     until they are delivered without blocking the sources */
+  if (request.command == "flush" && request.response == "ok") {
+    auto rc = flushTargets();
+    if (!rc.isSuccess()) {
+      request.response = "error: " + rc.getMessage();
+    }
+  }
+
+  response->swap(request.response);
+}
+
+void ServiceImpl::handleMonitorRequest(
+    const std::string& command,
+    std::string* response) {
+  auto args = StringUtil::split(command, " ");
+  args.erase(
+      std::remove(args.begin(), args.end(), std::string()),
+      args.end());
+
+  if (args.empty()) {
+    *response = "error: empty command";
+    return;
+  }
+
+  auto rc = ReturnCode::success();
+  if (args[0] == "stats") {
+    getStats(response);
+  } else if (args[0] == "top") {
+    getTop(response);
+  } else if (args[0] == "queues") {
+    getQueues(response);
+  } else if (args[0] == "list") {
+    getBindings(response);
+  } else if (args[0] == "checkpoint") {
+    rc = checkpoint();
+  } else if (args[0] == "flush") {
+    rc = deliverEvents();
+  } else if (args[0] == "pause") {
+    rc = setPaused(args, true);
+  } else if (args[0] == "resume") {
+    rc = setPaused(args, false);
+  } else {
+    rc = ReturnCode::error("EINVAL", "unknown command: %s", args[0].c_str());
+  }
+
+  if (!rc.isSuccess()) {
+    *response = "error: " + rc.getMessage();
+  } else if (response->empty()) {
+    *response = "ok";
+  }
+}
+
+void ServiceImpl::getStats(std::string* json) {
+  /* user supplied names are always the last format argument so that a '$n'
+   * in a name can't be mistaken for a placeholder */
+  auto now = MonotonicClock::now();
+
+  *json = StringUtil::format(
+      R"({ "uptime": $0, "events": [)",
+      (now - start_time_) / kMicrosPerSecond);
+
+  for (size_t i = 0; i < event_bindings_.size(); ++i) {
+    auto& binding = event_bindings_[i];
+    auto events_total = binding->events_total.load(std::memory_order_relaxed);
+
+    /* the rate is computed over the interval since the last stats request */
+    auto rate = binding->rate.update(events_total, now);
+
+    if (i > 0) {
+      *json += ",";
+    }
+
+    *json += StringUtil::format(
+        R"({ "name": "$7", "paused": $4, "events_total": $0, )"
+        R"("events_per_sec": $1, "bytes_total": $2, "errors_total": $3, )"
+        R"("budget_exhausted": $6, "tick_lateness": $5, "sources": [)",
+        events_total,
+        uint64_t(rate),
+        binding->bytes_total.load(std::memory_order_relaxed),
+        binding->errors_total.load(std::memory_order_relaxed),
+        binding->paused ? "true" : "false",
+        binding->tick_lateness.toJSON(),
+        binding->budget_exhausted_total.load(std::memory_order_relaxed),
+        StringUtil::jsonEscape(*binding->event_name));
+
+    for (size_t j = 0; j < binding->sources.size(); ++j) {
+      const auto& src = binding->sources[j];
+
+      PluginStats plugin_stats;
+      src.plugin->pluginGetStats(src.userdata, &plugin_stats);
+
+      if (j > 0) {
+        *json += ",";
+      }
+
+      *json += StringUtil::format(
+          R"({ "source": "$1", "latency": $0)",
+          src.latency->toJSON(),
+          StringUtil::jsonEscape(src.label));
+
+      for (const auto& s : plugin_stats) {
+        *json += StringUtil::format(
+            R"(, "$1": $0)",
+            s.second,
+            StringUtil::jsonEscape(s.first));
+      }
+
+      *json += " }";
+    }
+
+    *json += "] }";
+  }
+
+  *json += R"(], "targets": [)";
+
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    const auto& queue = targets_[i]->queue;
+    auto delivered = queue->getDeliveredCount();
+    auto rate = targets_[i]->rate.update(delivered, now);
+
+    if (i > 0) {
+      *json += ",";
+    }
+
+    *json += StringUtil::format(
+        R"({ "name": "$9", "paused": $8, "queue_length": $0, )"
+        R"("queue_capacity": $1, "delivered_events": $2, )"
+        R"("events_per_sec": $3, "delivered_bytes": $4, "dropped": $5, )"
+        R"("retries": $6, "failed": $7, )",
+        queue->getLength(),
+        queue->getCapacity(),
+        delivered,
+        uint64_t(rate),
+        queue->getDeliveredBytes(),
+        queue->getDroppedCount(),
+        queue->getRetryCount(),
+        queue->getFailedCount(),
+        queue->isPaused() ? "true" : "false",
+        StringUtil::jsonEscape(queue->getName()));
+
+    *json += StringUtil::format(
+        R"("spilled_bytes": $0, "latency": $1, "enqueue_latency": $2 })",
+        queue->getSpilledBytes(),
+        queue->getDeliveryLatency().toJSON(),
+        targets_[i]->enqueue_latency.toJSON());
+  }
+
+  *json += R"(], "histograms": {)";
+
+  std::vector<std::pair<std::string, const LatencyHistogram*>> histograms;
+  HistogramRegistry::get()->listHistograms(&histograms);
+  for (size_t i = 0; i < histograms.size(); ++i) {
+    if (i > 0) {
+      *json += ",";
+    }
+
+    *json += StringUtil::format(
+        R"( "$1": $0)",
+        histograms[i].second->toJSON(),
+        StringUtil::jsonEscape(histograms[i].first));
+  }
+
+  *json += " } }";
+}
+
+void ServiceImpl::getTop(std::string* out) {
+  auto now = MonotonicClock::now();
+  char line[256];
+
+  snprintf(
+      line,
+      sizeof(line),
+      "%-32s %10s %12s %8s %10s %10s %10s  %s\n",
+      "EVENT",
+      "EVENTS/S",
+      "TOTAL",
+      "ERRORS",
+      "SRC_P50",
+      "SRC_P99",
+      "LATE_P99",
+      "STATE");
+  *out += line;
+
+  for (auto& binding : event_bindings_) {
+    auto events_total = binding->events_total.load(std::memory_order_relaxed);
+    auto rate = binding->rate.update(events_total, now);
+
+    /* the latencies of all sources of an event are merged */
+    LatencyHistogram::Snapshot src_latency;
+    for (const auto& src : binding->sources) {
+      src_latency.merge(src.latency->getSnapshot());
+    }
+
+    snprintf(
+        line,
+        sizeof(line),
+        "%-32s %10.1f %12llu %8llu %8lluus %8lluus %8lluus  %s\n",
+        binding->event_name->c_str(),
+        rate,
+        (unsigned long long) events_total,
+        (unsigned long long) binding->errors_total.load(),
+        (unsigned long long) src_latency.getPercentile(0.5),
+        (unsigned long long) src_latency.getPercentile(0.99),
+        (unsigned long long) binding->tick_lateness.getPercentile(0.99),
+        binding->paused ? "paused" : "running");
+    *out += line;
+  }
+
+  snprintf(
+      line,
+      sizeof(line),
+      "\n%-32s %10s %12s %8s %10s %10s  %s\n",
+      "TARGET",
+      "EVENTS/S",
+      "QUEUE",
+      "DROPPED",
+      "P50",
+      "P99",
+      "STATE");
+  *out += line;
+
+  for (auto& target : targets_) {
+    const auto& queue = target->queue;
+    auto rate = target->rate.update(queue->getDeliveredCount(), now);
+    const auto& latency = queue->getDeliveryLatency();
+
+    snprintf(
+        line,
+        sizeof(line),
+        "%-32s %10.1f %12llu %8llu %8lluus %8lluus  %s\n",
+        queue->getName().c_str(),
+        rate,
+        (unsigned long long) queue->getLength(),
+        (unsigned long long) queue->getDroppedCount(),
+        (unsigned long long) latency.getPercentile(0.5),
+        (unsigned long long) latency.getPercentile(0.99),
+        queue->isPaused() ? "paused" : "running");
+    *out += line;
+  }
+}
+
+void ServiceImpl::getQueues(std::string* out) {
+  char line[256];
+
+  snprintf(
+      line,
+      sizeof(line),
+      "%-32s %10s %10s %10s %10s %14s %10s %10s %10s\n",
+      "TARGET",
+      "LENGTH",
+      "CAPACITY",
+      "HIGH_WM",
+      "LOW_WM",
+      "SPILLED_BYTES",
+      "DROPPED",
+      "RETRIES",
+      "FAILED");
+  *out += line;
+
+  for (const auto& target : targets_) {
+    const auto& queue = target->queue;
+    snprintf(
+        line,
+        sizeof(line),
+        "%-32s %10llu %10llu %10llu %10llu %14llu %10llu %10llu %10llu\n",
+        queue->getName().c_str(),
+        (unsigned long long) queue->getLength(),
+        (unsigned long long) queue->getCapacity(),
+        (unsigned long long) queue->getHighWatermark(),
+        (unsigned long long) queue->getLowWatermark(),
+        (unsigned long long) queue->getSpilledBytes(),
+        (unsigned long long) queue->getDroppedCount(),
+        (unsigned long long) queue->getRetryCount(),
+        (unsigned long long) queue->getFailedCount());
+    *out += line;
+  }
+}
+
+void ServiceImpl::getBindings(std::string* out) {
+  for (const auto& binding : event_bindings_) {
+    *out += StringUtil::format(
+        "event $2 interval $0ms$1\n",
+        binding->interval_micros / kMicrosPerMilli,
+        binding->paused ? " (paused)" : "",
+        *binding->event_name);
+
+    for (const auto& src : binding->sources) {
+      *out += "  source " + src.label + "\n";
+    }
+  }
+
+  for (const auto& target : targets_) {
+    *out += "output " + target->queue->getName();
+    *out += " plugin " + target->plugin_name;
+    *out += target->queue->isPaused() ? " (paused)\n" : "\n";
+  }
+}
+
+ReturnCode ServiceImpl::checkpoint() {
+  acknowledgeEvents();
+
+  auto rc_aggr = ReturnCode::success();
+  for (const auto& binding : event_bindings_) {
+    for (const auto& src : binding->sources) {
+      auto rc = src.plugin->pluginCheckpoint(src.userdata);
+      if (!rc.isSuccess()) {
+        logWarning(
+            "Error while writing checkpoint for '$0': $1",
+            src.label,
+            rc.getMessage());
+        rc_aggr = rc;
+      }
+    }
+  }
+
+  return rc_aggr;
+}
+
+ReturnCode ServiceImpl::flushTargets() {
+  auto rc_aggr = ReturnCode::success();
+  for (const auto& target : targets_) {
+    auto rc = target->queue->flush(kFlushTimeoutMicros);
+    if (!rc.isSuccess()) {
+      rc_aggr = rc;
+    }
+  }
+
+  return rc_aggr;
+}
+
+void ServiceImpl::dumpHistograms() {
+  for (const auto& binding : event_bindings_) {
+    logInfo(
+        "Latency for event '$0' (tick lateness): $1",
+        *binding->event_name,
+        binding->tick_lateness.getSnapshot().toString());
+
+    for (const auto& src : binding->sources) {
+      logInfo(
+          "Latency for event '$0' (source $1): $2",
+          *binding->event_name,
+          src.label,
+          src.latency->getSnapshot().toString());
+    }
+  }
+
+  for (const auto& target : targets_) {
+    logInfo(
+        "Latency for target '$0' (enqueue): $1",
+        target->queue->getName(),
+        target->enqueue_latency.getSnapshot().toString());
+
+    logInfo(
+        "Latency for target '$0' (delivery): $1",
+        target->queue->getName(),
+        target->queue->getDeliveryLatency().getSnapshot().toString());
+  }
+
+  std::vector<std::pair<std::string, const LatencyHistogram*>> histograms;
+  HistogramRegistry::get()->listHistograms(&histograms);
+  for (const auto& h : histograms) {
+    logInfo(
+        "Latency for '$0': $1",
+        h.first,
+        h.second->getSnapshot().toString());
+  }
+}
+
+ReturnCode ServiceImpl::setPaused(
+    const std::vector<std::string>& args,
+    bool paused) {
+  if (args.size() != 3 || (args[1] != "event" && args[1] != "target")) {
+    return ReturnCode::error(
+        "EINVAL",
+        "usage: %s {event|target} <name>",
+        args[0].c_str());
+  }
+
+  const auto& name = args[2];
+  if (args[1] == "event") {
+    for (auto& binding : event_bindings_) {
+      if (*binding->event_name == name) {
+        if (binding->paused != paused) {
+          logInfo("Event '$0' $1", name, paused ? "paused" : "resumed");
+        }
+
+        binding->paused = paused;
+        return ReturnCode::success();
+      }
+    }
+
+    return ReturnCode::error("ENOTFOUND", "no such event: %s", name.c_str());
+  }
+
+  for (auto& target : targets_) {
+    if (target->queue->getName() == name) {
+      if (paused) {
+        return target->queue->pause();
+      } else {
+        target->queue->resume();
+        return ReturnCode::success();
+      }
+    }
+  }
+
+  return ReturnCode::error("ENOTFOUND", "no such target: %s", name.c_str());
 }
 
 void ServiceImpl::kill() {
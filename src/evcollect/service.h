@@ -46,6 +46,12 @@ public:
   virtual ReturnCode loadPlugin(const std::string& plugin) = 0;
   virtual ReturnCode loadPlugin(bool (*init_fn)(evcollect_ctx_t* ctx)) = 0;
 
+  /**
+   * Serve the monitor protocol on a unix socket at the provided path. Requests
+   * are handled from the run() loop
+   */
+  virtual ReturnCode listenMonitor(const std::string& socket_path) = 0;
+
   virtual ReturnCode run() = 0;
   virtual void kill() = 0;
 
@@ -0,0 +1,475 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <evcollect/stream_output.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+#include <evcollect/util/time.h>
+
+namespace evcollect {
+
+namespace {
+
+enum class StreamFraming { NEWLINE, LENGTH };
+
+/* max number of iovecs per sendmsg call */
+const size_t kMaxIovecs = 1024;
+
+struct StreamTarget {
+  std::string address;
+  bool is_unix;
+  std::string host;
+  std::string port;
+  std::string path;
+  StreamFraming framing;
+  uint64_t write_timeout_ms;
+  uint64_t backoff_min_micros;
+  uint64_t backoff_max_micros;
+  uint64_t backoff_micros;
+  uint64_t next_connect;
+  int fd;
+  std::string headers;
+  std::vector<size_t> header_offsets;
+  std::vector<struct iovec> iov;
+};
+
+ReturnCode parseAddress(StreamTarget* target) {
+  const auto& addr = target->address;
+
+  if (StringUtil::beginsWith(addr, "unix://")) {
+    target->is_unix = true;
+    target->path = addr.substr(7);
+    if (target->path.size() >= sizeof(sockaddr_un::sun_path)) {
+      return ReturnCode::error("EINVAL", "socket path too long");
+    }
+
+    return ReturnCode::success();
+  }
+
+  if (StringUtil::beginsWith(addr, "tcp://")) {
+    auto hostport = addr.substr(6);
+    auto sep = hostport.rfind(':');
+    if (sep == std::string::npos || sep == 0 || sep + 1 == hostport.size()) {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid address '%s'; expected tcp://<host>:<port>",
+          addr.c_str());
+    }
+
+    target->is_unix = false;
+    target->host = hostport.substr(0, sep);
+    target->port = hostport.substr(sep + 1);
+    return ReturnCode::success();
+  }
+
+  return ReturnCode::error(
+      "EINVAL",
+      "invalid address '%s'; must start with tcp:// or unix://",
+      addr.c_str());
+}
+
+void disconnect(StreamTarget* target) {
+  if (target->fd >= 0) {
+    close(target->fd);
+    target->fd = -1;
+  }
+}
+
+ReturnCode waitWritable(StreamTarget* target) {
+  struct pollfd p;
+  p.fd = target->fd;
+  p.events = POLLOUT;
+
+  for (;;) {
+    auto rc = poll(&p, 1, target->write_timeout_ms);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (rc < 0) {
+      return ReturnCode::error("IOERR", "poll() failed: %s", strerror(errno));
+    }
+
+    if (rc == 0) {
+      return ReturnCode::error(
+          "ETIMEOUT",
+          "timeout while writing to %s",
+          target->address.c_str());
+    }
+
+    return ReturnCode::success();
+  }
+}
+
+ReturnCode connectSocket(
+    StreamTarget* target,
+    int family,
+    const struct sockaddr* addr,
+    socklen_t addr_len) {
+  target->fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (target->fd < 0) {
+    return ReturnCode::error("IOERR", "socket() failed: %s", strerror(errno));
+  }
+
+  if (connect(target->fd, addr, addr_len) < 0) {
+    if (errno != EINPROGRESS) {
+      return ReturnCode::error(
+          "IOERR",
+          "connect(%s) failed: %s",
+          target->address.c_str(),
+          strerror(errno));
+    }
+
+    auto rc = waitWritable(target);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    getsockopt(target->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+    if (err != 0) {
+      return ReturnCode::error(
+          "IOERR",
+          "connect(%s) failed: %s",
+          target->address.c_str(),
+          strerror(err));
+    }
+  }
+
+  if (family != AF_UNIX) {
+    int nodelay = 1;
+    setsockopt(target->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  }
+
+  return ReturnCode::success();
+}
+
+ReturnCode tryConnect(StreamTarget* target) {
+  if (target->is_unix) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, target->path.c_str(), sizeof(addr.sun_path) - 1);
+    return connectSocket(
+        target,
+        AF_UNIX,
+        (const struct sockaddr*) &addr,
+        sizeof(addr));
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* res;
+  auto gai_rc = getaddrinfo(
+      target->host.c_str(),
+      target->port.c_str(),
+      &hints,
+      &res);
+
+  if (gai_rc != 0) {
+    return ReturnCode::error(
+        "IOERR",
+        "can't resolve %s: %s",
+        target->host.c_str(),
+        gai_strerror(gai_rc));
+  }
+
+  auto rc = ReturnCode::error("IOERR", "no address for %s", target->host.c_str());
+  for (auto ai = res; ai; ai = ai->ai_next) {
+    rc = connectSocket(target, ai->ai_family, ai->ai_addr, ai->ai_addrlen);
+    if (rc.isSuccess()) {
+      break;
+    }
+
+    disconnect(target);
+  }
+
+  freeaddrinfo(res);
+  return rc;
+}
+
+/**
+ * Make sure we have a live connection. A peer that closed the connection
+ * while we were idle is only noticed after the next write would have
+ * succeeded, so check for EOF before sending a batch
+ */
+ReturnCode ensureConnected(StreamTarget* target) {
+  if (target->fd >= 0) {
+    char c;
+    auto rc = recv(target->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (rc > 0 || (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+      return ReturnCode::success();
+    }
+
+    logWarning("Connection to $0 closed, reconnecting", target->address);
+    disconnect(target);
+  }
+
+  auto now = MonotonicClock::now();
+  if (now < target->next_connect) {
+    usleep(target->next_connect - now);
+  }
+
+  auto rc = tryConnect(target);
+  if (!rc.isSuccess()) {
+    disconnect(target);
+    target->next_connect = MonotonicClock::now() + target->backoff_micros;
+    target->backoff_micros = std::min(
+        target->backoff_micros * 2,
+        target->backoff_max_micros);
+    return rc;
+  }
+
+  logInfo("Connected to $0", target->address);
+  target->backoff_micros = target->backoff_min_micros;
+  target->next_connect = 0;
+  return ReturnCode::success();
+}
+
+/**
+ * Send all iovecs, resuming partial writes in place
+ */
+ReturnCode sendAll(StreamTarget* target, struct iovec* iov, size_t iov_count) {
+  while (iov_count > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = std::min(iov_count, kMaxIovecs);
+
+    auto rc = sendmsg(target->fd, &msg, MSG_NOSIGNAL);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        auto wait_rc = waitWritable(target);
+        if (!wait_rc.isSuccess()) {
+          return wait_rc;
+        }
+
+        continue;
+      }
+
+      return ReturnCode::error(
+          "IOERR",
+          "sendmsg(%s) failed: %s",
+          target->address.c_str(),
+          strerror(errno));
+    }
+
+    /* skip the iovecs that were written completely, then advance into the
+       one that was written partially */
+    size_t written = rc;
+    while (iov_count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --iov_count;
+    }
+
+    if (written > 0) {
+      iov->iov_base = (char*) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return ReturnCode::success();
+}
+
+} // namespace
+
+void StreamOutputPlugin::registerPlugin(PluginMap* plugin_map) {
+  plugin_map->registerOutputPlugin(
+      "stream",
+      std::unique_ptr<OutputPlugin>(new StreamOutputPlugin()));
+}
+
+ReturnCode StreamOutputPlugin::pluginAttach(
+    const PropertyList& config,
+    void** userdata) {
+  std::unique_ptr<StreamTarget> target(new StreamTarget());
+  target->framing = StreamFraming::NEWLINE;
+  target->write_timeout_ms = kDefaultWriteTimeoutMillis;
+  target->next_connect = 0;
+  target->fd = -1;
+
+  if (!config.get("address", &target->address)) {
+    return ReturnCode::error("EINVAL", "stream output needs an address");
+  }
+
+  {
+    auto rc = parseAddress(target.get());
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  std::string framing;
+  if (config.get("framing", &framing)) {
+    if (framing == "newline") {
+      target->framing = StreamFraming::NEWLINE;
+    } else if (framing == "length") {
+      target->framing = StreamFraming::LENGTH;
+    } else {
+      return ReturnCode::error(
+          "EINVAL",
+          "invalid framing '%s'; must be one of newline, length",
+          framing.c_str());
+    }
+  }
+
+  uint64_t backoff_min = kDefaultReconnectBackoffMinMillis;
+  uint64_t backoff_max = kDefaultReconnectBackoffMaxMillis;
+
+  std::vector<std::pair<std::string, uint64_t*>> options = {
+    { "write_timeout", &target->write_timeout_ms },
+    { "reconnect_backoff_min", &backoff_min },
+    { "reconnect_backoff_max", &backoff_max },
+  };
+
+  for (const auto& opt : options) {
+    auto rc = config.getUInt(opt.first, opt.second);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  target->backoff_min_micros = backoff_min * kMicrosPerMilli;
+  target->backoff_max_micros = std::max(backoff_max, backoff_min) *
+      kMicrosPerMilli;
+  target->backoff_micros = target->backoff_min_micros;
+
+  *userdata = target.release();
+  return ReturnCode::success();
+}
+
+void StreamOutputPlugin::pluginDetach(void* userdata) {
+  auto target = static_cast<StreamTarget*>(userdata);
+  disconnect(target);
+  delete target;
+}
+
+ReturnCode StreamOutputPlugin::pluginEmitEvent(
+    void* userdata,
+    const EventData& evdata) {
+  return pluginEmitEvents(userdata, &evdata, 1);
+}
+
+ReturnCode StreamOutputPlugin::pluginEmitEvents(
+    void* userdata,
+    const EventData* events,
+    size_t events_count) {
+  auto target = static_cast<StreamTarget*>(userdata);
+
+  {
+    auto rc = ensureConnected(target);
+    if (!rc.isSuccess()) {
+      return rc;
+    }
+  }
+
+  static const char kNewlineTrailer[] = "}\n";
+  static const char kLengthTrailer[] = "}";
+  const char* trailer;
+  size_t trailer_len;
+  if (target->framing == StreamFraming::NEWLINE) {
+    trailer = kNewlineTrailer;
+    trailer_len = sizeof(kNewlineTrailer) - 1;
+  } else {
+    trailer = kLengthTrailer;
+    trailer_len = sizeof(kLengthTrailer) - 1;
+  }
+
+  /* build the per-event headers first; the iovecs can only point into the
+     header buffer once it no longer reallocates */
+  auto& headers = target->headers;
+  auto& header_offsets = target->header_offsets;
+  headers.clear();
+  header_offsets.clear();
+  for (size_t i = 0; i < events_count; ++i) {
+    const auto& ev = events[i];
+    header_offsets.emplace_back(headers.size());
+
+    size_t length_pos = headers.size();
+    if (target->framing == StreamFraming::LENGTH) {
+      headers.append(sizeof(uint32_t), '\0');
+    }
+
+    headers += "{\"time\":";
+    headers += std::to_string(ev.time);
+    headers += ",\"event\":\"";
+    headers += StringUtil::jsonEscape(*ev.event_name);
+    headers += "\",\"data\":";
+
+    if (target->framing == StreamFraming::LENGTH) {
+      uint32_t len = htonl(
+          headers.size() - length_pos - sizeof(uint32_t) +
+          ev.event_data->size() +
+          trailer_len);
+
+      memcpy(&headers[length_pos], &len, sizeof(len));
+    }
+  }
+
+  header_offsets.emplace_back(headers.size());
+
+  auto& iov = target->iov;
+  iov.clear();
+  for (size_t i = 0; i < events_count; ++i) {
+    const auto& data = *events[i].event_data;
+    iov.push_back({
+        &headers[header_offsets[i]],
+        header_offsets[i + 1] - header_offsets[i] });
+    iov.push_back({ (void*) data.data(), data.size() });
+    iov.push_back({ (void*) trailer, trailer_len });
+  }
+
+  auto rc = sendAll(target, iov.data(), iov.size());
+  if (!rc.isSuccess()) {
+    /* we don't know how much of the batch the peer got, so start over on a
+       new connection when the batch is retried */
+    disconnect(target);
+  }
+
+  return rc;
+}
+
+} // namespace evcollect
+
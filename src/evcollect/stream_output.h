@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <string>
+#include <evcollect/evcollect.h>
+#include <evcollect/plugin.h>
+
+namespace evcollect {
+
+/**
+ * Streams events over a persistent TCP or unix domain socket connection,
+ * e.g. to a local relay. Every event is sent as
+ *
+ *   {"time":<micros>,"event":"<event name>","data":<event json>}
+ *
+ * either terminated by a newline (framing newline) or preceded by its length
+ * as a 32 bit big endian integer (framing length). A batch is sent with a
+ * single sendmsg call whose iovecs point into the event payloads, so the
+ * payloads are never copied.
+ *
+ * If the connection fails, the batch fails and the delivery queue retries it
+ * (see delivery_max_retries); reconnects are spaced out with an exponential
+ * backoff.
+ *
+ * Options:
+ *   address                 tcp://<host>:<port> or unix://<path> (required)
+ *   framing                 "newline" (default) or "length"
+ *   write_timeout           milliseconds to wait for a connect or for the
+ *                           socket to become writable (default 10000)
+ *   reconnect_backoff_min   initial reconnect backoff in ms (default 100)
+ *   reconnect_backoff_max   maximum reconnect backoff in ms (default 30000)
+ */
+class StreamOutputPlugin : public OutputPlugin {
+public:
+
+  static void registerPlugin(PluginMap* plugin_map);
+
+  static const uint64_t kDefaultWriteTimeoutMillis = 10000;
+  static const uint64_t kDefaultReconnectBackoffMinMillis = 100;
+  static const uint64_t kDefaultReconnectBackoffMaxMillis = 30000;
+
+  ReturnCode pluginAttach(
+      const PropertyList& config,
+      void** userdata) override;
+
+  void pluginDetach(
+      void* userdata) override;
+
+  ReturnCode pluginEmitEvent(
+      void* userdata,
+      const EventData& evdata) override;
+
+  ReturnCode pluginEmitEvents(
+      void* userdata,
+      const EventData* events,
+      size_t events_count) override;
+
+};
+
+} // namespace evcollect
+
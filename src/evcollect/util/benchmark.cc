@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdio.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <algorithm>
+#include <evcollect/util/benchmark.h>
+#include <evcollect/util/flagparser.h>
+#include <evcollect/util/logging.h>
+#include <evcollect/util/stringutil.h>
+
+namespace benchmark {
+
+static const uint64_t kNanosPerSecond = 1000000000;
+static const uint64_t kMaxIterations = 1000000000;
+
+static uint64_t getMonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * kNanosPerSecond + ts.tv_nsec;
+}
+
+int main(int argc, const char* argv[]) {
+  return BenchmarkRunner::instance()->main(argc, argv);
+}
+
+State::State(
+    uint64_t max_iterations) :
+    max_iterations_(max_iterations),
+    iterations_(0),
+    elapsed_nanos_(0),
+    timer_start_(0),
+    timer_running_(false),
+    bytes_per_iteration_(0) {}
+
+void State::pauseTiming() {
+  if (timer_running_) {
+    elapsed_nanos_ += getMonotonicNanos() - timer_start_;
+    timer_running_ = false;
+  }
+}
+
+void State::resumeTiming() {
+  if (!timer_running_) {
+    timer_start_ = getMonotonicNanos();
+    timer_running_ = true;
+  }
+}
+
+void State::setBytesPerIteration(uint64_t bytes) {
+  bytes_per_iteration_ = bytes;
+}
+
+void State::skipWithError(const std::string& message) {
+  error_ = message;
+  max_iterations_ = 0;
+  pauseTiming();
+}
+
+uint64_t State::getIterations() const {
+  return iterations_;
+}
+
+uint64_t State::getElapsedNanos() const {
+  return elapsed_nanos_;
+}
+
+uint64_t State::getBytesPerIteration() const {
+  return bytes_per_iteration_;
+}
+
+const std::string& State::getError() const {
+  return error_;
+}
+
+BenchmarkRunner* BenchmarkRunner::instance() {
+  static BenchmarkRunner runner;
+  return &runner;
+}
+
+BenchmarkInfo* BenchmarkRunner::addBenchmark(
+    const char* benchmark_case,
+    const char* benchmark_name,
+    BenchmarkFn fn) {
+  std::unique_ptr<BenchmarkInfo> benchmark(new BenchmarkInfo());
+  benchmark->name = StringUtil::format("$0.$1", benchmark_case, benchmark_name);
+  benchmark->fn = fn;
+  benchmarks_.emplace_back(std::move(benchmark));
+  return benchmarks_.back().get();
+}
+
+BenchmarkResult BenchmarkRunner::runBenchmark(
+    const BenchmarkInfo& benchmark,
+    uint64_t min_time_nanos) {
+  BenchmarkResult result;
+  result.name = benchmark.name;
+
+  for (uint64_t iterations = 1; ; ) {
+    State state(iterations);
+    benchmark.fn(state);
+
+    if (!state.getError().empty()) {
+      result.iterations = 0;
+      result.nanos_per_op = 0;
+      result.bytes_per_second = 0;
+      result.error = state.getError();
+      return result;
+    }
+
+    auto elapsed = state.getElapsedNanos();
+    if (elapsed >= min_time_nanos || iterations >= kMaxIterations) {
+      result.iterations = state.getIterations();
+      result.nanos_per_op = double(elapsed) / std::max(result.iterations, uint64_t(1));
+      result.bytes_per_second = elapsed > 0 ?
+          double(state.getBytesPerIteration()) * result.iterations *
+              kNanosPerSecond / elapsed :
+          0;
+      return result;
+    }
+
+    /* aim 40% past the target to avoid another round, but never grow the
+       iteration count by more than 10x based on a single sample */
+    double multiplier = elapsed > 0 ?
+        double(min_time_nanos) * 1.4 / elapsed :
+        10.0;
+
+    multiplier = std::min(std::max(multiplier, 2.0), 10.0);
+    iterations = std::min(uint64_t(iterations * multiplier), kMaxIterations);
+  }
+}
+
+void BenchmarkRunner::printResult(const BenchmarkResult& result) const {
+  if (!result.error.empty()) {
+    printf("%-40s ERROR: %s\n", result.name.c_str(), result.error.c_str());
+    return;
+  }
+
+  printf(
+      "%-40s %12llu %14.1f ns/op",
+      result.name.c_str(),
+      (unsigned long long) result.iterations,
+      result.nanos_per_op);
+
+  if (result.bytes_per_second > 0) {
+    printf(" %10.1f MB/s", result.bytes_per_second / (1024 * 1024));
+  }
+
+  printf("\n");
+  fflush(stdout);
+}
+
+std::string BenchmarkRunner::toJSON(
+    const std::vector<BenchmarkResult>& results) const {
+  std::string json = "{\"benchmarks\":[";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& result = results[i];
+    if (i > 0) {
+      json += ",";
+    }
+
+    json += StringUtil::format(
+        R"({"iterations":$0,"ns_per_op":$1,"bytes_per_second":$2,)",
+        result.iterations,
+        result.nanos_per_op,
+        uint64_t(result.bytes_per_second));
+
+    if (!result.error.empty()) {
+      json += StringUtil::format(
+          R"("error":"$0",)",
+          StringUtil::jsonEscape(result.error));
+    }
+
+    json += StringUtil::format(
+        R"("name":"$0"})",
+        StringUtil::jsonEscape(result.name));
+  }
+
+  json += "]}\n";
+  return json;
+}
+
+int BenchmarkRunner::main(int argc, const char* argv[]) {
+  FlagParser flags;
+
+  flags.defineFlag(
+      "help",
+      FlagParser::T_SWITCH,
+      false,
+      "?",
+      NULL);
+
+  flags.defineFlag(
+      "filter",
+      FlagParser::T_STRING,
+      false,
+      "f",
+      "*");
+
+  flags.defineFlag(
+      "list",
+      FlagParser::T_SWITCH,
+      false,
+      "l",
+      NULL);
+
+  flags.defineFlag(
+      "json",
+      FlagParser::T_SWITCH,
+      false,
+      NULL,
+      NULL);
+
+  flags.defineFlag(
+      "min_time_ms",
+      FlagParser::T_INTEGER,
+      false,
+      "t",
+      "500");
+
+  /* parse flags */ {
+    auto rc = flags.parseArgv(argc, argv);
+    if (!rc.isSuccess()) {
+      logFatal(rc.getMessage());
+      return 1;
+    }
+  }
+
+  if (flags.isSet("help")) {
+    printf("Parameters:\n"
+           " --filter=GLOB          run only benchmarks matching the glob\n"
+           " --min_time_ms=MS       minimum duration of a measured run\n"
+           " --json                 print the results as JSON\n"
+           " --list                 just list the benchmarks and exit.\n");
+    return 0;
+  }
+
+  auto filter = flags.getString("filter");
+  std::vector<const BenchmarkInfo*> benchmarks;
+  for (const auto& benchmark : benchmarks_) {
+    if (fnmatch(filter.c_str(), benchmark->name.c_str(), 0) == 0) {
+      benchmarks.emplace_back(benchmark.get());
+    }
+  }
+
+  std::sort(
+      benchmarks.begin(),
+      benchmarks.end(),
+      [] (const BenchmarkInfo* a, const BenchmarkInfo* b) {
+        return a->name < b->name;
+      });
+
+  if (flags.isSet("list")) {
+    for (size_t i = 0; i < benchmarks.size(); ++i) {
+      printf("%4zu. %s\n", i + 1, benchmarks[i]->name.c_str());
+    }
+
+    return 0;
+  }
+
+  auto json = flags.isSet("json");
+  auto min_time_nanos = flags.getInt("min_time_ms") * 1000000;
+
+  int exit_code = EXIT_SUCCESS;
+  std::vector<BenchmarkResult> results;
+  for (const auto benchmark : benchmarks) {
+    auto result = runBenchmark(*benchmark, min_time_nanos);
+    if (!result.error.empty()) {
+      exit_code = EXIT_FAILURE;
+    }
+
+    if (!json) {
+      printResult(result);
+    }
+
+    results.emplace_back(result);
+  }
+
+  if (json) {
+    printf("%s", toJSON(results).c_str());
+  }
+
+  return exit_code;
+}
+
+} // namespace benchmark
+
@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A minimal microbenchmark harness in the spirit of util/testing.h.
+ *
+ *   BENCHMARK(StringUtil, jsonEscape) {
+ *     std::string str = ...;              // setup is not timed
+ *     while (state.keepRunning()) {
+ *       benchmark::doNotOptimize(StringUtil::jsonEscape(str));
+ *     }
+ *     state.setBytesPerIteration(str.size());
+ *   }
+ *
+ * Each benchmark is run with an increasing number of iterations until a
+ * single run takes at least --min_time_ms; the result of that run is reported
+ * as ns/op (and MB/s if bytes per iteration were set)
+ */
+namespace benchmark {
+
+#define BENCHMARK(benchmarkCase, benchmarkName)                               \
+  static void _BENCHMARK_FN_NAME(benchmarkCase, benchmarkName)(               \
+      ::benchmark::State& state);                                             \
+                                                                              \
+  static ::benchmark::BenchmarkInfo* const                                    \
+  _BENCHMARK_INFO_NAME(benchmarkCase, benchmarkName) __attribute__((unused)) =\
+      ::benchmark::BenchmarkRunner::instance()->addBenchmark(                 \
+          #benchmarkCase,                                                     \
+          #benchmarkName,                                                     \
+          &_BENCHMARK_FN_NAME(benchmarkCase, benchmarkName));                 \
+                                                                              \
+  static void _BENCHMARK_FN_NAME(benchmarkCase, benchmarkName)(               \
+      ::benchmark::State& state)
+
+#define _BENCHMARK_FN_NAME(benchmarkCase, benchmarkName) \
+  Benchmark_##benchmarkCase##benchmarkName
+
+#define _BENCHMARK_INFO_NAME(benchmarkCase, benchmarkName) \
+  BenchmarkInfo_##benchmarkCase##benchmarkName
+
+int main(int argc, const char* argv[]);
+
+/**
+ * Prevent the compiler from optimizing away the computation of value
+ */
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Force all pending writes to memory
+ */
+inline void clobberMemory() {
+  asm volatile("" : : : "memory");
+}
+
+class State {
+public:
+
+  explicit State(uint64_t max_iterations);
+
+  /**
+   * Returns true as long as the benchmark should run another iteration. The
+   * timer is started on the first call and stopped on the last one
+   */
+  inline bool keepRunning() {
+    if (iterations_ < max_iterations_) {
+      if (iterations_++ == 0) {
+        resumeTiming();
+      }
+
+      return true;
+    }
+
+    pauseTiming();
+    return false;
+  }
+
+  /**
+   * Exclude the following code from the measurement (e.g. per-iteration
+   * setup) until resumeTiming() is called
+   */
+  void pauseTiming();
+  void resumeTiming();
+
+  /**
+   * Report the number of bytes processed per iteration so that a throughput
+   * can be computed
+   */
+  void setBytesPerIteration(uint64_t bytes);
+
+  /**
+   * Abort the benchmark with an error message
+   */
+  void skipWithError(const std::string& message);
+
+  uint64_t getIterations() const;
+  uint64_t getElapsedNanos() const;
+  uint64_t getBytesPerIteration() const;
+  const std::string& getError() const;
+
+protected:
+  uint64_t max_iterations_;
+  uint64_t iterations_;
+  uint64_t elapsed_nanos_;
+  uint64_t timer_start_;
+  bool timer_running_;
+  uint64_t bytes_per_iteration_;
+  std::string error_;
+};
+
+using BenchmarkFn = void (*)(State& state);
+
+struct BenchmarkInfo {
+  std::string name;
+  BenchmarkFn fn;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  uint64_t iterations;
+  double nanos_per_op;
+  double bytes_per_second;
+  std::string error;
+};
+
+class BenchmarkRunner {
+public:
+
+  static BenchmarkRunner* instance();
+
+  BenchmarkInfo* addBenchmark(
+      const char* benchmark_case,
+      const char* benchmark_name,
+      BenchmarkFn fn);
+
+  int main(int argc, const char* argv[]);
+
+  /**
+   * Run a single benchmark, calibrating the number of iterations so that the
+   * measured run takes at least min_time_nanos
+   */
+  static BenchmarkResult runBenchmark(
+      const BenchmarkInfo& benchmark,
+      uint64_t min_time_nanos);
+
+protected:
+  void printResult(const BenchmarkResult& result) const;
+  std::string toJSON(const std::vector<BenchmarkResult>& results) const;
+
+  std::vector<std::unique_ptr<BenchmarkInfo>> benchmarks_;
+};
+
+} // namespace benchmark
+
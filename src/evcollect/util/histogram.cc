@@ -0,0 +1,239 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <algorithm>
+#include <evcollect/util/histogram.h>
+#include <evcollect/util/stringutil.h>
+
+namespace {
+
+/* spreads threads over the shards; assigned once per thread */
+std::atomic<size_t> next_shard(0);
+
+size_t getThreadShard() {
+  static thread_local size_t shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) %
+      LatencyHistogram::kNumShards;
+
+  return shard;
+}
+
+} // namespace
+
+size_t LatencyHistogram::getBucketIndex(uint64_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+
+  size_t magnitude = 63 - __builtin_clzll(value);
+  size_t shift = magnitude - kSubBucketBits;
+  return (magnitude - kSubBucketBits + 1) * kSubBuckets +
+      (value >> shift) - kSubBuckets;
+}
+
+uint64_t LatencyHistogram::getBucketUpperBound(size_t idx) {
+  if (idx < kSubBuckets) {
+    return idx;
+  }
+
+  size_t magnitude = idx / kSubBuckets + kSubBucketBits - 1;
+  size_t shift = magnitude - kSubBucketBits;
+  uint64_t sub_bucket = idx % kSubBuckets + kSubBuckets;
+  if (magnitude == 63 && sub_bucket == 2 * kSubBuckets - 1) {
+    return uint64_t(-1);
+  }
+
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : shards_(new Shard[kNumShards]) {
+  for (size_t i = 0; i < kNumShards; ++i) {
+    auto& shard = shards_[i];
+    for (size_t j = 0; j < kNumBuckets; ++j) {
+      shard.buckets[j].store(0, std::memory_order_relaxed);
+    }
+
+    shard.count.store(0, std::memory_order_relaxed);
+    shard.sum.store(0, std::memory_order_relaxed);
+    shard.max.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  auto& shard = shards_[getThreadShard()];
+  shard.buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  shard.count.fetch_add(1, std::memory_order_relaxed);
+  shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+  auto max = shard.max.load(std::memory_order_relaxed);
+  while (value > max &&
+         !shard.max.compare_exchange_weak(
+            max,
+            value,
+            std::memory_order_relaxed)) {}
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const {
+  Snapshot snapshot;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    const auto& shard = shards_[i];
+    for (size_t j = 0; j < kNumBuckets; ++j) {
+      snapshot.buckets[j] += shard.buckets[j].load(std::memory_order_relaxed);
+    }
+
+    snapshot.count += shard.count.load(std::memory_order_relaxed);
+    snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    snapshot.max = std::max(
+        snapshot.max,
+        shard.max.load(std::memory_order_relaxed));
+  }
+
+  return snapshot;
+}
+
+uint64_t LatencyHistogram::getCount() const {
+  uint64_t count = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    count += shards_[i].count.load(std::memory_order_relaxed);
+  }
+
+  return count;
+}
+
+uint64_t LatencyHistogram::getSum() const {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    sum += shards_[i].sum.load(std::memory_order_relaxed);
+  }
+
+  return sum;
+}
+
+uint64_t LatencyHistogram::getMax() const {
+  uint64_t max = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    max = std::max(max, shards_[i].max.load(std::memory_order_relaxed));
+  }
+
+  return max;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+  return getSnapshot().getPercentile(percentile);
+}
+
+std::string LatencyHistogram::toJSON() const {
+  return getSnapshot().toJSON();
+}
+
+LatencyHistogram::Snapshot::Snapshot() :
+    buckets(kNumBuckets, 0),
+    count(0),
+    sum(0),
+    max(0) {}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other) {
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+
+  count += other.count;
+  sum += other.sum;
+  max = std::max(max, other.max);
+}
+
+uint64_t LatencyHistogram::Snapshot::getPercentile(double percentile) const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    total += buckets[i];
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = total * percentile;
+  if (rank >= total) {
+    rank = total - 1;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen > rank) {
+      return std::min(getBucketUpperBound(i), max);
+    }
+  }
+
+  return max;
+}
+
+std::string LatencyHistogram::Snapshot::toJSON() const {
+  return StringUtil::format(
+      R"({ "count": $0, "mean": $1, "max": $2, "p50": $3, "p90": $4, )"
+      R"("p99": $5, "p999": $6 })",
+      count,
+      count > 0 ? sum / count : 0,
+      max,
+      getPercentile(0.5),
+      getPercentile(0.9),
+      getPercentile(0.99),
+      getPercentile(0.999));
+}
+
+std::string LatencyHistogram::Snapshot::toString() const {
+  return StringUtil::format(
+      "count=$0 mean=$1 p50=$2 p90=$3 p99=$4 p999=$5 max=$6",
+      count,
+      count > 0 ? sum / count : 0,
+      getPercentile(0.5),
+      getPercentile(0.9),
+      getPercentile(0.99),
+      getPercentile(0.999),
+      max);
+}
+
+HistogramRegistry* HistogramRegistry::get() {
+  static HistogramRegistry registry;
+  return &registry;
+}
+
+LatencyHistogram* HistogramRegistry::getHistogram(const std::string& name) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  auto& histogram = map_[name];
+  if (!histogram) {
+    histogram.reset(new LatencyHistogram());
+  }
+
+  return histogram.get();
+}
+
+void HistogramRegistry::listHistograms(
+    std::vector<std::pair<std::string, const LatencyHistogram*>>* list) const {
+  std::unique_lock<std::mutex> lk(mutex_);
+  for (const auto& h : map_) {
+    list->emplace_back(h.first, h.second.get());
+  }
+
+  std::sort(list->begin(), list->end());
+}
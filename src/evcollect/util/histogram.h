@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * A lock-free latency histogram with HDR-style log-linear buckets: every power
+ * of two is split into kSubBuckets linear buckets, so each recorded value is
+ * accurate to within 1/kSubBuckets (~6%) over the full 64-bit range.
+ *
+ * Recording a value is a handful of relaxed atomic increments on a shard that
+ * is picked per thread, so multiple threads can record into the same
+ * histogram without bouncing cache lines. The shards are merged on read.
+ */
+class LatencyHistogram {
+public:
+
+  static const size_t kSubBucketBits = 4;
+  static const size_t kSubBuckets = 1 << kSubBucketBits;
+  static const size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+  static const size_t kNumShards = 4;
+
+  /**
+   * A merged, point-in-time copy of a histogram
+   */
+  struct Snapshot {
+    Snapshot();
+
+    /**
+     * Add the values of another snapshot to this one
+     */
+    void merge(const Snapshot& other);
+
+    /**
+     * Return an upper bound for the value at the provided percentile
+     * (0.0 - 1.0)
+     */
+    uint64_t getPercentile(double percentile) const;
+
+    /**
+     * Return a JSON object with count, mean, max and the p50/p90/p99/p999
+     * percentiles
+     */
+    std::string toJSON() const;
+
+    /**
+     * Return a one line human readable summary
+     */
+    std::string toString() const;
+
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+  };
+
+  LatencyHistogram();
+
+  /**
+   * Record a value (usually a duration in microseconds)
+   */
+  void record(uint64_t value);
+
+  /**
+   * Merge all shards into a snapshot
+   */
+  Snapshot getSnapshot() const;
+
+  uint64_t getCount() const;
+  uint64_t getSum() const;
+  uint64_t getMax() const;
+  uint64_t getPercentile(double percentile) const;
+  std::string toJSON() const;
+
+  static size_t getBucketIndex(uint64_t value);
+  static uint64_t getBucketUpperBound(size_t idx);
+
+protected:
+
+  struct Shard {
+    std::atomic<uint64_t> buckets[kNumBuckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+/**
+ * Process-wide registry of named latency histograms, e.g. for latencies that
+ * are measured inside of plugins. Histograms are never removed, so pointers
+ * stay valid for the lifetime of the process
+ */
+class HistogramRegistry {
+public:
+
+  static HistogramRegistry* get();
+
+  /**
+   * Return the histogram with the provided name, creating it if necessary
+   */
+  LatencyHistogram* getHistogram(const std::string& name);
+
+  /**
+   * List all histograms, sorted by name
+   */
+  void listHistograms(
+      std::vector<std::pair<std::string, const LatencyHistogram*>>* list) const;
+
+protected:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<LatencyHistogram>> map_;
+};
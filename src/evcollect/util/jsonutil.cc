@@ -0,0 +1,486 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdint.h>
+#include <string.h>
+#include "jsonutil.h"
+
+namespace {
+
+const char* validateValue(const char* cur, const char* end, size_t depth);
+
+const char* validateLiteral(
+    const char* cur,
+    const char* end,
+    const char* literal,
+    size_t size) {
+  if (size_t(end - cur) < size || memcmp(cur, literal, size) != 0) {
+    return nullptr;
+  }
+
+  return cur + size;
+}
+
+const char* validateDigits(const char* cur, const char* end) {
+  auto begin = cur;
+  while (cur < end && *cur >= '0' && *cur <= '9') {
+    ++cur;
+  }
+
+  return cur == begin ? nullptr : cur;
+}
+
+const char* validateNumber(const char* cur, const char* end) {
+  if (*cur == '-') {
+    ++cur;
+  }
+
+  if (cur < end && *cur == '0') {
+    ++cur;
+  } else {
+    cur = validateDigits(cur, end);
+    if (!cur) {
+      return nullptr;
+    }
+  }
+
+  if (cur < end && *cur == '.') {
+    cur = validateDigits(cur + 1, end);
+    if (!cur) {
+      return nullptr;
+    }
+  }
+
+  if (cur < end && (*cur == 'e' || *cur == 'E')) {
+    ++cur;
+    if (cur < end && (*cur == '+' || *cur == '-')) {
+      ++cur;
+    }
+
+    cur = validateDigits(cur, end);
+  }
+
+  return cur;
+}
+
+inline bool isHexDigit(char c) {
+  return
+      (c >= '0' && c <= '9') ||
+      (c >= 'a' && c <= 'f') ||
+      (c >= 'A' && c <= 'F');
+}
+
+/* returns the end of the UTF-8 sequence at cur or nullptr if it is invalid,
+   overlong or encodes a surrogate */
+const char* validateUTF8(const char* cur, const char* end) {
+  auto c = (unsigned char) *cur;
+  size_t len;
+  uint32_t min;
+  if ((c & 0xe0) == 0xc0) {
+    len = 2;
+    min = 0x80;
+  } else if ((c & 0xf0) == 0xe0) {
+    len = 3;
+    min = 0x800;
+  } else if ((c & 0xf8) == 0xf0) {
+    len = 4;
+    min = 0x10000;
+  } else {
+    return nullptr;
+  }
+
+  if (size_t(end - cur) < len) {
+    return nullptr;
+  }
+
+  uint32_t cp = c & (0x7f >> len);
+  for (size_t i = 1; i < len; ++i) {
+    auto b = (unsigned char) cur[i];
+    if ((b & 0xc0) != 0x80) {
+      return nullptr;
+    }
+
+    cp = (cp << 6) | (b & 0x3f);
+  }
+
+  if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+    return nullptr;
+  }
+
+  return cur + len;
+}
+
+const char* validateString(const char* cur, const char* end) {
+  ++cur;
+  while (cur < end) {
+    auto c = (unsigned char) *cur;
+    if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+      ++cur;
+      continue;
+    }
+
+    switch (c) {
+      case '"':
+        return cur + 1;
+      case '\\':
+        if (++cur == end) {
+          return nullptr;
+        }
+
+        switch (*cur) {
+          case '"':
+          case '\\':
+          case '/':
+          case 'b':
+          case 'f':
+          case 'n':
+          case 'r':
+          case 't':
+            ++cur;
+            continue;
+          case 'u':
+            if (end - cur < 5 ||
+                !isHexDigit(cur[1]) ||
+                !isHexDigit(cur[2]) ||
+                !isHexDigit(cur[3]) ||
+                !isHexDigit(cur[4])) {
+              return nullptr;
+            }
+
+            cur += 5;
+            continue;
+          default:
+            return nullptr;
+        }
+      default:
+        if (c < 0x20) {
+          return nullptr;
+        }
+
+        cur = validateUTF8(cur, end);
+        if (!cur) {
+          return nullptr;
+        }
+    }
+  }
+
+  return nullptr;
+}
+
+const char* validateContainer(const char* cur, const char* end, size_t depth) {
+  if (depth >= JSONUtil::kMaxDepth) {
+    return nullptr;
+  }
+
+  bool object = *cur == '{';
+  char close = object ? '}' : ']';
+  cur = JSONUtil::skipWhitespace(cur + 1, end);
+  if (cur < end && *cur == close) {
+    return cur + 1;
+  }
+
+  while (cur < end) {
+    if (object) {
+      if (*cur != '"') {
+        return nullptr;
+      }
+
+      cur = validateString(cur, end);
+      if (!cur) {
+        return nullptr;
+      }
+
+      cur = JSONUtil::skipWhitespace(cur, end);
+      if (cur == end || *cur != ':') {
+        return nullptr;
+      }
+
+      cur = JSONUtil::skipWhitespace(cur + 1, end);
+    }
+
+    cur = validateValue(cur, end, depth + 1);
+    if (!cur) {
+      return nullptr;
+    }
+
+    cur = JSONUtil::skipWhitespace(cur, end);
+    if (cur == end) {
+      return nullptr;
+    }
+
+    if (*cur == close) {
+      return cur + 1;
+    }
+
+    if (*cur != ',') {
+      return nullptr;
+    }
+
+    cur = JSONUtil::skipWhitespace(cur + 1, end);
+  }
+
+  return nullptr;
+}
+
+const char* validateValue(const char* cur, const char* end, size_t depth) {
+  if (cur >= end) {
+    return nullptr;
+  }
+
+  switch (*cur) {
+    case '"':
+      return validateString(cur, end);
+    case '{':
+    case '[':
+      return validateContainer(cur, end, depth);
+    case 't':
+      return validateLiteral(cur, end, "true", 4);
+    case 'f':
+      return validateLiteral(cur, end, "false", 5);
+    case 'n':
+      return validateLiteral(cur, end, "null", 4);
+    default:
+      return validateNumber(cur, end);
+  }
+}
+
+} // namespace
+
+const char* JSONUtil::skipWhitespace(const char* begin, const char* end) {
+  while (begin < end) {
+    switch (*begin) {
+      case ' ':
+      case '\t':
+      case '\r':
+      case '\n':
+        ++begin;
+        continue;
+      default:
+        return begin;
+    }
+  }
+
+  return begin;
+}
+
+const char* JSONUtil::skipString(const char* begin, const char* end) {
+  for (auto cur = begin + 1; cur < end; ) {
+    switch (*cur) {
+      case '\\':
+        cur += 2;
+        continue;
+      case '"':
+        return cur + 1;
+      default:
+        ++cur;
+        continue;
+    }
+  }
+
+  return nullptr;
+}
+
+const char* JSONUtil::skipValue(const char* begin, const char* end) {
+  if (begin >= end) {
+    return nullptr;
+  }
+
+  switch (*begin) {
+
+    case '"':
+      return skipString(begin, end);
+
+    case '{':
+    case '[': {
+      size_t depth = 0;
+      for (auto cur = begin; cur < end; ) {
+        switch (*cur) {
+          case '"':
+            cur = skipString(cur, end);
+            if (!cur) {
+              return nullptr;
+            }
+            continue;
+          case '{':
+          case '[':
+            ++depth;
+            break;
+          case '}':
+          case ']':
+            if (--depth == 0) {
+              return cur + 1;
+            }
+            break;
+        }
+
+        ++cur;
+      }
+
+      return nullptr;
+    }
+
+    default: {
+      auto cur = begin;
+      while (cur < end) {
+        switch (*cur) {
+          case ',':
+          case '}':
+          case ']':
+          case ' ':
+          case '\t':
+          case '\r':
+          case '\n':
+            return cur == begin ? nullptr : cur;
+          default:
+            ++cur;
+            continue;
+        }
+      }
+
+      return cur;
+    }
+
+  }
+}
+
+bool JSONObjectMerger::scanObject(
+    const char* begin,
+    const char* end,
+    std::vector<Member>* members) {
+  members->clear();
+
+  auto cur = JSONUtil::skipWhitespace(begin, end);
+  if (cur == end || *cur != '{') {
+    return false;
+  }
+
+  cur = JSONUtil::skipWhitespace(cur + 1, end);
+  if (cur < end && *cur == '}') {
+    return JSONUtil::skipWhitespace(cur + 1, end) == end;
+  }
+
+  while (cur < end) {
+    if (*cur != '"') {
+      return false;
+    }
+
+    Member m;
+    m.key_begin = cur;
+    m.key_end = JSONUtil::skipString(cur, end);
+    if (!m.key_end) {
+      return false;
+    }
+
+    cur = JSONUtil::skipWhitespace(m.key_end, end);
+    if (cur == end || *cur != ':') {
+      return false;
+    }
+
+    cur = JSONUtil::skipWhitespace(cur + 1, end);
+    m.value_end = JSONUtil::skipValue(cur, end);
+    if (!m.value_end) {
+      return false;
+    }
+
+    members->emplace_back(m);
+
+    cur = JSONUtil::skipWhitespace(m.value_end, end);
+    if (cur == end) {
+      return false;
+    }
+
+    switch (*cur) {
+      case ',':
+        cur = JSONUtil::skipWhitespace(cur + 1, end);
+        continue;
+      case '}':
+        return JSONUtil::skipWhitespace(cur + 1, end) == end;
+      default:
+        return false;
+    }
+  }
+
+  return false;
+}
+
+bool JSONObjectMerger::merge(
+    const char* base,
+    size_t base_len,
+    const char* overlay,
+    size_t overlay_len,
+    std::string* out) {
+  if (!scanObject(base, base + base_len, &base_members_) ||
+      !scanObject(overlay, overlay + overlay_len, &overlay_members_)) {
+    return false;
+  }
+
+  out->clear();
+  out->reserve(base_len + overlay_len);
+  *out += '{';
+
+  size_t n = 0;
+  for (const auto& m : base_members_) {
+    size_t key_len = m.key_end - m.key_begin;
+    bool shadowed = false;
+    for (const auto& o : overlay_members_) {
+      if (size_t(o.key_end - o.key_begin) == key_len &&
+          memcmp(o.key_begin, m.key_begin, key_len) == 0) {
+        shadowed = true;
+        break;
+      }
+    }
+
+    if (shadowed) {
+      continue;
+    }
+
+    if (n++ > 0) {
+      *out += ',';
+    }
+
+    out->append(m.key_begin, m.value_end - m.key_begin);
+  }
+
+  for (const auto& m : overlay_members_) {
+    if (n++ > 0) {
+      *out += ',';
+    }
+
+    out->append(m.key_begin, m.value_end - m.key_begin);
+  }
+
+  *out += '}';
+  return true;
+}
+
+bool JSONObjectMerger::merge(
+    const std::string& base,
+    const std::string& overlay,
+    std::string* out) {
+  return merge(base.data(), base.size(), overlay.data(), overlay.size(), out);
+}
+
+bool JSONUtil::validate(const char* begin, const char* end) {
+  auto cur = validateValue(skipWhitespace(begin, end), end, 0);
+  return cur && skipWhitespace(cur, end) == end;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+class JSONUtil {
+public:
+
+  /**
+   * Skip whitespace
+   *
+   * @return pointer to the first non-whitespace character or end
+   */
+  static const char* skipWhitespace(const char* begin, const char* end);
+
+  /**
+   * Skip a string literal; begin must point to the opening quote
+   *
+   * @return pointer past the closing quote or nullptr if the string is not
+   * terminated
+   */
+  static const char* skipString(const char* begin, const char* end);
+
+  /**
+   * Skip a JSON value (string, number, literal, object or array). The value is
+   * not validated, only its extent is determined
+   *
+   * @return pointer past the value or nullptr if the value is truncated
+   */
+  static const char* skipValue(const char* begin, const char* end);
+
+  /**
+   * Check that the input is exactly one valid JSON value (RFC 8259, strings
+   * must be valid UTF-8), optionally surrounded by whitespace. Does not
+   * allocate; values nested deeper than kMaxDepth levels are rejected
+   */
+  static bool validate(const char* begin, const char* end);
+
+  static const size_t kMaxDepth = 128;
+
+};
+
+/**
+ * Merges the top-level members of JSON objects by splicing their member lists
+ * instead of parsing them into a DOM. Members of the overlay object replace
+ * members of the base object with the same key. The scratch space is reused
+ * between calls, so a long-lived merger does not allocate in the steady state
+ */
+class JSONObjectMerger {
+public:
+
+  /**
+   * Merge the base and overlay objects into out
+   *
+   * @return true on success, false if one of the inputs is not a JSON object
+   */
+  bool merge(
+      const char* base,
+      size_t base_len,
+      const char* overlay,
+      size_t overlay_len,
+      std::string* out);
+
+  bool merge(
+      const std::string& base,
+      const std::string& overlay,
+      std::string* out);
+
+protected:
+
+  struct Member {
+    const char* key_begin;
+    const char* key_end;
+    const char* value_end;
+  };
+
+  static bool scanObject(
+      const char* begin,
+      const char* end,
+      std::vector<Member>* members);
+
+  std::vector<Member> base_members_;
+  std::vector<Member> overlay_members_;
+};
+
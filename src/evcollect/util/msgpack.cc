@@ -0,0 +1,412 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <evcollect/util/msgpack.h>
+#include <evcollect/util/stringutil.h>
+
+MsgPackWriter::MsgPackWriter(std::string* out) : out_(out) {}
+
+void MsgPackWriter::appendBigEndian(uint64_t value, size_t size) {
+  for (size_t i = size; i > 0; --i) {
+    *out_ += char((value >> ((i - 1) * 8)) & 0xff);
+  }
+}
+
+void MsgPackWriter::appendMap(uint32_t size) {
+  if (size < 16) {
+    *out_ += char(0x80 | size);
+  } else if (size <= 0xffff) {
+    *out_ += char(0xde);
+    appendBigEndian(size, 2);
+  } else {
+    *out_ += char(0xdf);
+    appendBigEndian(size, 4);
+  }
+}
+
+void MsgPackWriter::appendArray(uint32_t size) {
+  if (size < 16) {
+    *out_ += char(0x90 | size);
+  } else if (size <= 0xffff) {
+    *out_ += char(0xdc);
+    appendBigEndian(size, 2);
+  } else {
+    *out_ += char(0xdd);
+    appendBigEndian(size, 4);
+  }
+}
+
+void MsgPackWriter::appendString(const char* data, size_t size) {
+  if (size < 32) {
+    *out_ += char(0xa0 | size);
+  } else if (size <= 0xff) {
+    *out_ += char(0xd9);
+    appendBigEndian(size, 1);
+  } else if (size <= 0xffff) {
+    *out_ += char(0xda);
+    appendBigEndian(size, 2);
+  } else {
+    *out_ += char(0xdb);
+    appendBigEndian(size, 4);
+  }
+
+  out_->append(data, size);
+}
+
+void MsgPackWriter::appendString(const std::string& str) {
+  appendString(str.data(), str.size());
+}
+
+void MsgPackWriter::appendUInt(uint64_t value) {
+  if (value < 128) {
+    *out_ += char(value);
+  } else if (value <= 0xff) {
+    *out_ += char(0xcc);
+    appendBigEndian(value, 1);
+  } else if (value <= 0xffff) {
+    *out_ += char(0xcd);
+    appendBigEndian(value, 2);
+  } else if (value <= 0xffffffff) {
+    *out_ += char(0xce);
+    appendBigEndian(value, 4);
+  } else {
+    *out_ += char(0xcf);
+    appendBigEndian(value, 8);
+  }
+}
+
+void MsgPackWriter::appendInt(int64_t value) {
+  if (value >= 0) {
+    appendUInt(value);
+  } else if (value >= -32) {
+    *out_ += char(value);
+  } else if (value >= INT8_MIN) {
+    *out_ += char(0xd0);
+    appendBigEndian(value, 1);
+  } else if (value >= INT16_MIN) {
+    *out_ += char(0xd1);
+    appendBigEndian(value, 2);
+  } else if (value >= INT32_MIN) {
+    *out_ += char(0xd2);
+    appendBigEndian(value, 4);
+  } else {
+    *out_ += char(0xd3);
+    appendBigEndian(value, 8);
+  }
+}
+
+void MsgPackWriter::appendDouble(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  *out_ += char(0xcb);
+  appendBigEndian(bits, 8);
+}
+
+void MsgPackWriter::appendBool(bool value) {
+  *out_ += char(value ? 0xc3 : 0xc2);
+}
+
+void MsgPackWriter::appendNil() {
+  *out_ += char(0xc0);
+}
+
+namespace {
+
+class MsgPackReader {
+public:
+
+  MsgPackReader(const char* begin, const char* end) :
+      cur_(reinterpret_cast<const unsigned char*>(begin)),
+      end_(reinterpret_cast<const unsigned char*>(end)) {}
+
+  bool readValue(std::string* json, size_t depth, bool as_key);
+
+  bool atEnd() const {
+    return cur_ == end_;
+  }
+
+protected:
+
+  bool readBigEndian(size_t size, uint64_t* value) {
+    if (size_t(end_ - cur_) < size) {
+      return false;
+    }
+
+    *value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      *value = (*value << 8) | *cur_++;
+    }
+
+    return true;
+  }
+
+  bool readSigned(size_t size, std::string* json) {
+    uint64_t v;
+    if (!readBigEndian(size, &v)) {
+      return false;
+    }
+
+    /* sign-extend */
+    auto shift = 64 - size * 8;
+    auto value = int64_t(v << shift) >> shift;
+    *json += std::to_string(value);
+    return true;
+  }
+
+  bool readString(size_t size, std::string* json) {
+    if (size_t(end_ - cur_) < size) {
+      return false;
+    }
+
+    *json += '"';
+    *json += StringUtil::jsonEscape(
+        std::string(reinterpret_cast<const char*>(cur_), size));
+    *json += '"';
+    cur_ += size;
+    return true;
+  }
+
+  bool readDouble(double value, std::string* json) {
+    if (isnan(value) || isinf(value)) {
+      *json += "null";
+      return true;
+    }
+
+    char buf[32];
+    auto len = snprintf(buf, sizeof(buf), "%.17g", value);
+    json->append(buf, len);
+    return true;
+  }
+
+  bool readContainer(
+      size_t size,
+      bool is_map,
+      std::string* json,
+      size_t depth) {
+    if (depth >= MsgPack::kMaxDepth) {
+      return false;
+    }
+
+    *json += is_map ? '{' : '[';
+    for (size_t i = 0; i < size; ++i) {
+      if (i > 0) {
+        *json += ',';
+      }
+
+      if (is_map) {
+        if (!readValue(json, depth + 1, true)) {
+          return false;
+        }
+
+        *json += ':';
+      }
+
+      if (!readValue(json, depth + 1, false)) {
+        return false;
+      }
+    }
+
+    *json += is_map ? '}' : ']';
+    return true;
+  }
+
+  bool skipExt(size_t size, std::string* json) {
+    /* type byte + payload */
+    if (size_t(end_ - cur_) < size + 1) {
+      return false;
+    }
+
+    cur_ += size + 1;
+    *json += "null";
+    return true;
+  }
+
+  const unsigned char* cur_;
+  const unsigned char* end_;
+};
+
+bool MsgPackReader::readValue(std::string* json, size_t depth, bool as_key) {
+  if (cur_ == end_) {
+    return false;
+  }
+
+  /* JSON only allows string keys; render all other keys as strings */
+  uint8_t type = *cur_;
+  if (as_key && (type & 0xe0) != 0xa0 && type != 0xd9 && type != 0xda &&
+      type != 0xdb) {
+    std::string key;
+    if (!readValue(&key, depth, false)) {
+      return false;
+    }
+
+    *json += '"';
+    *json += StringUtil::jsonEscape(key);
+    *json += '"';
+    return true;
+  }
+
+  ++cur_;
+
+  if (type <= 0x7f) {
+    *json += std::to_string(type);
+    return true;
+  }
+
+  if (type >= 0xe0) {
+    *json += std::to_string(int(int8_t(type)));
+    return true;
+  }
+
+  if ((type & 0xf0) == 0x80) {
+    return readContainer(type & 0x0f, true, json, depth);
+  }
+
+  if ((type & 0xf0) == 0x90) {
+    return readContainer(type & 0x0f, false, json, depth);
+  }
+
+  if ((type & 0xe0) == 0xa0) {
+    return readString(type & 0x1f, json);
+  }
+
+  uint64_t v;
+  switch (type) {
+
+    case 0xc0:
+      *json += "null";
+      return true;
+
+    case 0xc2:
+      *json += "false";
+      return true;
+
+    case 0xc3:
+      *json += "true";
+      return true;
+
+    /* bin 8/16/32 */
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+      return
+          readBigEndian(size_t(1) << (type - 0xc4), &v) &&
+          readString(v, json);
+
+    /* ext 8/16/32 */
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+      return
+          readBigEndian(size_t(1) << (type - 0xc7), &v) &&
+          skipExt(v, json);
+
+    case 0xca: {
+      if (!readBigEndian(4, &v)) {
+        return false;
+      }
+
+      uint32_t bits = v;
+      float value;
+      memcpy(&value, &bits, sizeof(value));
+      return readDouble(value, json);
+    }
+
+    case 0xcb: {
+      if (!readBigEndian(8, &v)) {
+        return false;
+      }
+
+      double value;
+      memcpy(&value, &v, sizeof(value));
+      return readDouble(value, json);
+    }
+
+    /* uint 8/16/32/64 */
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+      if (!readBigEndian(size_t(1) << (type - 0xcc), &v)) {
+        return false;
+      }
+
+      *json += std::to_string(v);
+      return true;
+
+    /* int 8/16/32/64 */
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+      return readSigned(size_t(1) << (type - 0xd0), json);
+
+    /* fixext 1/2/4/8/16 */
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+      return skipExt(size_t(1) << (type - 0xd4), json);
+
+    /* str 8/16/32 */
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+      return
+          readBigEndian(size_t(1) << (type - 0xd9), &v) &&
+          readString(v, json);
+
+    /* array 16/32 */
+    case 0xdc:
+    case 0xdd:
+      return
+          readBigEndian(size_t(2) << (type - 0xdc), &v) &&
+          readContainer(v, false, json, depth);
+
+    /* map 16/32 */
+    case 0xde:
+    case 0xdf:
+      return
+          readBigEndian(size_t(2) << (type - 0xde), &v) &&
+          readContainer(v, true, json, depth);
+
+    default:
+      return false;
+
+  }
+}
+
+} // namespace
+
+bool MsgPack::toJSON(const char* data, size_t size, std::string* json) {
+  MsgPackReader reader(data, data + size);
+  return reader.readValue(json, 0, false) && reader.atEnd();
+}
+
+bool MsgPack::toJSON(const std::string& data, std::string* json) {
+  return toJSON(data.data(), data.size(), json);
+}
+
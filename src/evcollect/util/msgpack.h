@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * Appends MessagePack encoded values to a string. Maps and arrays are written
+ * as a header with the number of elements followed by the elements (keys and
+ * values alternating for maps)
+ */
+class MsgPackWriter {
+public:
+
+  explicit MsgPackWriter(std::string* out);
+
+  void appendMap(uint32_t size);
+  void appendArray(uint32_t size);
+  void appendString(const char* data, size_t size);
+  void appendString(const std::string& str);
+  void appendUInt(uint64_t value);
+  void appendInt(int64_t value);
+  void appendDouble(double value);
+  void appendBool(bool value);
+  void appendNil();
+
+protected:
+  void appendBigEndian(uint64_t value, size_t size);
+  std::string* out_;
+};
+
+class MsgPack {
+public:
+
+  static const size_t kMaxDepth = 64;
+
+  /**
+   * Convert a single MessagePack value to JSON. Map keys that are not strings
+   * are converted to strings, binary data is written as a string and
+   * extension types, NaN and infinity are written as null
+   *
+   * @return true on success, false if the input is truncated, nested deeper
+   * than kMaxDepth or has trailing bytes
+   */
+  static bool toJSON(const char* data, size_t size, std::string* json);
+  static bool toJSON(const std::string& data, std::string* json);
+
+};
+
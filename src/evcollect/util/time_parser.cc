@@ -0,0 +1,494 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#include <ctype.h>
+#include <string.h>
+#include "time_parser.h"
+#include "time.h"
+
+namespace {
+
+const char* const kMonthNames[] = {
+  "january", "february", "march", "april", "may", "june", "july", "august",
+  "september", "october", "november", "december"
+};
+
+inline char toLower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\t';
+}
+
+/* reads between min_digits and max_digits decimal digits */
+inline bool readNumber(
+    const char** cur,
+    const char* end,
+    size_t min_digits,
+    size_t max_digits,
+    uint64_t* value) {
+  uint64_t v = 0;
+  size_t n = 0;
+  const char* p = *cur;
+  for (; p < end && n < max_digits && *p >= '0' && *p <= '9'; ++p, ++n) {
+    v = v * 10 + (*p - '0');
+  }
+
+  if (n < min_digits) {
+    return false;
+  }
+
+  *cur = p;
+  *value = v;
+  return true;
+}
+
+bool readMonthName(const char** cur, const char* end, uint64_t* month) {
+  const char* p = *cur;
+  if (end - p < 3) {
+    return false;
+  }
+
+  for (size_t m = 0; m < 12; ++m) {
+    const char* name = kMonthNames[m];
+    if (toLower(p[0]) != name[0] ||
+        toLower(p[1]) != name[1] ||
+        toLower(p[2]) != name[2]) {
+      continue;
+    }
+
+    /* accept the full name, too */
+    size_t len = 3;
+    size_t name_len = strlen(name);
+    while (len < name_len &&
+        p + len < end &&
+        toLower(p[len]) == name[len]) {
+      ++len;
+    }
+
+    if (len != name_len) {
+      len = 3;
+    }
+
+    *cur = p + len;
+    *month = m + 1;
+    return true;
+  }
+
+  return false;
+}
+
+bool readZone(const char** cur, const char* end, int64_t* offset_seconds) {
+  const char* p = *cur;
+  if (p < end && (*p == 'Z' || *p == 'z')) {
+    *cur = p + 1;
+    *offset_seconds = 0;
+    return true;
+  }
+
+  if (p >= end || (*p != '+' && *p != '-')) {
+    return false;
+  }
+
+  int64_t sign = *p == '-' ? -1 : 1;
+  ++p;
+
+  uint64_t hours;
+  uint64_t minutes = 0;
+  if (!readNumber(&p, end, 2, 2, &hours)) {
+    return false;
+  }
+
+  if (p < end && *p == ':') {
+    ++p;
+    if (!readNumber(&p, end, 2, 2, &minutes)) {
+      return false;
+    }
+  } else {
+    readNumber(&p, end, 2, 2, &minutes);
+  }
+
+  if (hours > 23 || minutes > 59) {
+    return false;
+  }
+
+  *cur = p;
+  *offset_seconds = sign * (int64_t) (hours * 3600 + minutes * 60);
+  return true;
+}
+
+/* days since 1970-01-01 in the proleptic gregorian calendar */
+int64_t daysFromCivil(int64_t y, uint64_t m, uint64_t d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  uint64_t yoe = y - era * 400;
+  uint64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+} // namespace
+
+TimeParser::TimeParser() :
+    infer_year_(false),
+    cache_tokens_(0),
+    cache_len_(0),
+    cache_seconds_(0) {}
+
+ReturnCode TimeParser::compile(const std::string& format) {
+  std::vector<Token> tokens;
+  auto push = [&tokens] (Op op, char literal) {
+    Token token;
+    token.op = op;
+    token.literal = literal;
+    tokens.emplace_back(token);
+  };
+
+  for (size_t i = 0; i < format.size(); ++i) {
+    if (isSpace(format[i])) {
+      if (tokens.empty() || tokens.back().op != Op::WHITESPACE) {
+        push(Op::WHITESPACE, ' ');
+      }
+
+      continue;
+    }
+
+    if (format[i] != '%') {
+      push(Op::LITERAL, format[i]);
+      continue;
+    }
+
+    if (++i == format.size()) {
+      return ReturnCode::error("EINVAL", "time format ends with '%%'");
+    }
+
+    switch (format[i]) {
+      case 'Y': push(Op::YEAR, 0); break;
+      case 'm': push(Op::MONTH, 0); break;
+      case 'b': push(Op::MONTH_NAME, 0); break;
+      case 'h': push(Op::MONTH_NAME, 0); break;
+      case 'd': push(Op::DAY, 0); break;
+      case 'e': push(Op::DAY_PADDED, 0); break;
+      case 'H': push(Op::HOUR, 0); break;
+      case 'M': push(Op::MINUTE, 0); break;
+      case 'S': push(Op::SECOND, 0); break;
+      case 'f': push(Op::FRACTION, 0); break;
+      case 'z': push(Op::ZONE, 0); break;
+      case 's': push(Op::EPOCH_SECONDS, 0); break;
+      case '%': push(Op::LITERAL, '%'); break;
+      case 'T':
+        push(Op::HOUR, 0);
+        push(Op::LITERAL, ':');
+        push(Op::MINUTE, 0);
+        push(Op::LITERAL, ':');
+        push(Op::SECOND, 0);
+        break;
+      case 'F':
+        push(Op::YEAR, 0);
+        push(Op::LITERAL, '-');
+        push(Op::MONTH, 0);
+        push(Op::LITERAL, '-');
+        push(Op::DAY, 0);
+        break;
+      default:
+        return ReturnCode::error(
+            "EINVAL",
+            "unsupported conversion in time format: %%%c",
+            format[i]);
+    }
+  }
+
+  bool has_year = false;
+  bool has_date = false;
+  for (const auto& token : tokens) {
+    switch (token.op) {
+      case Op::YEAR:
+      case Op::EPOCH_SECONDS:
+        has_year = true;
+        has_date = true;
+        break;
+      case Op::MONTH:
+      case Op::MONTH_NAME:
+        has_date = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (!has_date) {
+    return ReturnCode::error(
+        "EINVAL",
+        "time format has no date: %s",
+        format.c_str());
+  }
+
+  /* the result of the leading tokens up to the last date/time conversion
+     can be cached if no fraction, zone or epoch conversion precedes it */
+  size_t cache_tokens = 0;
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    auto op = tokens[i].op;
+    if (op == Op::FRACTION || op == Op::ZONE || op == Op::EPOCH_SECONDS) {
+      break;
+    }
+
+    if (op != Op::LITERAL && op != Op::WHITESPACE) {
+      cache_tokens = i + 1;
+    }
+  }
+
+  for (size_t i = cache_tokens; i < tokens.size(); ++i) {
+    auto op = tokens[i].op;
+    if (op != Op::LITERAL &&
+        op != Op::WHITESPACE &&
+        op != Op::FRACTION &&
+        op != Op::ZONE) {
+      cache_tokens = 0;
+    }
+  }
+
+  tokens_ = std::move(tokens);
+  infer_year_ = !has_year;
+  cache_tokens_ = cache_tokens;
+  cache_len_ = 0;
+  return ReturnCode::success();
+}
+
+bool TimeParser::toLocalSeconds(
+    uint64_t year,
+    uint64_t month,
+    uint64_t day,
+    uint64_t hour,
+    uint64_t minute,
+    uint64_t second,
+    int64_t* seconds) {
+  if (month < 1 || month > 12 ||
+      day < 1 || day > 31 ||
+      hour > 23 ||
+      minute > 59 ||
+      second > 60) {
+    return false;
+  }
+
+  *seconds =
+      daysFromCivil(year, month, day) * 86400 +
+      hour * 3600 +
+      minute * 60 +
+      second;
+
+  return true;
+}
+
+bool TimeParser::toLocalSecondsInCurrentYear(
+    uint64_t month,
+    uint64_t day,
+    uint64_t hour,
+    uint64_t minute,
+    uint64_t second,
+    int64_t* seconds) {
+  time_t now = WallClock::unixSeconds();
+  struct tm now_tm;
+  gmtime_r(&now, &now_tm);
+
+  uint64_t year = now_tm.tm_year + 1900;
+  if (!toLocalSeconds(year, month, day, hour, minute, second, seconds)) {
+    return false;
+  }
+
+  /* e.g. a December line read in January; allow a day for time zones */
+  if (*seconds > now + int64_t(kSecondsPerDay)) {
+    return toLocalSeconds(year - 1, month, day, hour, minute, second, seconds);
+  }
+
+  return true;
+}
+
+bool TimeParser::resolveLocalSeconds(
+    uint64_t year,
+    uint64_t month,
+    uint64_t day,
+    uint64_t hour,
+    uint64_t minute,
+    uint64_t second,
+    int64_t* seconds) const {
+  if (infer_year_) {
+    return toLocalSecondsInCurrentYear(
+        month,
+        day,
+        hour,
+        minute,
+        second,
+        seconds);
+  } else {
+    return toLocalSeconds(year, month, day, hour, minute, second, seconds);
+  }
+}
+
+bool TimeParser::parse(
+    const char* data,
+    size_t size,
+    uint64_t* unix_micros) {
+  uint64_t year = 1970;
+  uint64_t month = 1;
+  uint64_t day = 1;
+  uint64_t hour = 0;
+  uint64_t minute = 0;
+  uint64_t second = 0;
+  uint64_t micros = 0;
+  int64_t zone_offset = 0;
+  bool has_epoch = false;
+  uint64_t epoch = 0;
+  int64_t local_seconds = 0;
+  bool has_local_seconds = false;
+  size_t first_token = 0;
+
+  const char* cur = data;
+  const char* end = data + size;
+
+  /* the cached prefix must not be followed by characters that would have
+     been read as part of its last conversion */
+  if (cache_len_ > 0 &&
+      size >= cache_len_ &&
+      memcmp(data, cache_text_, cache_len_) == 0 &&
+      (size == cache_len_ || !isalnum(data[cache_len_]))) {
+    cur += cache_len_;
+    first_token = cache_tokens_;
+    local_seconds = cache_seconds_;
+    has_local_seconds = true;
+  }
+
+  for (size_t i = first_token; i < tokens_.size(); ++i) {
+    const auto& token = tokens_[i];
+    bool ok = true;
+    switch (token.op) {
+      case Op::LITERAL:
+        ok = cur < end && *cur == token.literal;
+        ++cur;
+        break;
+      case Op::WHITESPACE:
+        while (cur < end && isSpace(*cur)) {
+          ++cur;
+        }
+        break;
+      case Op::YEAR:
+        ok = readNumber(&cur, end, 4, 4, &year);
+        break;
+      case Op::MONTH:
+        ok = readNumber(&cur, end, 1, 2, &month);
+        break;
+      case Op::MONTH_NAME:
+        ok = readMonthName(&cur, end, &month);
+        break;
+      case Op::DAY_PADDED:
+        if (cur < end && *cur == ' ') {
+          ++cur;
+        }
+        /* fallthrough */
+      case Op::DAY:
+        ok = readNumber(&cur, end, 1, 2, &day);
+        break;
+      case Op::HOUR:
+        ok = readNumber(&cur, end, 1, 2, &hour);
+        break;
+      case Op::MINUTE:
+        ok = readNumber(&cur, end, 1, 2, &minute);
+        break;
+      case Op::SECOND:
+        ok = readNumber(&cur, end, 1, 2, &second);
+        break;
+      case Op::FRACTION: {
+        const char* begin = cur;
+        ok = readNumber(&cur, end, 1, 9, &micros);
+        for (auto n = cur - begin; n < 6; ++n) {
+          micros *= 10;
+        }
+        for (auto n = cur - begin; n > 6; --n) {
+          micros /= 10;
+        }
+        break;
+      }
+      case Op::ZONE:
+        ok = readZone(&cur, end, &zone_offset);
+        break;
+      case Op::EPOCH_SECONDS:
+        ok = readNumber(&cur, end, 1, 12, &epoch);
+        has_epoch = true;
+        break;
+    }
+
+    if (!ok) {
+      return false;
+    }
+
+    if (i + 1 == cache_tokens_) {
+      ok = resolveLocalSeconds(
+          year,
+          month,
+          day,
+          hour,
+          minute,
+          second,
+          &local_seconds);
+
+      if (!ok) {
+        return false;
+      }
+
+      has_local_seconds = true;
+      if (size_t(cur - data) <= sizeof(cache_text_)) {
+        cache_len_ = cur - data;
+        memcpy(cache_text_, data, cache_len_);
+        cache_seconds_ = local_seconds;
+      }
+    }
+  }
+
+  if (cur != end) {
+    return false;
+  }
+
+  int64_t seconds;
+  if (has_epoch) {
+    seconds = epoch;
+  } else if (has_local_seconds) {
+    seconds = local_seconds;
+  } else if (!resolveLocalSeconds(
+      year,
+      month,
+      day,
+      hour,
+      minute,
+      second,
+      &seconds)) {
+    return false;
+  }
+
+  seconds -= zone_offset;
+  if (seconds < 0) {
+    return false;
+  }
+
+  *unix_micros = seconds * 1000000ull + micros;
+  return true;
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2016 DeepCortex GmbH <legal@eventql.io>
+ * Authors:
+ *   - Paul Asmuth <paul@eventql.io>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License ("the license") as
+ * published by the Free Software Foundation, either version 3 of the License,
+ * or any later version.
+ *
+ * In accordance with Section 7(e) of the license, the licensing of the Program
+ * under the license does not imply a trademark license. Therefore any rights,
+ * title and interest in our trademarks remain entirely with us.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the license for more details.
+ *
+ * You can be released from the requirements of the license by purchasing a
+ * commercial license. Buying such a license is mandatory as soon as you develop
+ * commercial activities involving this program without disclosing the source
+ * code of your own applications
+ */
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "return_code.h"
+
+/**
+ * Parses timestamps in a strptime-like format. Unlike strptime/timegm it does
+ * not depend on the locale or the TZ environment and does not allocate, so it
+ * is cheap enough to run for every log line. Supported conversions:
+ *
+ *   %Y  year (4 digits)             %b  month name (Jan or January)
+ *   %m  month (1-2 digits)          %z  UTC offset (+hhmm, +hh:mm, +hh or Z)
+ *   %d  day of month (1-2 digits)   %s  seconds since epoch
+ *   %e  like %d, may be space padded
+ *   %H  hour (1-2 digits)           %T  same as %H:%M:%S
+ *   %M  minute (1-2 digits)         %F  same as %Y-%m-%d
+ *   %S  second (1-2 digits)         %%  a literal %
+ *   %f  fraction of a second (1-9 digits)
+ *
+ * A space in the format matches any amount of whitespace. Times without %z
+ * are interpreted as UTC. Formats without a year (e.g. the syslog format
+ * "%b %e %T") use the current year, or the previous one if the time would
+ * otherwise be more than a day in the future. Formats without a date are
+ * rejected.
+ *
+ * The parser remembers the text up to the last date/time conversion of the
+ * previous input (e.g. "23/Aug/2016:13:37:00"); if the next input starts
+ * with the same text only the remainder (fraction, zone) is parsed
+ */
+class TimeParser {
+public:
+
+  TimeParser();
+
+  ReturnCode compile(const std::string& format);
+
+  /**
+   * Parse a timestamp; the whole input must match the format
+   *
+   * @return true on success, false if the input does not match the format or
+   * is before the epoch
+   */
+  bool parse(const char* data, size_t size, uint64_t* unix_micros);
+
+protected:
+
+  enum class Op : uint8_t {
+    LITERAL,
+    WHITESPACE,
+    YEAR,
+    MONTH,
+    MONTH_NAME,
+    DAY,
+    DAY_PADDED,
+    HOUR,
+    MINUTE,
+    SECOND,
+    FRACTION,
+    ZONE,
+    EPOCH_SECONDS
+  };
+
+  struct Token {
+    Op op;
+    char literal;
+  };
+
+  static bool toLocalSeconds(
+      uint64_t year,
+      uint64_t month,
+      uint64_t day,
+      uint64_t hour,
+      uint64_t minute,
+      uint64_t second,
+      int64_t* seconds);
+
+  static bool toLocalSecondsInCurrentYear(
+      uint64_t month,
+      uint64_t day,
+      uint64_t hour,
+      uint64_t minute,
+      uint64_t second,
+      int64_t* seconds);
+
+  bool resolveLocalSeconds(
+      uint64_t year,
+      uint64_t month,
+      uint64_t day,
+      uint64_t hour,
+      uint64_t minute,
+      uint64_t second,
+      int64_t* seconds) const;
+
+  std::vector<Token> tokens_;
+  bool infer_year_;
+
+  /* number of leading tokens whose result is cached; 0 if not cacheable */
+  size_t cache_tokens_;
+  char cache_text_[64];
+  size_t cache_len_;
+  int64_t cache_seconds_;
+};
+